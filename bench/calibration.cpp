@@ -0,0 +1,152 @@
+// Cost of the To calculation per subpage before and after the calibration was compiled: CalculateTo, which rescales
+// kta, kv and alpha for every pixel, against CalculateToCompiled and the cached kernel, plus the one-off cost of
+// MLX90640_CompileParameters. Frames come from the simulator. Run with: pio run -e bench_calibration -t exec
+// Cycles are time stamp counter ticks where the host has one, nanoseconds otherwise
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "MLX90640_API.h"
+#include "MLX90640_I2C_Driver.h"
+#include "MLX90640_Simulator.h"
+
+#define SENSOR_ADDRESS 0x33
+#define BENCH_FRAMES 16
+#define BENCH_ROUNDS 200
+#define COMPILE_ROUNDS 2000
+
+static simulatorMLX90640 simulator;
+static transportMLX90640 transport;
+static paramsMLX90640 params;
+static compiledParamsMLX90640 compiled;
+static frameContextMLX90640 context;
+static uint16_t frames[BENCH_FRAMES][834];
+static float expected[768];
+static float result[768];
+
+static uint64_t nowNanos()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t nowCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return nowNanos();
+#endif
+}
+
+struct Timing
+{
+  double nanos;
+  double cycles;
+};
+
+enum Variant
+{
+  VARIANT_REFERENCE,
+  VARIANT_COMPILED,
+  VARIANT_CACHED,
+};
+
+static void calculate(Variant variant, uint16_t *frameData)
+{
+  switch (variant)
+  {
+  case VARIANT_REFERENCE:
+    MLX90640_CalculateTo(frameData, &params, 0.95f, 23, result);
+    break;
+  case VARIANT_COMPILED:
+    MLX90640_CalculateToCompiled(frameData, &params, &compiled, 0.95f, 23, result);
+    break;
+  case VARIANT_CACHED:
+    MLX90640_UpdateFrameContext(frameData, &params, &compiled, &context);
+    MLX90640_CalculateToCached(frameData, &params, &compiled, &context, 0.95f, 23, result);
+    break;
+  }
+}
+
+// Per subpage, over every recorded frame
+static Timing timeVariant(Variant variant)
+{
+  uint64_t startNanos = nowNanos();
+  uint64_t startCycles = nowCycles();
+  for (int round = 0; round < BENCH_ROUNDS; round++)
+    for (int frame = 0; frame < BENCH_FRAMES; frame++)
+      calculate(variant, frames[frame]);
+  Timing timing;
+  timing.cycles = (double)(nowCycles() - startCycles) / (BENCH_ROUNDS * BENCH_FRAMES);
+  timing.nanos = (double)(nowNanos() - startNanos) / (BENCH_ROUNDS * BENCH_FRAMES);
+  return timing;
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  static const char *names[] = {"CalculateTo", "CalculateToCompiled", "CalculateToCached"};
+  uint16_t eeData[832];
+
+  MLX90640_SimulatorSyntheticEE(eeData);
+  MLX90640_SimulatorInit(&simulator, SENSOR_ADDRESS, eeData, false);
+  MLX90640_SimulatorTransport(&simulator, &transport);
+  int device = MLX90640_I2CAttach(SENSOR_ADDRESS, &transport);
+  if (device < 0 || MLX90640_ExtractParameters(eeData, &params) != 0)
+  {
+    printf("simulator setup failed\n");
+    return 1;
+  }
+  for (int frame = 0; frame < BENCH_FRAMES; frame++)
+  {
+    MLX90640_SimulatorSetAmbient(&simulator, 20 + frame * 0.01f);
+    if (MLX90640_GetFrameData(device, frames[frame]) < 0)
+    {
+      printf("frame %d failed\n", frame);
+      return 1;
+    }
+  }
+
+  uint64_t startNanos = nowNanos();
+  uint64_t startCycles = nowCycles();
+  for (int round = 0; round < COMPILE_ROUNDS; round++)
+    MLX90640_CompileParameters(&params, &compiled);
+  printf("MLX90640_CompileParameters, once per boot: %.0f cycles, %.1f us\n\n", (double)(nowCycles() - startCycles) / COMPILE_ROUNDS,
+         (double)(nowNanos() - startNanos) / COMPILE_ROUNDS / 1e3);
+
+  MLX90640_InitFrameContext(&context, 0.01f, 0.05f);
+  printf("%-22s %14s %10s %8s %s\n", "per subpage", "cycles", "us", "speedup", "To vs CalculateTo");
+  Timing before = timeVariant(VARIANT_REFERENCE);
+  for (int variant = VARIANT_REFERENCE; variant <= VARIANT_CACHED; variant++)
+  {
+    Timing timing = variant == VARIANT_REFERENCE ? before : timeVariant((Variant)variant);
+
+    // The cached kernel keeps its own operation order, the compiled one has to match bit for bit
+    float maxDelta = 0;
+    bool identical = true;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++)
+    {
+      MLX90640_CalculateTo(frames[frame], &params, 0.95f, 23, expected);
+      memcpy(result, expected, sizeof(result));
+      calculate((Variant)variant, frames[frame]);
+      identical = identical && memcmp(expected, result, sizeof(result)) == 0;
+      for (int i = 0; i < 768; i++)
+        if (fabsf(result[i] - expected[i]) > maxDelta)
+          maxDelta = fabsf(result[i] - expected[i]);
+    }
+
+    printf("%-22s %14.0f %10.2f %7.2fx %s", names[variant], timing.cycles, timing.nanos / 1e3, before.nanos / timing.nanos,
+           identical ? "bit identical\n" : "");
+    if (!identical)
+      printf("max %.6f C\n", maxDelta);
+  }
+  printf("\ncache: %u hits, %u rebuilds\n", (unsigned)context.cacheHits, (unsigned)context.cacheRebuilds);
+
+  MLX90640_I2CDetach(device);
+  return 0;
+}
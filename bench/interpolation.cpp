@@ -0,0 +1,236 @@
+// Upscalers of the thermal image side by side: time per 320x240 frame and how far their color indexes are from
+// the same upscaling done in float without quantization, or for blocks and grid from the fillRect drawing they
+// replaced. Run with: pio run -e bench_interpolation -t exec
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "interpolation.h"
+
+#define MATRIX_X 32
+#define MATRIX_Y 24
+#define IMAGE_WIDTH 320
+#define IMAGE_HEIGHT 240
+#define TEMP_RANGE_MIN 25
+#define TEMP_RANGE_MAX 37
+#define BENCH_FRAMES 50
+#define BENCH_ROUNDS 10
+
+static InterpolationTables tables;
+static float temperatures[MATRIX_X * MATRIX_Y];
+static uint16_t image[IMAGE_WIDTH * IMAGE_HEIGHT];
+static float expected[IMAGE_WIDTH * IMAGE_HEIGHT]; // Color indexes, 0..255 within the range
+
+struct Upscaler
+{
+  const char *name;
+  void (*render)(uint16_t *out);
+  float (*reference)(int h, int w); // Unquantized color index of an image pixel, NAN for a grid line
+  InterpolationMode kernel; // Prepared in the tables before timing, INTERPOLATION_BILINEAR: none
+};
+
+static double nowMicros()
+{
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float colorIndex(float temperature)
+{
+  return (temperature - TEMP_RANGE_MIN) * 255 / (TEMP_RANGE_MAX - TEMP_RANGE_MIN);
+}
+
+// Source position of an image column or row, as prepareInterpolationAxis places it
+static void sourcePosition(int i, int source, int image, int *index, float *fraction)
+{
+  float position = (float)i * source / image;
+  *index = (int)position;
+  *fraction = position - *index;
+  if (*index >= source - 1)
+  {
+    *index = source - 1;
+    *fraction = 0;
+  }
+}
+
+static float bilinearReference(int h, int w)
+{
+  int x, y;
+  float fx, fy;
+  sourcePosition(w, MATRIX_X, IMAGE_WIDTH, &x, &fx);
+  sourcePosition(h, MATRIX_Y, IMAGE_HEIGHT, &y, &fy);
+  int x1 = x < MATRIX_X - 1 ? x + 1 : x;
+  int y1 = y < MATRIX_Y - 1 ? y + 1 : y;
+  const float *t = temperatures;
+  float upper = t[y * MATRIX_X + x] + (t[y * MATRIX_X + x1] - t[y * MATRIX_X + x]) * fx;
+  float lower = t[y1 * MATRIX_X + x] + (t[y1 * MATRIX_X + x1] - t[y1 * MATRIX_X + x]) * fx;
+  return colorIndex(upper + (lower - upper) * fy);
+}
+
+// Four taps around the source position, weights normalized in float, edge pixels repeated
+static void kernelTaps(InterpolationMode kernel, int i, int source, int image, int *index, float *weight)
+{
+  int x;
+  float fraction;
+  float sum = 0;
+  sourcePosition(i, source, image, &x, &fraction);
+  for (int k = 0; k < KERNEL_TAPS; k++)
+  {
+    int tap = x - 1 + k;
+    index[k] = tap < 0 ? 0 : tap >= source ? source - 1 : tap;
+    weight[k] = kernelWeight(kernel, fraction + 1 - k);
+    sum += weight[k];
+  }
+  for (int k = 0; k < KERNEL_TAPS; k++)
+    weight[k] /= sum;
+}
+
+static float kernelReference(InterpolationMode kernel, int h, int w)
+{
+  int x[KERNEL_TAPS], y[KERNEL_TAPS];
+  float wx[KERNEL_TAPS], wy[KERNEL_TAPS];
+  float value = 0;
+  kernelTaps(kernel, w, MATRIX_X, IMAGE_WIDTH, x, wx);
+  kernelTaps(kernel, h, MATRIX_Y, IMAGE_HEIGHT, y, wy);
+  for (int j = 0; j < KERNEL_TAPS; j++)
+    for (int k = 0; k < KERNEL_TAPS; k++)
+      value += wy[j] * wx[k] * temperatures[y[j] * MATRIX_X + x[k]];
+  return colorIndex(value);
+}
+
+static float bicubicReference(int h, int w)
+{
+  return kernelReference(INTERPOLATION_BICUBIC, h, w);
+}
+
+static float lanczos2Reference(int h, int w)
+{
+  return kernelReference(INTERPOLATION_LANCZOS2, h, w);
+}
+
+// Blocks are colored like fillRect drew them, through mapf
+static float blockReference(int h, int w)
+{
+  int x, y;
+  float fraction;
+  sourcePosition(w, MATRIX_X, IMAGE_WIDTH, &x, &fraction);
+  sourcePosition(h, MATRIX_Y, IMAGE_HEIGHT, &y, &fraction);
+  return mapf(temperatures[y * MATRIX_X + x], TEMP_RANGE_MIN, TEMP_RANGE_MAX);
+}
+
+// Lines on the first row and column of every block but the top and left ones
+static float gridReference(int h, int w)
+{
+  if ((h > 0 && h * MATRIX_Y / IMAGE_HEIGHT != (h - 1) * MATRIX_Y / IMAGE_HEIGHT) ||
+      (w > 0 && w * MATRIX_X / IMAGE_WIDTH != (w - 1) * MATRIX_X / IMAGE_WIDTH))
+    return NAN;
+  return blockReference(h, w);
+}
+
+// How blocks were drawn before blockRows, a fillRect per sensor pixel
+static void renderFillRect(uint16_t *out)
+{
+  int scaleX = IMAGE_WIDTH / MATRIX_X;
+  int scaleY = IMAGE_HEIGHT / MATRIX_Y;
+  for (int h = 0; h < MATRIX_Y; h++)
+    for (int w = 0; w < MATRIX_X; w++)
+    {
+      uint16_t color = colorMap[mapf(temperatures[h * MATRIX_X + w], TEMP_RANGE_MIN, TEMP_RANGE_MAX)];
+      for (int y = h * scaleY; y < (h + 1) * scaleY; y++)
+        for (int x = w * scaleX; x < (w + 1) * scaleX; x++)
+          out[y * IMAGE_WIDTH + x] = color;
+    }
+}
+
+static void renderBlocks(uint16_t *out)
+{
+  upscaleRows(&tables, INTERPOLATION_BLOCKS, temperatures, out, TEMP_RANGE_MIN, TEMP_RANGE_MAX, 0, IMAGE_HEIGHT, colorMap);
+}
+
+static void renderGrid(uint16_t *out)
+{
+  upscaleRows(&tables, INTERPOLATION_GRID, temperatures, out, TEMP_RANGE_MIN, TEMP_RANGE_MAX, 0, IMAGE_HEIGHT, colorMap);
+}
+
+static void renderLegacy(uint16_t *out)
+{
+  interpolateLegacy(temperatures, out, MATRIX_X, MATRIX_Y, IMAGE_WIDTH, IMAGE_HEIGHT, TEMP_RANGE_MIN, TEMP_RANGE_MAX);
+}
+
+static void renderBilinear(uint16_t *out)
+{
+  upscaleRows(&tables, INTERPOLATION_BILINEAR, temperatures, out, TEMP_RANGE_MIN, TEMP_RANGE_MAX, 0, IMAGE_HEIGHT, colorMap);
+}
+
+static void renderBicubic(uint16_t *out)
+{
+  upscaleRows(&tables, INTERPOLATION_BICUBIC, temperatures, out, TEMP_RANGE_MIN, TEMP_RANGE_MAX, 0, IMAGE_HEIGHT, colorMap);
+}
+
+static void renderLanczos2(uint16_t *out)
+{
+  upscaleRows(&tables, INTERPOLATION_LANCZOS2, temperatures, out, TEMP_RANGE_MIN, TEMP_RANGE_MAX, 0, IMAGE_HEIGHT, colorMap);
+}
+
+static const Upscaler upscalers[] = {
+    {"fillRect", renderFillRect, blockReference, INTERPOLATION_BILINEAR},
+    {"blocks", renderBlocks, blockReference, INTERPOLATION_BILINEAR},
+    {"grid", renderGrid, gridReference, INTERPOLATION_BILINEAR},
+    {"legacy", renderLegacy, bilinearReference, INTERPOLATION_BILINEAR},
+    {"bilinear", renderBilinear, bilinearReference, INTERPOLATION_BILINEAR},
+    {"bicubic", renderBicubic, bicubicReference, INTERPOLATION_BICUBIC},
+    {"lanczos2", renderLanczos2, lanczos2Reference, INTERPOLATION_LANCZOS2},
+};
+
+// Distance of a color to the reference index, over every index that has this color
+static int indexError(uint16_t color, float reference)
+{
+  if (isnan(reference)) return color == INTERPOLATION_GRID_COLOR ? 0 : 256;
+  int target = reference < 0 ? 0 : reference > 255 ? 255 : (int)reference;
+  int best = 256;
+  for (int i = 0; i < 256; i++)
+    if (colorMap[i] == color && abs(i - target) < best) best = abs(i - target);
+  return best;
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  // A smooth scene over the range with a hot and a cold spot beyond it
+  for (int i = 0; i < MATRIX_X * MATRIX_Y; i++)
+    temperatures[i] = 25 + 12 * (0.5f + 0.5f * sinf(i * 0.37f)) + (i % MATRIX_X) * 0.05f;
+  temperatures[300] = 80;
+  temperatures[301] = -10;
+  prepareInterpolationTables(&tables, MATRIX_X, MATRIX_Y, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+  printf("%-10s %10s %10s %16s %14s\n", "upscaler", "us/frame", "Mpixel/s", "max index error", "pixels off >1");
+  for (const Upscaler &upscaler : upscalers)
+  {
+    if (upscaler.kernel != INTERPOLATION_BILINEAR)
+      prepareInterpolationKernel(&tables, upscaler.kernel); // Once at startup on the device
+    double best = INFINITY;
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+      double start = nowMicros();
+      for (int frame = 0; frame < BENCH_FRAMES; frame++)
+        upscaler.render(image);
+      best = fmin(best, (nowMicros() - start) / BENCH_FRAMES);
+    }
+
+    int maxError = 0;
+    int off = 0;
+    for (int h = 0; h < IMAGE_HEIGHT; h++)
+      for (int w = 0; w < IMAGE_WIDTH; w++)
+        expected[h * IMAGE_WIDTH + w] = upscaler.reference(h, w);
+    for (int i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++)
+    {
+      int error = indexError(image[i], expected[i]);
+      if (error > maxError) maxError = error;
+      if (error > 1) off++;
+    }
+    printf("%-10s %10.1f %10.1f %16d %13.2f%%\n", upscaler.name, best, IMAGE_WIDTH * IMAGE_HEIGHT / best, maxError, 100.0 * off / (IMAGE_WIDTH * IMAGE_HEIGHT));
+  }
+  return 0;
+}
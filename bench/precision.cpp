@@ -0,0 +1,208 @@
+// Max per-pixel deviation of the firmware's single precision To calculation from the double precision reference,
+// over a corpus of recordings (see recorder.h), or over simulator frames when none is given. Run with:
+//   pio run -e bench_precision -t exec
+//   .pio/build/bench_precision/program 0000_0001_R.mlx ...
+// The firmware column keeps the coefficient cache at its drift tolerances, the fresh column rebuilds it every
+// time Vdd or Ta move at all, so what is left there is the float arithmetic alone
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "MLX90640_API.h"
+#include "MLX90640_I2C_Driver.h"
+#include "MLX90640_Simulator.h"
+#include "recorder.h"
+#include "sensor.h"
+
+#define SENSOR_ADDRESS 0x33
+#define SIMULATED_SUBPAGES 256
+
+struct Deviation
+{
+  float max;
+  float maxTo; // Reference temperature of the worst pixel
+  double sum;
+  uint32_t pixels;
+};
+
+struct Corpus
+{
+  paramsMLX90640 params;
+  compiledParamsMLX90640 compiled;
+  frameContextMLX90640 cached;
+  frameContextMLX90640 fresh;
+  Deviation firmware;
+  Deviation freshContext;
+  uint32_t subpages;
+};
+
+static Corpus total;
+
+static void deviate(Deviation *deviation, const float *result, const float *reference, uint16_t subPage,
+                    const compiledParamsMLX90640 *compiled, uint16_t mode)
+{
+  const pixelPlanMLX90640 *plan = &compiled->plan[mode][subPage];
+  for (int i = 0; i < 384; i++)
+  {
+    int pixelNumber = plan->pixel[i];
+    float delta = fabsf(result[pixelNumber] - reference[pixelNumber]);
+    if (delta > deviation->max)
+    {
+      deviation->max = delta;
+      deviation->maxTo = reference[pixelNumber];
+    }
+    deviation->sum += delta;
+    deviation->pixels++;
+  }
+}
+
+static void beginCorpus(Corpus *corpus)
+{
+  memset(&corpus->firmware, 0, sizeof(corpus->firmware));
+  memset(&corpus->freshContext, 0, sizeof(corpus->freshContext));
+  corpus->subpages = 0;
+  MLX90640_CompileParameters(&corpus->params, &corpus->compiled);
+  MLX90640_InitFrameContext(&corpus->cached, SENSOR_VDD_CACHE_TOLERANCE, SENSOR_TA_CACHE_TOLERANCE);
+  MLX90640_InitFrameContext(&corpus->fresh, 0, 0);
+}
+
+static void measure(Corpus *corpus, uint16_t *frameData)
+{
+  float result[768];
+  float fresh[768];
+  float reference[768];
+  uint16_t mode = (frameData[832] & 0x1000) >> 12;
+
+  if (frameData[833] > 1)
+    return;
+  MLX90640_UpdateFrameContext(frameData, &corpus->params, &corpus->compiled, &corpus->cached);
+  MLX90640_UpdateFrameContext(frameData, &corpus->params, &corpus->compiled, &corpus->fresh);
+
+  float tr = corpus->cached.ta - SENSOR_DEFAULT_TA_SHIFT;
+  MLX90640_CalculateToCached(frameData, &corpus->params, &corpus->compiled, &corpus->cached, SENSOR_DEFAULT_EMISSIVITY, tr, result);
+  MLX90640_CalculateToCached(frameData, &corpus->params, &corpus->compiled, &corpus->fresh, SENSOR_DEFAULT_EMISSIVITY, tr, fresh);
+  MLX90640_CalculateToReference(frameData, &corpus->params, &corpus->compiled, SENSOR_DEFAULT_EMISSIVITY, tr, reference);
+
+  deviate(&corpus->firmware, result, reference, frameData[833], &corpus->compiled, mode);
+  deviate(&corpus->freshContext, fresh, reference, frameData[833], &corpus->compiled, mode);
+  corpus->subpages++;
+}
+
+static void merge(Deviation *into, const Deviation *from)
+{
+  if (from->max > into->max)
+  {
+    into->max = from->max;
+    into->maxTo = from->maxTo;
+  }
+  into->sum += from->sum;
+  into->pixels += from->pixels;
+}
+
+static void report(const char *name, const Corpus *corpus)
+{
+  const Deviation *deviations[2] = {&corpus->firmware, &corpus->freshContext};
+  printf("%-32s %9u", name, (unsigned)corpus->subpages);
+  for (int i = 0; i < 2; i++)
+    printf(" %10.6f C at %7.2f C, mean %9.7f C", deviations[i]->max, deviations[i]->maxTo,
+           deviations[i]->pixels ? deviations[i]->sum / deviations[i]->pixels : 0);
+  printf("\n");
+}
+
+static void addToTotal(const Corpus *corpus)
+{
+  total.subpages += corpus->subpages;
+  merge(&total.firmware, &corpus->firmware);
+  merge(&total.freshContext, &corpus->freshContext);
+}
+
+static bool measureRecording(Corpus *corpus, const char *path)
+{
+  RecordingHeader header;
+  RecordingFrame frame;
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return false;
+  }
+
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, RECORDING_MAGIC, 4) == 0 &&
+            header.version == RECORDING_VERSION && header.frameBytes == sizeof(RecordingFrame) &&
+            header.headerBytes >= sizeof(RecordingHeader) && fseek(file, header.headerBytes, SEEK_SET) == 0;
+  if (!ok)
+  {
+    fprintf(stderr, "%s: not a version %d recording\n", path, RECORDING_VERSION);
+    fclose(file);
+    return false;
+  }
+
+  if (MLX90640_ExtractParameters(header.eeData, &corpus->params) != 0)
+    fprintf(stderr, "%s: EEPROM reports too many bad pixels, continuing\n", path);
+  beginCorpus(corpus);
+  while (fread(&frame, sizeof(frame), 1, file) == 1)
+    measure(corpus, frame.frameData);
+  fclose(file);
+  return true;
+}
+
+// Both readout modes over the simulator's default scene, while the ambient drifts from 25 to 28 degrees
+static bool measureSimulator(Corpus *corpus)
+{
+  static simulatorMLX90640 simulator;
+  static transportMLX90640 transport;
+  uint16_t eeData[832];
+  uint16_t frameData[834];
+
+  MLX90640_SimulatorSyntheticEE(eeData);
+  MLX90640_SimulatorInit(&simulator, SENSOR_ADDRESS, eeData, false);
+  MLX90640_SimulatorTransport(&simulator, &transport);
+  int device = MLX90640_I2CAttach(SENSOR_ADDRESS, &transport);
+  if (device < 0 || MLX90640_ExtractParameters(eeData, &corpus->params) != 0)
+    return false;
+
+  beginCorpus(corpus);
+  for (int i = 0; i < SIMULATED_SUBPAGES; i++)
+  {
+    if (i % (SIMULATED_SUBPAGES / 2) == 0 &&
+        (i == 0 ? MLX90640_SetInterleavedMode(device) : MLX90640_SetChessMode(device)) != 0)
+      break;
+    MLX90640_SimulatorSetAmbient(&simulator, 25 + 3.0f * (i % (SIMULATED_SUBPAGES / 2)) / (SIMULATED_SUBPAGES / 2));
+    if (MLX90640_GetFrameData(device, frameData) < 0)
+      break;
+    measure(corpus, frameData);
+  }
+  MLX90640_I2CDetach(device);
+  return corpus->subpages == SIMULATED_SUBPAGES;
+}
+
+int main(int argc, char **argv)
+{
+  static Corpus corpus;
+  int failed = 0;
+
+  printf("%-32s %9s %-44s %-44s\n", "single vs double precision", "subpages", " firmware: max deviation", " fresh context: max deviation");
+  if (argc < 2)
+  {
+    if (!measureSimulator(&corpus))
+    {
+      fprintf(stderr, "simulator: frames failed\n");
+      return 1;
+    }
+    report("simulator", &corpus);
+  }
+  for (int i = 1; i < argc; i++)
+  {
+    if (measureRecording(&corpus, argv[i]))
+    {
+      report(argv[i], &corpus);
+      addToTotal(&corpus);
+    }
+    else
+      failed++;
+  }
+  if (argc > 2)
+    report("corpus", &total);
+
+  return failed ? 1 : 0;
+}
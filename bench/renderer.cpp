@@ -0,0 +1,128 @@
+// Steady state display throughput of the band renderer against the full frame path it replaced, on a MockDisplay
+// that takes the bus time of a real panel, and the RAM the bands free. Run with: pio run -e bench_renderer -t exec
+// The mock sleeps out each transfer, a host oversleeps by some ten microseconds per band, which shows when the
+// render cost is left at the host's
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "renderer.h"
+
+#define IMAGE_WIDTH 320
+#define IMAGE_HEIGHT 240
+#define BENCH_FRAMES 30
+#define MARKER_X 100
+#define MARKER_Y 17
+
+static InterpolationTables tables;
+static float temperatures[768];
+static uint16_t expected[IMAGE_WIDTH * IMAGE_HEIGHT];
+static uint16_t framebuffer[IMAGE_WIDTH * IMAGE_HEIGHT];
+static uint16_t frameInterpolated[IMAGE_WIDTH * IMAGE_HEIGHT]; // The full frame path's buffers
+static uint16_t sprite[IMAGE_WIDTH * IMAGE_HEIGHT];
+static uint32_t deviceRenderMicros = 0; // Extra render time per frame, standing in for the device's slower core
+
+static uint32_t nowMicros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Busy, like the core would be, rather than asleep
+static void spinMicros(uint32_t us)
+{
+  uint32_t start = nowMicros();
+  while (nowMicros() - start < us)
+    ;
+}
+
+static void overlay(BandRenderer *renderer, uint16_t *band, int firstRow, int rows)
+{
+  spinMicros(deviceRenderMicros * rows / IMAGE_HEIGHT);
+  rendererDrawMarker(band, IMAGE_WIDTH, firstRow, rows, MARKER_X, MARKER_Y, renderer->swapBytes);
+}
+
+// Interpolate into a frame buffer, copy it into the sprite in the display's byte order, push the sprite and wait
+static void drawFullFrame(const BandRenderer *renderer, const DisplayBackend *display)
+{
+  rendererRenderImage(renderer, temperatures, 25, 37, INTERPOLATION_BILINEAR, frameInterpolated);
+  spinMicros(deviceRenderMicros);
+  for (int i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++)
+    sprite[i] = (frameInterpolated[i] >> 8) | (frameInterpolated[i] << 8);
+  rendererDrawMarker(sprite, IMAGE_WIDTH, 0, IMAGE_HEIGHT, MARKER_X, MARKER_Y, true);
+  display->push(display->context, 0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, sprite);
+  display->wait(display->context);
+}
+
+static const char *matches()
+{
+  return memcmp(framebuffer, expected, sizeof(framebuffer)) == 0 ? "ok" : "MISMATCH";
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  static const uint32_t busSpeeds[] = {40000000, 80000000, 160000000};
+  static const uint32_t renderCosts[] = {0, 20000};
+  static MockDisplay mock;
+  static DisplayBackend display;
+  static DisplayBackend displayTask;
+  bool displayTaskStarted = false;
+
+  for (int i = 0; i < 768; i++)
+    temperatures[i] = 25 + 12 * (0.5f + 0.5f * sinf(i * 0.37f));
+  prepareInterpolationTables(&tables, 32, 24, IMAGE_WIDTH, IMAGE_HEIGHT);
+
+  BandRenderer reference;
+  rendererBegin(&reference, &display, &tables, 0, 0, RENDERER_BAND_ROWS, true);
+  rendererRenderImage(&reference, temperatures, 25, 37, INTERPOLATION_BILINEAR, expected);
+  rendererDrawMarker(expected, IMAGE_WIDTH, 0, IMAGE_HEIGHT, MARKER_X, MARKER_Y, false);
+
+  uint32_t fullFrameBytes = 2 * sizeof(frameInterpolated);
+  uint32_t bandBytes = 2 * rendererBandBytes(&reference);
+  printf("RAM: full frame path %u bytes, bands %u bytes, %u bytes freed\n", fullFrameBytes, bandBytes, fullFrameBytes - bandBytes);
+  printf("%-12s %-10s %-14s %14s %14s %10s %10s %10s\n", "extra render", "bus", "band backend", "full frame fps", "bands fps", "bus ms", "render ms", "wait ms");
+
+  for (uint32_t renderCost : renderCosts)
+    for (uint32_t busSpeed : busSpeeds)
+    {
+      deviceRenderMicros = renderCost;
+      mock = MockDisplay();
+      mock.framebuffer = framebuffer;
+      mock.width = IMAGE_WIDTH;
+      mock.height = IMAGE_HEIGHT;
+      mock.bitsPerSecond = busSpeed;
+      mock.swapBytes = true;
+      rendererMockDisplay(&mock, &display);
+      if (!displayTaskStarted) displayTaskStarted = rendererDisplayTask(&display, 0, &displayTask);
+
+      memset(framebuffer, 0, sizeof(framebuffer));
+      uint32_t start = nowMicros();
+      for (int f = 0; f < BENCH_FRAMES; f++)
+        drawFullFrame(&reference, &display);
+      float fullFps = BENCH_FRAMES * 1e6f / (nowMicros() - start);
+      const char *fullResult = matches();
+
+      for (int backend = 0; backend < 2; backend++)
+      {
+        BandRenderer renderer;
+        if (!rendererBegin(&renderer, backend == 0 ? &display : &displayTask, &tables, 0, 0, RENDERER_BAND_ROWS, true)) return 1;
+        renderer.overlay = overlay;
+
+        memset(framebuffer, 0, sizeof(framebuffer));
+        rendererDraw(&renderer, temperatures, 25, 37, INTERPOLATION_BILINEAR); // Warm up
+        rendererResetStats(&renderer);
+        for (int f = 0; f < BENCH_FRAMES; f++)
+          rendererDraw(&renderer, temperatures, 25, 37, INTERPOLATION_BILINEAR);
+
+        printf("%9.1f ms %5u Mbit/s %-14s %9.1f (%s) %9.1f (%s) %10.2f %10.2f %10.2f\n", renderCost / 1e3, busSpeed / 1000000, backend == 0 ? "DMA" : "display task",
+               fullFps, fullResult, renderer.frames * 1e6f / renderer.frameMicros, matches(), (float)IMAGE_WIDTH * IMAGE_HEIGHT * 16 * 1e3f / busSpeed,
+               renderer.renderMicros / 1e3f / renderer.frames, renderer.waitMicros / 1e3f / renderer.frames);
+        rendererEnd(&renderer);
+      }
+    }
+
+  rendererEnd(&reference);
+  return 0;
+}
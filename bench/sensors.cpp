@@ -0,0 +1,107 @@
+// Several simulated sensors read concurrently, each by its own task (sensorStart) on its own transport, while this
+// thread takes their newest frames and stitches them side by side, as a wider camera would. Reported per number of
+// sensors: subpages read per second, read errors, stitched frames per second and the cost of one stitch. Real time
+// simulators signal data ready at the refresh rate, instant ones whenever they are polled, so there the sensors' own
+// acquisition schedules alone pace the reads. Run with: pio run -e bench_sensors -t exec
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+#include "MLX90640_Simulator.h"
+#include "sensor.h"
+
+#define MAX_SENSORS 4
+#define SENSOR_ADDRESS 0x33
+#define REFRESH_RATE 0x07 // 64Hz, 128 subpages/s per sensor
+#define RESOLUTION 0x03
+#define OVERLAP 4 // Columns seen by two neighbouring sensors
+#define BENCH_MILLIS 2000
+
+static simulatorMLX90640 simulators[MAX_SENSORS];
+static transportMLX90640 transports[MAX_SENSORS];
+static ThermalSensor sensors[MAX_SENSORS];
+static float stitched[SENSOR_MATRIX_Y * (MAX_SENSORS * SENSOR_MATRIX_X)];
+
+static uint64_t nowNanos()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool run(int count, bool realTime)
+{
+  uint16_t eeData[832];
+  const float *frames[MAX_SENSORS];
+  bool ok = true;
+  int started = 0;
+
+  MLX90640_SimulatorSyntheticEE(eeData);
+  for (int k = 0; k < count && ok; k++)
+  {
+    MLX90640_SimulatorInit(&simulators[k], SENSOR_ADDRESS + k, eeData, realTime);
+    MLX90640_SimulatorTransport(&simulators[k], &transports[k]);
+    ok = sensorInit(&sensors[k], SENSOR_ADDRESS + k, &transports[k]) == 0 && sensorReadParameters(&sensors[k], eeData) == 0 &&
+         sensorConfigure(&sensors[k], REFRESH_RATE, RESOLUTION, REFRESH_RATE, REFRESH_RATE, 1) == 0 && sensorStart(&sensors[k], k % 2);
+    if (ok) started++;
+  }
+
+  // Stitch whenever every sensor has published since the last stitch
+  uint32_t stitches = 0;
+  uint64_t stitchNanos = 0;
+  uint64_t start = nowNanos();
+  while (ok && nowNanos() - start < BENCH_MILLIS * 1000000ULL)
+  {
+    bool all = true;
+    for (int k = 0; k < count; k++)
+      all = all && tripleBufferFresh(&sensors[k].frames);
+    if (!all)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+
+    bool fresh;
+    for (int k = 0; k < count; k++)
+      frames[k] = tripleBufferTake(&sensors[k].frames, &fresh)->temp;
+    uint64_t stitchStart = nowNanos();
+    sensorStitch(frames, count, OVERLAP, stitched);
+    stitchNanos += nowNanos() - stitchStart;
+    stitches++;
+  }
+  double seconds = (nowNanos() - start) / 1e9;
+
+  uint32_t subpages = 0;
+  uint32_t errors = 0;
+  for (int k = 0; k < started; k++)
+  {
+    sensorStop(&sensors[k]);
+    subpages += sensors[k].subpages;
+    errors += sensors[k].errors;
+    MLX90640_I2CDetach(sensors[k].device);
+  }
+  if (!ok)
+  {
+    printf("%d sensors: setup failed\n", count);
+    return false;
+  }
+
+  printf("%7d %5dx%-3d %12.1f %12.1f %7u %12.1f %10.2f\n", count, sensorStitchedWidth(count, OVERLAP), SENSOR_MATRIX_Y,
+         subpages / seconds, subpages / seconds / count, (unsigned)errors, stitches / seconds, stitches ? stitchNanos / 1e3 / stitches : 0);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  bool ok = true;
+
+  for (int realTime = 1; realTime >= 0; realTime--)
+  {
+    printf("%s simulators, refresh rate 0x%02x, %d overlapping columns\n", realTime ? "Real time" : "Instant", REFRESH_RATE, OVERLAP);
+    printf("%7s %9s %12s %12s %7s %12s %10s\n", "sensors", "image", "subpages/s", "per sensor", "errors", "stitches/s", "stitch us");
+    for (int count = 1; count <= MAX_SENSORS; count++)
+      ok = run(count, realTime) && ok;
+    printf("\n");
+  }
+  return ok ? 0 : 1;
+}
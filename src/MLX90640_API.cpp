@@ -16,7 +16,9 @@
  */
 #include "MLX90640_I2C_Driver.h"
 #include "MLX90640_API.h"
+#include "simd.h"
 #include <math.h>
+#include <string.h>
 
 void ExtractVDDParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
 void ExtractPTATParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
@@ -34,31 +36,95 @@ void ExtractCILCParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
 int ExtractDeviatingPixels(uint16_t *eeData, paramsMLX90640 *mlx90640);
 int CheckAdjacentPixels(uint16_t pix1, uint16_t pix2);
 float GetMedian(float *values, int n);
-int IsPixelBad(uint16_t pixel, paramsMLX90640 *params);
+int IsPixelBad(uint16_t pixel, const paramsMLX90640 *params);
+float GetTaFromVdd(uint16_t *frameData, const paramsMLX90640 *params,
+                   float vdd);
+template <class real>
+real VddFromFrame(uint16_t *frameData, const paramsMLX90640 *params);
+template <class real>
+real TaFromFrame(uint16_t *frameData, const paramsMLX90640 *params, real vdd);
+void BuildPixelPlans(compiledParamsMLX90640 *compiled);
+void BuildCorrectionPlans(const paramsMLX90640 *params,
+                          compiledParamsMLX90640 *compiled);
+void PlanPixelCorrection(uint16_t pixel, int mode,
+                         const paramsMLX90640 *params,
+                         pixelCorrectionMLX90640 *entry);
+void SetPixelCorrection(pixelCorrectionMLX90640 *entry, uint8_t method,
+                        int neighbour0, int neighbour1, int neighbour2,
+                        int neighbour3);
 
 int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData) {
     return MLX90640_I2CRead(slaveAddr, 0x2400, 832, eeData);
 }
 
+//------------------------------------------------------------------------------
+
+// First 64 EEPROM words: device ID and every scalar calibration parameter
+int MLX90640_DumpEEHeader(uint8_t slaveAddr, uint16_t *eeData) {
+    return MLX90640_I2CRead(slaveAddr, 0x2400, 64, eeData);
+}
+
+//------------------------------------------------------------------------------
+
+// FNV-1a hash of the EEPROM header. The device ID words (0x2407..0x2409)
+// tie it to one sensor, so per-pixel words need not be read to tell whether
+// previously extracted parameters still apply
+uint32_t MLX90640_GetEEFingerprint(const uint16_t *eeData) {
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < 64; i++) {
+        hash = (hash ^ (eeData[i] & 0xFF)) * 16777619u;
+        hash = (hash ^ (eeData[i] >> 8)) * 16777619u;
+    }
+
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+
 int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData) {
+    int dataReady = 0;
+
+    while (dataReady == 0) {
+        dataReady = MLX90640_IsDataReady(slaveAddr);
+        if (dataReady < 0) {
+            return dataReady;
+        }
+    }
+
+    return MLX90640_ReadFrameData(slaveAddr, frameData);
+}
+
+//------------------------------------------------------------------------------
+
+// One poll of the status register: 1 when a new subpage is ready, 0 when not
+// yet, a negative bus error otherwise
+int MLX90640_IsDataReady(uint8_t slaveAddr) {
+    uint16_t statusRegister;
+    int error;
+
+    error = MLX90640_I2CRead(slaveAddr, 0x8000, 1, &statusRegister);
+    if (error != 0) {
+        return error;
+    }
+
+    return (statusRegister & 0x0008) != 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Read the subpage once MLX90640_IsDataReady reported it, returns the subpage
+// number or a negative error like MLX90640_GetFrameData
+int MLX90640_ReadFrameData(uint8_t slaveAddr, uint16_t *frameData) {
     uint16_t dataReady = 1;
     uint16_t controlRegister1;
     uint16_t statusRegister;
     int error   = 1;
     uint8_t cnt = 0;
 
-    dataReady = 0;
-    while (dataReady == 0) {
-        error = MLX90640_I2CRead(slaveAddr, 0x8000, 1, &statusRegister);
-        if (error != 0) {
-            return error;
-        }
-        dataReady = statusRegister & 0x0008;
-    }
-
     while (dataReady != 0 && cnt < 5) {
-        error = MLX90640_I2CWrite(slaveAddr, 0x8000, 0x0030);
-        if (error == -1) {
+        error = MLX90640_I2CWriteUnverified(slaveAddr, 0x8000, 0x0030);
+        if (error != 0) {
             return error;
         }
 
@@ -79,7 +145,9 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData) {
         return -8;
     }
 
-    error          = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    // Served from the driver's shadow copy, the host is the only writer
+    error =
+        MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
     frameData[832] = controlRegister1;
     frameData[833] = statusRegister & 0x0001;
 
@@ -120,7 +188,7 @@ int MLX90640_SetResolution(uint8_t slaveAddr, uint8_t resolution) {
 
     value = (resolution & 0x03) << 10;
 
-    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    error = MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
 
     if (error == 0) {
         value = (controlRegister1 & 0xF3FF) | value;
@@ -137,7 +205,7 @@ int MLX90640_GetCurResolution(uint8_t slaveAddr) {
     int resolutionRAM;
     int error;
 
-    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    error = MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
     if (error != 0) {
         return error;
     }
@@ -155,7 +223,7 @@ int MLX90640_SetRefreshRate(uint8_t slaveAddr, uint8_t refreshRate) {
 
     value = (refreshRate & 0x07) << 7;
 
-    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    error = MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
     if (error == 0) {
         value = (controlRegister1 & 0xFC7F) | value;
         error = MLX90640_I2CWrite(slaveAddr, 0x800D, value);
@@ -171,7 +239,7 @@ int MLX90640_GetRefreshRate(uint8_t slaveAddr) {
     int refreshRate;
     int error;
 
-    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    error = MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
     if (error != 0) {
         return error;
     }
@@ -187,7 +255,7 @@ int MLX90640_SetInterleavedMode(uint8_t slaveAddr) {
     int value;
     int error;
 
-    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    error = MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
 
     if (error == 0) {
         value = (controlRegister1 & 0xEFFF);
@@ -204,7 +272,7 @@ int MLX90640_SetChessMode(uint8_t slaveAddr) {
     int value;
     int error;
 
-    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    error = MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
 
     if (error == 0) {
         value = (controlRegister1 | 0x1000);
@@ -221,7 +289,7 @@ int MLX90640_GetCurMode(uint8_t slaveAddr) {
     int modeRAM;
     int error;
 
-    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    error = MLX90640_I2CReadCached(slaveAddr, 0x800D, &controlRegister1);
     if (error != 0) {
         return error;
     }
@@ -388,6 +456,710 @@ void MLX90640_CalculateTo(uint16_t *frameData, const paramsMLX90640 *params,
 
 //------------------------------------------------------------------------------
 
+void MLX90640_CompileParameters(const paramsMLX90640 *params,
+                                compiledParamsMLX90640 *compiled) {
+    float ktaScale;
+    float kvScale;
+    float alphaScale;
+
+    ktaScale   = pow(2, (double)params->ktaScale);
+    kvScale    = pow(2, (double)params->kvScale);
+    alphaScale = pow(2, (double)params->alphaScale);
+
+    for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++) {
+        compiled->kta[pixelNumber] = params->kta[pixelNumber] / ktaScale;
+        compiled->kv[pixelNumber]  = params->kv[pixelNumber] / kvScale;
+        compiled->alpha[pixelNumber] =
+            SCALEALPHA * alphaScale / params->alpha[pixelNumber];
+        compiled->offset[pixelNumber] = params->offset[pixelNumber];
+    }
+
+    BuildPixelPlans(compiled);
+    BuildCorrectionPlans(params, compiled);
+}
+
+//------------------------------------------------------------------------------
+
+void BuildPixelPlans(compiledParamsMLX90640 *compiled) {
+    int8_t ilPattern;
+    int8_t chessPattern;
+    int8_t pattern;
+    int8_t conversionPattern;
+    int count[2][2] = {{0, 0}, {0, 0}};
+    int entry;
+    pixelPlanMLX90640 *plan;
+
+    for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++) {
+        ilPattern         = pixelNumber / 32 - (pixelNumber / 64) * 2;
+        chessPattern      = ilPattern ^ (pixelNumber - (pixelNumber / 2) * 2);
+        conversionPattern = ((pixelNumber + 2) / 4 - (pixelNumber + 3) / 4 +
+                             (pixelNumber + 1) / 4 - pixelNumber / 4) *
+                            (1 - 2 * ilPattern);
+
+        for (int mode = 0; mode < 2; mode++) {
+            if (mode == 0) {
+                pattern = ilPattern;
+            } else {
+                pattern = chessPattern;
+            }
+
+            plan  = &compiled->plan[mode][pattern];
+            entry = count[mode][pattern];
+
+            plan->pixel[entry]             = pixelNumber;
+            plan->ilPattern[entry]         = ilPattern;
+            plan->conversionPattern[entry] = conversionPattern;
+            count[mode][pattern]           = entry + 1;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void BuildCorrectionPlans(const paramsMLX90640 *params,
+                          compiledParamsMLX90640 *compiled) {
+    const uint16_t *pixels[2] = {params->brokenPixels, params->outlierPixels};
+    correctionPlanMLX90640 *plan;
+
+    for (int mode = 0; mode < 2; mode++) {
+        plan        = &compiled->correction[mode];
+        plan->count = 0;
+
+        for (int list = 0; list < 2; list++) {
+            for (int i = 0; i < 5 && pixels[list][i] != 0xFFFF; i++) {
+                PlanPixelCorrection(pixels[list][i], mode, params,
+                                    &plan->entry[plan->count]);
+                plan->count = plan->count + 1;
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void PlanPixelCorrection(uint16_t pixel, int mode,
+                         const paramsMLX90640 *params,
+                         pixelCorrectionMLX90640 *entry) {
+    uint8_t line;
+    uint8_t column;
+
+    line         = pixel >> 5;
+    column       = pixel - (line << 5);
+    entry->pixel = pixel;
+
+    if (mode == 1) {
+        if (line == 0) {
+            if (column == 0) {
+                SetPixelCorrection(entry, MLX90640_CORRECTION_COPY, 33, 33,
+                                   33, 33);
+            } else if (column == 31) {
+                SetPixelCorrection(entry, MLX90640_CORRECTION_COPY, 62, 62,
+                                   62, 62);
+            } else {
+                SetPixelCorrection(entry, MLX90640_CORRECTION_AVERAGE,
+                                   pixel + 31, pixel + 33, pixel, pixel);
+            }
+        } else if (line == 23) {
+            if (column == 0) {
+                SetPixelCorrection(entry, MLX90640_CORRECTION_COPY, 705, 705,
+                                   705, 705);
+            } else if (column == 31) {
+                SetPixelCorrection(entry, MLX90640_CORRECTION_COPY, 734, 734,
+                                   734, 734);
+            } else {
+                SetPixelCorrection(entry, MLX90640_CORRECTION_AVERAGE,
+                                   pixel - 33, pixel - 31, pixel, pixel);
+            }
+        } else if (column == 0) {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_AVERAGE, pixel - 31,
+                               pixel + 33, pixel, pixel);
+        } else if (column == 31) {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_AVERAGE, pixel - 33,
+                               pixel + 31, pixel, pixel);
+        } else {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_MEDIAN, pixel - 33,
+                               pixel - 31, pixel + 31, pixel + 33);
+        }
+    } else {
+        if (column == 0) {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_COPY, pixel + 1,
+                               pixel, pixel, pixel);
+        } else if (column == 1 || column == 30) {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_AVERAGE, pixel - 1,
+                               pixel + 1, pixel, pixel);
+        } else if (column == 31) {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_COPY, pixel - 1,
+                               pixel, pixel, pixel);
+        } else if (IsPixelBad(pixel - 2, params) == 0 &&
+                   IsPixelBad(pixel + 2, params) == 0) {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_GRADIENT, pixel - 2,
+                               pixel - 1, pixel + 1, pixel + 2);
+        } else {
+            SetPixelCorrection(entry, MLX90640_CORRECTION_AVERAGE, pixel - 1,
+                               pixel + 1, pixel, pixel);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void SetPixelCorrection(pixelCorrectionMLX90640 *entry, uint8_t method,
+                        int neighbour0, int neighbour1, int neighbour2,
+                        int neighbour3) {
+    entry->method       = method;
+    entry->neighbour[0] = neighbour0;
+    entry->neighbour[1] = neighbour1;
+    entry->neighbour[2] = neighbour2;
+    entry->neighbour[3] = neighbour3;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateToCompiled(uint16_t *frameData,
+                                  const paramsMLX90640 *params,
+                                  const compiledParamsMLX90640 *compiled,
+                                  float emissivity, float tr, float *result) {
+    float vdd;
+    float ta;
+    float ta4;
+    float tr4;
+    float taTr;
+    float gain;
+    float irDataCP[2];
+    float irData;
+    float alphaCompensated;
+    uint8_t mode;
+    const pixelPlanMLX90640 *plan;
+    int pixelNumber;
+    float Sx;
+    float To;
+    float alphaCorrR[4];
+    int8_t range;
+    uint16_t subPage;
+
+    subPage = frameData[833];
+    vdd     = MLX90640_GetVdd(frameData, params);
+    ta      = MLX90640_GetTa(frameData, params);
+
+    ta4  = (ta + 273.15);
+    ta4  = ta4 * ta4;
+    ta4  = ta4 * ta4;
+    tr4  = (tr + 273.15);
+    tr4  = tr4 * tr4;
+    tr4  = tr4 * tr4;
+    taTr = tr4 - (tr4 - ta4) / emissivity;
+
+    alphaCorrR[0] = 1 / (1 + params->ksTo[0] * 40);
+    alphaCorrR[1] = 1;
+    alphaCorrR[2] = (1 + params->ksTo[1] * params->ct[2]);
+    alphaCorrR[3] =
+        alphaCorrR[2] * (1 + params->ksTo[2] * (params->ct[3] - params->ct[2]));
+
+    //------------------------- Gain calculation
+    //-----------------------------------
+    gain = frameData[778];
+    if (gain > 32767) {
+        gain = gain - 65536;
+    }
+
+    gain = params->gainEE / gain;
+
+    //------------------------- To calculation
+    //-------------------------------------
+    mode = (frameData[832] & 0x1000) >> 5;
+
+    irDataCP[0] = frameData[776];
+    irDataCP[1] = frameData[808];
+    for (int i = 0; i < 2; i++) {
+        if (irDataCP[i] > 32767) {
+            irDataCP[i] = irDataCP[i] - 65536;
+        }
+        irDataCP[i] = irDataCP[i] * gain;
+    }
+    irDataCP[0] = irDataCP[0] - params->cpOffset[0] *
+                                    (1 + params->cpKta * (ta - 25)) *
+                                    (1 + params->cpKv * (vdd - 3.3));
+    if (mode == params->calibrationModeEE) {
+        irDataCP[1] = irDataCP[1] - params->cpOffset[1] *
+                                        (1 + params->cpKta * (ta - 25)) *
+                                        (1 + params->cpKv * (vdd - 3.3));
+    } else {
+        irDataCP[1] =
+            irDataCP[1] - (params->cpOffset[1] + params->ilChessC[0]) *
+                              (1 + params->cpKta * (ta - 25)) *
+                              (1 + params->cpKv * (vdd - 3.3));
+    }
+
+    plan = &compiled->plan[(frameData[832] & 0x1000) >> 12][subPage];
+    for (int i = 0; i < 384; i++) {
+        pixelNumber = plan->pixel[i];
+
+        irData = frameData[pixelNumber];
+        if (irData > 32767) {
+            irData = irData - 65536;
+        }
+        irData = irData * gain;
+
+        irData = irData - compiled->offset[pixelNumber] *
+                              (1 + compiled->kta[pixelNumber] * (ta - 25)) *
+                              (1 + compiled->kv[pixelNumber] * (vdd - 3.3));
+
+        if (mode != params->calibrationModeEE) {
+            irData = irData +
+                     params->ilChessC[2] * (2 * plan->ilPattern[i] - 1) -
+                     params->ilChessC[1] * plan->conversionPattern[i];
+        }
+
+        irData = irData - params->tgc * irDataCP[subPage];
+        irData = irData / emissivity;
+
+        alphaCompensated = compiled->alpha[pixelNumber];
+        alphaCompensated =
+            alphaCompensated * (1 + params->KsTa * (ta - 25));
+
+        Sx = alphaCompensated * alphaCompensated * alphaCompensated *
+             (irData + alphaCompensated * taTr);
+        Sx = sqrt(sqrt(Sx)) * params->ksTo[1];
+
+        To = sqrt(sqrt(irData / (alphaCompensated *
+                                     (1 - params->ksTo[1] * 273.15) +
+                                 Sx) +
+                       taTr)) -
+             273.15;
+
+        if (To < params->ct[1]) {
+            range = 0;
+        } else if (To < params->ct[2]) {
+            range = 1;
+        } else if (To < params->ct[3]) {
+            range = 2;
+        } else {
+            range = 3;
+        }
+
+        To = sqrt(sqrt(irData / (alphaCompensated * alphaCorrR[range] *
+                                 (1 + params->ksTo[range] *
+                                          (To - params->ct[range]))) +
+                       taTr)) -
+             273.15;
+
+        result[pixelNumber] = To;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_InitFrameContext(frameContextMLX90640 *context,
+                               float vddTolerance, float taTolerance) {
+    context->vdd           = 0;
+    context->ta            = 0;
+    context->cachedVdd     = 0;
+    context->cachedTa      = 0;
+    context->vddTolerance  = vddTolerance;
+    context->taTolerance   = taTolerance;
+    context->cacheValid    = 0;
+    context->cacheHits     = 0;
+    context->cacheRebuilds = 0;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_UpdateFrameContext(uint16_t *frameData,
+                                 const paramsMLX90640 *params,
+                                 const compiledParamsMLX90640 *compiled,
+                                 frameContextMLX90640 *context) {
+    float vdd;
+    float ta;
+
+    vdd          = MLX90640_GetVdd(frameData, params);
+    ta           = GetTaFromVdd(frameData, params, vdd);
+    context->vdd = vdd;
+    context->ta  = ta;
+
+    // Offset and alpha compensation only depend on Ta and Vdd, which drift
+    // slowly, so the per-pixel tables are kept until they move too far
+    if (context->cacheValid &&
+        fabs(vdd - context->cachedVdd) <= context->vddTolerance &&
+        fabs(ta - context->cachedTa) <= context->taTolerance) {
+        context->cacheHits = context->cacheHits + 1;
+        return;
+    }
+
+    // offset * (1 + kta * (ta - 25)) * (1 + kv * (vdd - 3.3)), with the alpha
+    // table holding the Vdd factor until alpha itself is compensated
+    simdAffine(compiled->kta, context->offset, 768, ta - 25, 1);
+    simdMultiply(compiled->offset, context->offset, context->offset, 768);
+    simdAffine(compiled->kv, context->alpha, 768, vdd - 3.3f, 1);
+    simdMultiply(context->offset, context->alpha, context->offset, 768);
+    simdAffine(compiled->alpha, context->alpha, 768,
+               1 + params->KsTa * (ta - 25), 0);
+
+    context->cachedVdd     = vdd;
+    context->cachedTa      = ta;
+    context->cacheValid    = 1;
+    context->cacheRebuilds = context->cacheRebuilds + 1;
+}
+
+//------------------------------------------------------------------------------
+
+// Precision policies of the To calculation kernel. The ESP32-S3 FPU only
+// handles single precision, so the firmware policy keeps every operation in
+// float; the double policy is the reference the float results are checked
+// against.
+struct SinglePrecisionMLX90640 {
+    typedef float real;
+    static inline float fourthRoot(float x) { return sqrtf(sqrtf(x)); }
+};
+
+struct DoublePrecisionMLX90640 {
+    typedef double real;
+    static inline double fourthRoot(double x) { return sqrt(sqrt(x)); }
+};
+
+// Ta, Vdd and the per-pixel offset and alpha after their compensation, as
+// the To calculation kernel reads them. The firmware takes them from the
+// float tables of a frame context; the reference recomputes all of it in
+// double from the extracted parameters, so float rounding of the context
+// does not leak into the results the float kernel is checked against.
+struct CachedCompensationMLX90640 {
+    const frameContextMLX90640 *context;
+    float vdd;
+    float ta;
+
+    CachedCompensationMLX90640(const frameContextMLX90640 *frameContext)
+        : context(frameContext), vdd(frameContext->vdd),
+          ta(frameContext->ta) {}
+    inline float offset(int pixelNumber) const {
+        return context->offset[pixelNumber];
+    }
+    inline float alpha(int pixelNumber) const {
+        return context->alpha[pixelNumber];
+    }
+};
+
+struct ExactCompensationMLX90640 {
+    const paramsMLX90640 *params;
+    double vdd;
+    double ta;
+    double ktaScale;
+    double kvScale;
+    double alphaScale;
+
+    ExactCompensationMLX90640(uint16_t *frameData,
+                              const paramsMLX90640 *parameters)
+        : params(parameters),
+          vdd(VddFromFrame<double>(frameData, parameters)),
+          ta(TaFromFrame<double>(frameData, parameters, vdd)),
+          ktaScale(pow(2, (double)parameters->ktaScale)),
+          kvScale(pow(2, (double)parameters->kvScale)),
+          alphaScale(pow(2, (double)parameters->alphaScale)) {}
+    inline double offset(int pixelNumber) const {
+        return params->offset[pixelNumber] *
+               (1 + params->kta[pixelNumber] / ktaScale * (ta - 25)) *
+               (1 + params->kv[pixelNumber] / kvScale * (vdd - 3.3));
+    }
+    inline double alpha(int pixelNumber) const {
+        return SCALEALPHA * alphaScale / params->alpha[pixelNumber] *
+               (1 + (double)params->KsTa * (ta - 25));
+    }
+};
+
+// Plan entries four at a time on the SIMD layer, for the single precision
+// kernel where the layer has vector registers. The per-pixel inputs are
+// gathered into lanes and every step runs in the scalar loop's order, so the
+// results stay bit identical to it; the range is picked by selects. Returns
+// the first entry left for the scalar loop, which gets all of them on other
+// precisions and on backends with scalar lanes such as the ESP32-S3's, whose
+// FPU has no float vectors and only loses to the packing there
+template <class Precision, class Compensation, class real>
+int CalculateToBlocks(const Precision &, uint16_t *,
+                      const paramsMLX90640 *, const pixelPlanMLX90640 *,
+                      const Compensation &, int, real, real, float, real,
+                      const real *, float *, int firstEntry, int) {
+    return firstEntry;
+}
+
+#if SIMD_F32X4_NATIVE
+template <class Compensation>
+int CalculateToBlocks(const SinglePrecisionMLX90640 &, uint16_t *frameData,
+                      const paramsMLX90640 *params,
+                      const pixelPlanMLX90640 *plan,
+                      const Compensation &compensation, int chessCorrection,
+                      float gain, float irDataCP, float emissivity,
+                      float taTr, const float *alphaCorrR, float *result,
+                      int firstEntry, int lastEntry) {
+    const float kelvin = 273.15f;
+    const simd_f32x4 vGain       = simdSet1(gain);
+    const simd_f32x4 vChessC2    = simdSet1(params->ilChessC[2]);
+    const simd_f32x4 vChessC1    = simdSet1(params->ilChessC[1]);
+    const simd_f32x4 vIrDataCP   = simdSet1(params->tgc * irDataCP);
+    const simd_f32x4 vEmissivity = simdSet1(emissivity);
+    const simd_f32x4 vTaTr       = simdSet1(taTr);
+    const simd_f32x4 vKsTo1      = simdSet1(params->ksTo[1]);
+    const simd_f32x4 vAlphaKsTo1 = simdSet1(1 - params->ksTo[1] * kelvin);
+    const simd_f32x4 vKelvin     = simdSet1(kelvin);
+    const simd_f32x4 vOne        = simdSet1(1);
+    simd_f32x4 vCt[4];
+    simd_f32x4 vKsTo[4];
+    simd_f32x4 vAlphaCorrR[4];
+    float to[4];
+    int i;
+
+    for (int range = 0; range < 4; range++) {
+        vCt[range]         = simdSet1(params->ct[range]);
+        vKsTo[range]       = simdSet1(params->ksTo[range]);
+        vAlphaCorrR[range] = simdSet1(alphaCorrR[range]);
+    }
+
+    for (i = firstEntry; i + 4 <= lastEntry; i += 4) {
+        const uint16_t *pixel           = &plan->pixel[i];
+        const int8_t *ilPattern         = &plan->ilPattern[i];
+        const int8_t *conversionPattern = &plan->conversionPattern[i];
+
+        simd_f32x4 irData = simdSet4(
+            (int16_t)frameData[pixel[0]], (int16_t)frameData[pixel[1]],
+            (int16_t)frameData[pixel[2]], (int16_t)frameData[pixel[3]]);
+        irData = simdMul(irData, vGain);
+        irData = simdSub(irData, simdSet4(compensation.offset(pixel[0]),
+                                          compensation.offset(pixel[1]),
+                                          compensation.offset(pixel[2]),
+                                          compensation.offset(pixel[3])));
+        if (chessCorrection) {
+            irData = simdAdd(
+                irData, simdMul(vChessC2, simdSet4(2 * ilPattern[0] - 1,
+                                                   2 * ilPattern[1] - 1,
+                                                   2 * ilPattern[2] - 1,
+                                                   2 * ilPattern[3] - 1)));
+            irData = simdSub(
+                irData, simdMul(vChessC1,
+                                simdSet4(conversionPattern[0],
+                                         conversionPattern[1],
+                                         conversionPattern[2],
+                                         conversionPattern[3])));
+        }
+        irData = simdDiv(simdSub(irData, vIrDataCP), vEmissivity);
+
+        simd_f32x4 a = simdSet4(
+            compensation.alpha(pixel[0]), compensation.alpha(pixel[1]),
+            compensation.alpha(pixel[2]), compensation.alpha(pixel[3]));
+        simd_f32x4 Sx = simdMul(simdMul(simdMul(a, a), a),
+                                simdAdd(irData, simdMul(a, vTaTr)));
+        Sx = simdMul(simdSqrt(simdSqrt(Sx)), vKsTo1);
+        simd_f32x4 To = simdSub(
+            simdSqrt(simdSqrt(simdAdd(
+                simdDiv(irData, simdAdd(simdMul(a, vAlphaKsTo1), Sx)),
+                vTaTr))),
+            vKelvin);
+
+        // Range of each lane as the scalar if chain picks it, the corner
+        // temperatures ascend and a NaN ends up in the last range there too
+        simd_f32x4 ct        = vCt[0];
+        simd_f32x4 ksTo      = vKsTo[0];
+        simd_f32x4 alphaCorr = vAlphaCorrR[0];
+        for (int range = 1; range < 4; range++) {
+            ct        = simdSelectNotLess(To, vCt[range], vCt[range], ct);
+            ksTo      = simdSelectNotLess(To, vCt[range], vKsTo[range], ksTo);
+            alphaCorr = simdSelectNotLess(To, vCt[range], vAlphaCorrR[range],
+                                          alphaCorr);
+        }
+
+        simd_f32x4 alphaRange =
+            simdMul(simdMul(a, alphaCorr),
+                    simdAdd(vOne, simdMul(ksTo, simdSub(To, ct))));
+        To = simdSub(simdSqrt(simdSqrt(simdAdd(simdDiv(irData, alphaRange),
+                                               vTaTr))),
+                     vKelvin);
+
+        simdStore(to, To);
+        for (int lane = 0; lane < 4; lane++) {
+            result[pixel[lane]] = to[lane];
+        }
+    }
+
+    return i;
+}
+#endif
+
+template <class Precision, class Compensation>
+void CalculateToKernel(uint16_t *frameData, const paramsMLX90640 *params,
+                       const compiledParamsMLX90640 *compiled,
+                       const Compensation &compensation, float emissivity,
+                       float tr, float *result, int firstEntry, int lastEntry) {
+    typedef typename Precision::real real;
+
+    const real kelvin = (real)273.15;
+    const real vdd0   = (real)3.3;
+
+    real vdd;
+    real ta;
+    real ta4;
+    real tr4;
+    real taTr;
+    real gain;
+    real irDataCP[2];
+    real irData;
+    real alphaCompensated;
+    uint8_t mode;
+    const pixelPlanMLX90640 *plan;
+    int pixelNumber;
+    real Sx;
+    real To;
+    real alphaCorrR[4];
+    int8_t range;
+    uint16_t subPage;
+
+    subPage = frameData[833];
+    vdd     = compensation.vdd;
+    ta      = compensation.ta;
+
+    ta4  = (ta + kelvin);
+    ta4  = ta4 * ta4;
+    ta4  = ta4 * ta4;
+    tr4  = (tr + kelvin);
+    tr4  = tr4 * tr4;
+    tr4  = tr4 * tr4;
+    taTr = tr4 - (tr4 - ta4) / emissivity;
+
+    alphaCorrR[0] = 1 / (1 + (real)params->ksTo[0] * 40);
+    alphaCorrR[1] = 1;
+    alphaCorrR[2] = (1 + (real)params->ksTo[1] * params->ct[2]);
+    alphaCorrR[3] = alphaCorrR[2] * (1 + (real)params->ksTo[2] *
+                                             (params->ct[3] - params->ct[2]));
+
+    //------------------------- Gain calculation
+    //-----------------------------------
+    gain = frameData[778];
+    if (gain > 32767) {
+        gain = gain - 65536;
+    }
+
+    gain = params->gainEE / gain;
+
+    //------------------------- To calculation
+    //-------------------------------------
+    mode = (frameData[832] & 0x1000) >> 5;
+
+    irDataCP[0] = frameData[776];
+    irDataCP[1] = frameData[808];
+    for (int i = 0; i < 2; i++) {
+        if (irDataCP[i] > 32767) {
+            irDataCP[i] = irDataCP[i] - 65536;
+        }
+        irDataCP[i] = irDataCP[i] * gain;
+    }
+    irDataCP[0] = irDataCP[0] - params->cpOffset[0] *
+                                    (1 + (real)params->cpKta * (ta - 25)) *
+                                    (1 + (real)params->cpKv * (vdd - vdd0));
+    if (mode == params->calibrationModeEE) {
+        irDataCP[1] = irDataCP[1] - params->cpOffset[1] *
+                                        (1 + (real)params->cpKta * (ta - 25)) *
+                                        (1 + (real)params->cpKv * (vdd - vdd0));
+    } else {
+        irDataCP[1] =
+            irDataCP[1] -
+            (params->cpOffset[1] + (real)params->ilChessC[0]) *
+                (1 + (real)params->cpKta * (ta - 25)) *
+                (1 + (real)params->cpKv * (vdd - vdd0));
+    }
+
+    plan = &compiled->plan[(frameData[832] & 0x1000) >> 12][subPage];
+    firstEntry = CalculateToBlocks(
+        Precision(), frameData, params, plan, compensation,
+        mode != params->calibrationModeEE, gain, irDataCP[subPage], emissivity,
+        taTr, alphaCorrR, result, firstEntry, lastEntry);
+    for (int i = firstEntry; i < lastEntry; i++) {
+        pixelNumber = plan->pixel[i];
+
+        irData = frameData[pixelNumber];
+        if (irData > 32767) {
+            irData = irData - 65536;
+        }
+        irData = irData * gain;
+
+        irData = irData - compensation.offset(pixelNumber);
+
+        if (mode != params->calibrationModeEE) {
+            irData = irData +
+                     (real)params->ilChessC[2] * (2 * plan->ilPattern[i] - 1) -
+                     (real)params->ilChessC[1] * plan->conversionPattern[i];
+        }
+
+        irData = irData - (real)params->tgc * irDataCP[subPage];
+        irData = irData / emissivity;
+
+        alphaCompensated = compensation.alpha(pixelNumber);
+
+        Sx = alphaCompensated * alphaCompensated * alphaCompensated *
+             (irData + alphaCompensated * taTr);
+        Sx = Precision::fourthRoot(Sx) * (real)params->ksTo[1];
+
+        To = Precision::fourthRoot(
+                 irData / (alphaCompensated *
+                               (1 - (real)params->ksTo[1] * kelvin) +
+                           Sx) +
+                 taTr) -
+             kelvin;
+
+        if (To < params->ct[1]) {
+            range = 0;
+        } else if (To < params->ct[2]) {
+            range = 1;
+        } else if (To < params->ct[3]) {
+            range = 2;
+        } else {
+            range = 3;
+        }
+
+        To = Precision::fourthRoot(
+                 irData / (alphaCompensated * alphaCorrR[range] *
+                           (1 + (real)params->ksTo[range] *
+                                    (To - params->ct[range]))) +
+                 taTr) -
+             kelvin;
+
+        result[pixelNumber] = To;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateToCached(uint16_t *frameData,
+                                const paramsMLX90640 *params,
+                                const compiledParamsMLX90640 *compiled,
+                                const frameContextMLX90640 *context,
+                                float emissivity, float tr, float *result) {
+    CalculateToKernel<SinglePrecisionMLX90640>(
+        frameData, params, compiled, CachedCompensationMLX90640(context),
+        emissivity, tr, result, 0, 384);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateToCachedPart(uint16_t *frameData,
+                                    const paramsMLX90640 *params,
+                                    const compiledParamsMLX90640 *compiled,
+                                    const frameContextMLX90640 *context,
+                                    float emissivity, float tr, float *result,
+                                    uint8_t part, uint8_t parts) {
+    CalculateToKernel<SinglePrecisionMLX90640>(
+        frameData, params, compiled, CachedCompensationMLX90640(context),
+        emissivity, tr, result, 384 * part / parts, 384 * (part + 1) / parts);
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_CalculateToReference(uint16_t *frameData,
+                                   const paramsMLX90640 *params,
+                                   const compiledParamsMLX90640 *compiled,
+                                   float emissivity, float tr, float *result) {
+    CalculateToKernel<DoublePrecisionMLX90640>(
+        frameData, params, compiled,
+        ExactCompensationMLX90640(frameData, params), emissivity, tr, result,
+        0, 384);
+}
+
+//------------------------------------------------------------------------------
+
 void MLX90640_GetImage(uint16_t *frameData, const paramsMLX90640 *params,
                        float *result) {
     float vdd;
@@ -494,9 +1266,104 @@ void MLX90640_GetImage(uint16_t *frameData, const paramsMLX90640 *params,
 
 //------------------------------------------------------------------------------
 
-float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params) {
+void MLX90640_GetImageCompiled(uint16_t *frameData,
+                               const paramsMLX90640 *params,
+                               const compiledParamsMLX90640 *compiled,
+                               float *result) {
     float vdd;
-    float resolutionCorrection;
+    float ta;
+    float gain;
+    float irDataCP[2];
+    float irData;
+    float alphaCompensated;
+    uint8_t mode;
+    const pixelPlanMLX90640 *plan;
+    int pixelNumber;
+    float image;
+    uint16_t subPage;
+
+    subPage = frameData[833];
+    vdd     = MLX90640_GetVdd(frameData, params);
+    ta      = MLX90640_GetTa(frameData, params);
+
+    //------------------------- Gain calculation
+    //-----------------------------------
+    gain = frameData[778];
+    if (gain > 32767) {
+        gain = gain - 65536;
+    }
+
+    gain = params->gainEE / gain;
+
+    //------------------------- Image calculation
+    //-------------------------------------
+    mode = (frameData[832] & 0x1000) >> 5;
+
+    irDataCP[0] = frameData[776];
+    irDataCP[1] = frameData[808];
+    for (int i = 0; i < 2; i++) {
+        if (irDataCP[i] > 32767) {
+            irDataCP[i] = irDataCP[i] - 65536;
+        }
+        irDataCP[i] = irDataCP[i] * gain;
+    }
+    irDataCP[0] = irDataCP[0] - params->cpOffset[0] *
+                                    (1 + params->cpKta * (ta - 25)) *
+                                    (1 + params->cpKv * (vdd - 3.3));
+    if (mode == params->calibrationModeEE) {
+        irDataCP[1] = irDataCP[1] - params->cpOffset[1] *
+                                        (1 + params->cpKta * (ta - 25)) *
+                                        (1 + params->cpKv * (vdd - 3.3));
+    } else {
+        irDataCP[1] =
+            irDataCP[1] - (params->cpOffset[1] + params->ilChessC[0]) *
+                              (1 + params->cpKta * (ta - 25)) *
+                              (1 + params->cpKv * (vdd - 3.3));
+    }
+
+    plan = &compiled->plan[(frameData[832] & 0x1000) >> 12][subPage];
+    for (int i = 0; i < 384; i++) {
+        pixelNumber = plan->pixel[i];
+
+        irData = frameData[pixelNumber];
+        if (irData > 32767) {
+            irData = irData - 65536;
+        }
+        irData = irData * gain;
+
+        irData = irData - compiled->offset[pixelNumber] *
+                              (1 + compiled->kta[pixelNumber] * (ta - 25)) *
+                              (1 + compiled->kv[pixelNumber] * (vdd - 3.3));
+
+        if (mode != params->calibrationModeEE) {
+            irData = irData +
+                     params->ilChessC[2] * (2 * plan->ilPattern[i] - 1) -
+                     params->ilChessC[1] * plan->conversionPattern[i];
+        }
+
+        irData = irData - params->tgc * irDataCP[subPage];
+
+        alphaCompensated = params->alpha[pixelNumber];
+
+        image = irData * alphaCompensated;
+
+        result[pixelNumber] = image;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params) {
+    return VddFromFrame<float>(frameData, params);
+}
+
+//------------------------------------------------------------------------------
+
+// Vdd and Ta in the precision of the caller, float for the firmware
+template <class real>
+real VddFromFrame(uint16_t *frameData, const paramsMLX90640 *params) {
+    real vdd;
+    real resolutionCorrection;
 
     int resolutionRAM;
 
@@ -515,12 +1382,23 @@ float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params) {
 //------------------------------------------------------------------------------
 
 float MLX90640_GetTa(uint16_t *frameData, const paramsMLX90640 *params) {
-    float ptat;
-    float ptatArt;
-    float vdd;
-    float ta;
+    return GetTaFromVdd(frameData, params, MLX90640_GetVdd(frameData, params));
+}
+
+//------------------------------------------------------------------------------
 
-    vdd = MLX90640_GetVdd(frameData, params);
+float GetTaFromVdd(uint16_t *frameData, const paramsMLX90640 *params,
+                   float vdd) {
+    return TaFromFrame<float>(frameData, params, vdd);
+}
+
+//------------------------------------------------------------------------------
+
+template <class real>
+real TaFromFrame(uint16_t *frameData, const paramsMLX90640 *params, real vdd) {
+    real ptat;
+    real ptatArt;
+    real ta;
 
     ptat = frameData[800];
     if (ptat > 32767) {
@@ -621,6 +1499,51 @@ void MLX90640_BadPixelsCorrection(uint16_t *pixels, float *to, int mode,
 
 //------------------------------------------------------------------------------
 
+void MLX90640_CorrectPixels(uint16_t *frameData,
+                            const compiledParamsMLX90640 *compiled,
+                            float *to) {
+    const correctionPlanMLX90640 *plan;
+    const pixelCorrectionMLX90640 *entry;
+    float ap[4];
+    float low;
+    float high;
+
+    plan = &compiled->correction[(frameData[832] & 0x1000) >> 12];
+    for (int i = 0; i < plan->count; i++) {
+        entry = &plan->entry[i];
+        ap[0] = to[entry->neighbour[0]];
+        ap[1] = to[entry->neighbour[1]];
+        ap[2] = to[entry->neighbour[2]];
+        ap[3] = to[entry->neighbour[3]];
+
+        switch (entry->method) {
+        case MLX90640_CORRECTION_COPY:
+            to[entry->pixel] = ap[0];
+            break;
+        case MLX90640_CORRECTION_AVERAGE:
+            to[entry->pixel] = (ap[0] + ap[1]) / 2.0;
+            break;
+        case MLX90640_CORRECTION_MEDIAN:
+            // The middle pair of four is the larger minimum and the smaller
+            // maximum of the two halves, no sorting needed
+            low              = fmax(fmin(ap[0], ap[1]), fmin(ap[2], ap[3]));
+            high             = fmin(fmax(ap[0], ap[1]), fmax(ap[2], ap[3]));
+            to[entry->pixel] = (low + high) / 2.0;
+            break;
+        case MLX90640_CORRECTION_GRADIENT:
+            // Extend the flatter side's gradient, ap holds p-2, p-1, p+1, p+2
+            if (fabs(ap[2] - ap[3]) > fabs(ap[1] - ap[0])) {
+                to[entry->pixel] = ap[1] + (ap[1] - ap[0]);
+            } else {
+                to[entry->pixel] = ap[2] + (ap[2] - ap[3]);
+            }
+            break;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
 void ExtractVDDParameters(uint16_t *eeData, paramsMLX90640 *mlx90640) {
     int16_t kVdd;
     int16_t vdd25;
@@ -1260,7 +2183,7 @@ float GetMedian(float *values, int n) {
 
 //------------------------------------------------------------------------------
 
-int IsPixelBad(uint16_t pixel, paramsMLX90640 *params) {
+int IsPixelBad(uint16_t pixel, const paramsMLX90640 *params) {
     for (int i = 0; i < 5; i++) {
         if (pixel == params->outlierPixels[i] ||
             pixel == params->brokenPixels[i]) {
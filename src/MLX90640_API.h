@@ -51,8 +51,57 @@ typedef struct {
     uint16_t outlierPixels[5];
 } paramsMLX90640;
 
+typedef struct {
+    uint16_t pixel[384];
+    int8_t ilPattern[384];
+    int8_t conversionPattern[384];
+} pixelPlanMLX90640;
+
+#define MLX90640_CORRECTION_COPY 0
+#define MLX90640_CORRECTION_AVERAGE 1
+#define MLX90640_CORRECTION_MEDIAN 2
+#define MLX90640_CORRECTION_GRADIENT 3
+
+typedef struct {
+    uint16_t pixel;
+    uint8_t method;
+    uint16_t neighbour[4];
+} pixelCorrectionMLX90640;
+
+typedef struct {
+    uint8_t count;
+    pixelCorrectionMLX90640 entry[10];
+} correctionPlanMLX90640;
+
+typedef struct {
+    float kta[768];
+    float kv[768];
+    float alpha[768];
+    float offset[768];
+    pixelPlanMLX90640 plan[2][2];
+    correctionPlanMLX90640 correction[2];
+} compiledParamsMLX90640;
+
+typedef struct {
+    float vdd;
+    float ta;
+    float cachedVdd;
+    float cachedTa;
+    float vddTolerance;
+    float taTolerance;
+    uint8_t cacheValid;
+    uint32_t cacheHits;
+    uint32_t cacheRebuilds;
+    float offset[768];
+    float alpha[768];
+} frameContextMLX90640;
+
 int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData);
+int MLX90640_DumpEEHeader(uint8_t slaveAddr, uint16_t *eeData);
+uint32_t MLX90640_GetEEFingerprint(const uint16_t *eeData);
 int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData);
+int MLX90640_IsDataReady(uint8_t slaveAddr);
+int MLX90640_ReadFrameData(uint8_t slaveAddr, uint16_t *frameData);
 int MLX90640_ExtractParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
 float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params);
 float MLX90640_GetTa(uint16_t *frameData, const paramsMLX90640 *params);
@@ -60,6 +109,37 @@ void MLX90640_GetImage(uint16_t *frameData, const paramsMLX90640 *params,
                        float *result);
 void MLX90640_CalculateTo(uint16_t *frameData, const paramsMLX90640 *params,
                           float emissivity, float tr, float *result);
+void MLX90640_CompileParameters(const paramsMLX90640 *params,
+                                compiledParamsMLX90640 *compiled);
+void MLX90640_CalculateToCompiled(uint16_t *frameData,
+                                  const paramsMLX90640 *params,
+                                  const compiledParamsMLX90640 *compiled,
+                                  float emissivity, float tr, float *result);
+void MLX90640_GetImageCompiled(uint16_t *frameData,
+                               const paramsMLX90640 *params,
+                               const compiledParamsMLX90640 *compiled,
+                               float *result);
+void MLX90640_InitFrameContext(frameContextMLX90640 *context,
+                               float vddTolerance, float taTolerance);
+void MLX90640_UpdateFrameContext(uint16_t *frameData,
+                                 const paramsMLX90640 *params,
+                                 const compiledParamsMLX90640 *compiled,
+                                 frameContextMLX90640 *context);
+void MLX90640_CalculateToCached(uint16_t *frameData,
+                                const paramsMLX90640 *params,
+                                const compiledParamsMLX90640 *compiled,
+                                const frameContextMLX90640 *context,
+                                float emissivity, float tr, float *result);
+void MLX90640_CalculateToCachedPart(uint16_t *frameData,
+                                    const paramsMLX90640 *params,
+                                    const compiledParamsMLX90640 *compiled,
+                                    const frameContextMLX90640 *context,
+                                    float emissivity, float tr, float *result,
+                                    uint8_t part, uint8_t parts);
+void MLX90640_CalculateToReference(uint16_t *frameData,
+                                   const paramsMLX90640 *params,
+                                   const compiledParamsMLX90640 *compiled,
+                                   float emissivity, float tr, float *result);
 int MLX90640_SetResolution(uint8_t slaveAddr, uint8_t resolution);
 int MLX90640_GetCurResolution(uint8_t slaveAddr);
 int MLX90640_SetRefreshRate(uint8_t slaveAddr, uint8_t refreshRate);
@@ -70,5 +150,8 @@ int MLX90640_SetInterleavedMode(uint8_t slaveAddr);
 int MLX90640_SetChessMode(uint8_t slaveAddr);
 void MLX90640_BadPixelsCorrection(uint16_t *pixels, float *to, int mode,
                                   paramsMLX90640 *params);
+void MLX90640_CorrectPixels(uint16_t *frameData,
+                            const compiledParamsMLX90640 *compiled,
+                            float *to);
 
 #endif
@@ -14,91 +14,794 @@
    limitations under the License.
 
 */
+#include "MLX90640_I2C_Driver.h"
+
+#include <string.h>
+
+#if defined(ARDUINO)
 #include <Arduino.h>
 #include <Wire.h>
+#else
+#include <chrono>
+#include <mutex>
+#include <thread>
 
-#include "MLX90640_I2C_Driver.h"
+static uint32_t micros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+#endif
+
+#define STATUS_REGISTER 0x8000
+#define CONTROL_REGISTER_1 0x800D
+
+// One transaction at a time on a bus, so that sensors read from separate
+// tasks take turns on a bus they share
+#if defined(ARDUINO)
+typedef struct {
+    SemaphoreHandle_t handle;
+    StaticSemaphore_t storage;
+} busLockMLX90640;
+#else
+typedef struct {
+    std::mutex mutex;
+} busLockMLX90640;
+#endif
+
+// Host side copy of the registers only the host writes (control) or that
+// come along with every frame anyway (status), the sensor's address and its
+// own bus when one was attached. Guarded by the lock of the bus it is on
+typedef struct {
+    uint8_t slaveAddr;
+    uint8_t used;
+    uint8_t statusValid;
+    uint8_t controlValid;
+    uint16_t statusRegister;
+    uint16_t controlRegister1;
+    uint8_t attached;
+    transportMLX90640 transport;
+    busLockMLX90640 *lock;
+} registerShadowMLX90640;
+
+// Where a handle or plain address leads: the sensor's address on its bus,
+// the bus and its lock, and the slot of an attached sensor
+typedef struct {
+    uint8_t slaveAddr;
+    const transportMLX90640 *bus;
+    busLockMLX90640 *lock;
+    registerShadowMLX90640 *shadow;
+} targetMLX90640;
+
+static registerShadowMLX90640 shadows[MLX90640_SHADOW_DEVICES];
+static busLockMLX90640 sharedLock;
+static busLockMLX90640 busLocks[MLX90640_SHADOW_DEVICES];
+static thread_local busStatsMLX90640 busStats;  // Per task, like the sensors
+static uint8_t retryLimit = MLX90640_I2C_RETRIES;
+static uint16_t backoffMicros = MLX90640_I2C_BACKOFF_MICROS;
+
+void InitLock(busLockMLX90640 *lock);
+void LockBus(busLockMLX90640 *lock);
+void UnlockBus(busLockMLX90640 *lock);
+int FindTarget(uint8_t device, targetMLX90640 *target);
+const transportMLX90640 *BusOf(const registerShadowMLX90640 *shadow);
+int SameBus(const transportMLX90640 *bus, const transportMLX90640 *other);
+void UpdateShadow(registerShadowMLX90640 *shadow, unsigned int address,
+                  uint16_t value);
+void InvalidateShadow(registerShadowMLX90640 *shadow);
+int RecoverTransport(const transportMLX90640 *bus, busLockMLX90640 *lock);
+int CountError(int error);
+int RetryAfter(const targetMLX90640 *target, int error, int attempt);
+int ReadOnce(const targetMLX90640 *target, unsigned int startAddress,
+             unsigned int nWordsRead, uint16_t *data);
+int WriteOnce(const targetMLX90640 *target, unsigned int writeAddress,
+              uint16_t data, uint8_t verify);
+
+#if defined(ARDUINO)
+
+static uint16_t burstLength = I2C_BUFFER_LENGTH;
+static wireBusMLX90640 defaultBus = {&Wire, -1, -1, 400000};
+
+int ClassifyWireError(uint8_t code);
+int WireRead(void *context, uint8_t _deviceAddress, unsigned int startAddress,
+             unsigned int nWords, uint16_t *data);
+int WireWrite(void *context, uint8_t _deviceAddress, unsigned int writeAddress,
+              uint16_t data);
+int WireRecover(void *context);
+void WireSetClock(void *context, uint32_t frequency);
+
+static const transportMLX90640 wireTransport = {
+    WireRead, WireWrite, WireRecover, WireSetClock, &defaultBus,
+    I2C_BUFFER_LENGTH / 2};
+static transportMLX90640 transport = wireTransport;
+
+// Locks are created during setup, a bus is used without one before that
+void InitLock(busLockMLX90640 *lock) {
+    if (lock->handle == NULL) {
+        lock->handle = xSemaphoreCreateMutexStatic(&lock->storage);
+    }
+}
+
+void LockBus(busLockMLX90640 *lock) {
+    if (lock->handle != NULL) {
+        xSemaphoreTake(lock->handle, portMAX_DELAY);
+    }
+}
+
+void UnlockBus(busLockMLX90640 *lock) {
+    if (lock->handle != NULL) {
+        xSemaphoreGive(lock->handle);
+    }
+}
+
+#else
 
+// No bus on a host build until a transport, e.g. the simulator, is set
+static const transportMLX90640 wireTransport = {NULL, NULL, NULL, NULL, NULL,
+                                                0};
+static transportMLX90640 transport = wireTransport;
+
+void InitLock(busLockMLX90640 *lock) {
+    (void)lock;  // A std::mutex is ready from the start
+}
+
+void LockBus(busLockMLX90640 *lock) {
+    lock->mutex.lock();
+}
+
+void UnlockBus(busLockMLX90640 *lock) {
+    lock->mutex.unlock();
+}
+
+#endif
+
+// Grow the Wire receive buffer so that a whole subpage is read in a single
+// transaction. Keeps the default chunking when the core refuses
 void MLX90640_I2CInit() {
+    InitLock(&sharedLock);
+#if defined(ARDUINO_ARCH_ESP32)
+    if (Wire.setBufferSize(MLX90640_I2C_BURST_BYTES) >=
+        MLX90640_I2C_BURST_BYTES) {
+        burstLength = MLX90640_I2C_BURST_BYTES;
+        if (transport.read == WireRead) {
+            transport.maxReadWords = burstLength / 2;
+        }
+    }
+#endif
+}
+
+// Route the traffic of all sensors without a bus of their own through another
+// transport, NULL goes back to Wire. The shadows belong to the old bus and
+// are dropped. Not while sensors are being read
+void MLX90640_I2CSetTransport(const transportMLX90640 *newTransport) {
+    InitLock(&sharedLock);
+    LockBus(&sharedLock);
+    if (newTransport != NULL) {
+        transport = *newTransport;
+    } else {
+        transport = wireTransport;
+#if defined(ARDUINO)
+        transport.maxReadWords = burstLength / 2;
+#endif
+    }
+
+    for (int i = 0; i < MLX90640_SHADOW_DEVICES; i++) {
+        if (shadows[i].used && !shadows[i].attached) {
+            InvalidateShadow(&shadows[i]);
+        }
+    }
+    UnlockBus(&sharedLock);
+}
+
+// Register a sensor and return the handle to address it by from then on, or
+// MLX90640_I2C_NO_TRANSPORT when all slots are taken. sensorTransport gives
+// it a bus of its own, e.g. a second Wire or a simulator, NULL puts it on the
+// shared one. Sensors are told apart by bus and address, so the same address
+// on two buses makes two sensors and attaching one again returns its handle.
+// Attach every sensor before reading them from separate tasks: sensors on
+// different buses never wait for each other, those on one bus take turns
+int MLX90640_I2CAttach(uint8_t slaveAddr,
+                       const transportMLX90640 *sensorTransport) {
+    const transportMLX90640 *bus =
+        sensorTransport != NULL ? sensorTransport : &transport;
+    registerShadowMLX90640 *shadow = NULL;
+    busLockMLX90640 *lock          = &sharedLock;
+    int slot;
+
+    for (slot = 0; slot < MLX90640_SHADOW_DEVICES; slot++) {
+        if (shadows[slot].used && shadows[slot].slaveAddr == slaveAddr &&
+            SameBus(BusOf(&shadows[slot]), bus)) {
+            return MLX90640_I2C_DEVICE | slot;
+        }
+    }
+    for (slot = 0; slot < MLX90640_SHADOW_DEVICES; slot++) {
+        if (!shadows[slot].used) {
+            shadow = &shadows[slot];
+            break;
+        }
+    }
+    if (shadow == NULL) {
+        return MLX90640_I2C_NO_TRANSPORT;
+    }
+
+    // Sensors on one bus share its lock
+    if (sensorTransport != NULL && !SameBus(sensorTransport, &transport)) {
+        lock = &busLocks[slot];
+        for (int i = 0; i < MLX90640_SHADOW_DEVICES; i++) {
+            if (shadows[i].used && shadows[i].attached &&
+                SameBus(&shadows[i].transport, sensorTransport)) {
+                lock = shadows[i].lock;
+            }
+        }
+    }
+    InitLock(&sharedLock);
+    InitLock(lock);
+
+    LockBus(lock);
+    memset(shadow, 0, sizeof(*shadow));
+    shadow->slaveAddr = slaveAddr;
+    shadow->lock      = lock;
+    if (sensorTransport != NULL) {
+        shadow->transport = *sensorTransport;
+        shadow->attached  = 1;
+    }
+    shadow->used = 1;
+    UnlockBus(lock);
+
+    return MLX90640_I2C_DEVICE | slot;
+}
+
+// Free the slot of a sensor that is no longer read, its handle becomes
+// invalid
+void MLX90640_I2CDetach(uint8_t device) {
+    targetMLX90640 target;
+
+    if (FindTarget(device, &target) != 0 || target.shadow == NULL) {
+        return;
+    }
+
+    LockBus(target.lock);
+    target.shadow->used = 0;
+    UnlockBus(target.lock);
+}
+
+// Resolve a handle from MLX90640_I2CAttach, or a plain address on the shared
+// bus. Returns MLX90640_I2C_NO_TRANSPORT for a handle without a sensor
+int FindTarget(uint8_t device, targetMLX90640 *target) {
+    registerShadowMLX90640 *shadow = NULL;
+
+    if (device & MLX90640_I2C_DEVICE) {
+        unsigned int slot = device & ~MLX90640_I2C_DEVICE;
+        if (slot >= MLX90640_SHADOW_DEVICES || !shadows[slot].used) {
+            return MLX90640_I2C_NO_TRANSPORT;
+        }
+        shadow = &shadows[slot];
+    }
+
+    target->shadow    = shadow;
+    target->slaveAddr = shadow != NULL ? shadow->slaveAddr : device;
+    target->bus       = BusOf(shadow);
+    target->lock      = shadow != NULL ? shadow->lock : &sharedLock;
+
+    return (0);
+}
+
+// The bus a slot's sensor is on, the shared one for a plain address
+const transportMLX90640 *BusOf(const registerShadowMLX90640 *shadow) {
+    if (shadow != NULL && shadow->attached) {
+        return &shadow->transport;
+    }
+
+    return &transport;
+}
+
+// Two transports driving the same bus
+int SameBus(const transportMLX90640 *bus, const transportMLX90640 *other) {
+    return bus->context == other->context && bus->read == other->read;
+}
+
+// Record a register value seen on the bus, under the bus lock
+void UpdateShadow(registerShadowMLX90640 *shadow, unsigned int address,
+                  uint16_t value) {
+    if (shadow == NULL) {
+        return;
+    }
+
+    if (address == STATUS_REGISTER) {
+        shadow->statusRegister = value;
+        shadow->statusValid    = 1;
+    } else if (address == CONTROL_REGISTER_1) {
+        shadow->controlRegister1 = value;
+        shadow->controlValid     = 1;
+    }
+}
+
+// Forget both registers, under the bus lock
+void InvalidateShadow(registerShadowMLX90640 *shadow) {
+    if (shadow != NULL) {
+        shadow->statusValid  = 0;
+        shadow->controlValid = 0;
+    }
+}
+
+// Tally a failed transaction by kind
+int CountError(int error) {
+    switch (error) {
+        case 0:
+            break;
+        case MLX90640_I2C_NACK:
+            busStats.nacks++;
+            break;
+        case MLX90640_I2C_TIMEOUT:
+            busStats.timeouts++;
+            break;
+        case MLX90640_I2C_SHORT_READ:
+            busStats.shortReads++;
+            break;
+        default:
+            busStats.busErrors++;
+            break;
+    }
+
+    return error;
+}
+
+// Error of a read that got received of the requested bytes, for transports
+// that report every failure as a byte count. The ESP32 core's requestFrom()
+// sends the register address queued by endTransmission(false) too, and
+// returns 0 on an address NACK, a timeout or SDA held low alike: nothing at
+// all is taken for a stuck bus so that it gets recovered, a partial read for
+// a short one
+int MLX90640_I2CReceivedError(unsigned int received, unsigned int requested) {
+    if (received >= requested) {
+        return (0);
+    }
+
+    return received == 0 ? MLX90640_I2C_BUS_ERROR : MLX90640_I2C_SHORT_READ;
+}
+
+// Decide on another attempt after a failed one. Backs off exponentially and
+// recovers the bus first when it looks stuck. Returns 0 once attempts run out
+// and right away when there is no bus to retry on
+int RetryAfter(const targetMLX90640 *target, int error, int attempt) {
+    if (error == MLX90640_I2C_NO_TRANSPORT || attempt >= retryLimit) {
+        return (0);
+    }
+
+    busStats.retries++;
+    if (error == MLX90640_I2C_TIMEOUT || error == MLX90640_I2C_BUS_ERROR) {
+        RecoverTransport(target->bus, target->lock);
+    }
+    delayMicroseconds(backoffMicros << attempt);
+
+    return (1);
 }
 
 // Read a number of words from startAddress. Store into Data array.
-// Returns 0 if successful, -1 if error
+// The sensor auto-increments the address, so the read is split only where
+// the transport forces it. Failed reads are retried under the policy, the
+// bus is held for one attempt at a time.
+// Returns 0 if successful, one of the MLX90640_I2C_* errors otherwise
 int MLX90640_I2CRead(uint8_t _deviceAddress, unsigned int startAddress,
                      unsigned int nWordsRead, uint16_t *data) {
-    // Caller passes number of 'unsigned ints to read', increase this to 'bytes
-    // to read'
-    uint16_t bytesRemaining = nWordsRead * 2;
-
-    // It doesn't look like sequential read works. Do we need to re-issue the
-    // address command each time?
-
-    uint16_t dataSpot = 0;  // Start at beginning of array
-
-    // Setup a series of chunked I2C_BUFFER_LENGTH byte reads
-    while (bytesRemaining > 0) {
-        Wire.beginTransmission(_deviceAddress);
-        Wire.write(startAddress >> 8);         // MSB
-        Wire.write(startAddress & 0xFF);       // LSB
-        if (Wire.endTransmission(false) != 0)  // Do not release bus
-        {
-            Serial.println("No ack read");
-            return (0);  // Sensor did not ACK
-        }
-
-        uint16_t numberOfBytesToRead = bytesRemaining;
-        if (numberOfBytesToRead > I2C_BUFFER_LENGTH)
-            numberOfBytesToRead = I2C_BUFFER_LENGTH;
+    targetMLX90640 target;
+    int error = FindTarget(_deviceAddress, &target);
+    if (error != 0) {
+        return error;
+    }
 
-        Wire.requestFrom((uint8_t)_deviceAddress, numberOfBytesToRead);
-        if (Wire.available()) {
-            for (uint16_t x = 0; x < numberOfBytesToRead / 2; x++) {
-                // Store data into array
-                data[dataSpot] = Wire.read() << 8;  // MSB
-                data[dataSpot] |= Wire.read();      // LSB
+    for (int attempt = 0;; attempt++) {
+        LockBus(target.lock);
+        error = ReadOnce(&target, startAddress, nWordsRead, data);
 
-                dataSpot++;
+        // Keep the shadow in step with whatever the bus returned
+        if (error == 0 && startAddress <= CONTROL_REGISTER_1 &&
+            startAddress + nWordsRead > STATUS_REGISTER) {
+            for (unsigned int i = 0; i < nWordsRead; i++) {
+                UpdateShadow(target.shadow, startAddress + i, data[i]);
             }
         }
+        UnlockBus(target.lock);
+
+        if (error == 0 || !RetryAfter(&target, error, attempt)) {
+            break;
+        }
+    }
 
-        bytesRemaining -= numberOfBytesToRead;
+    return error;
+}
 
-        startAddress += numberOfBytesToRead / 2;
+// Single attempt of MLX90640_I2CRead, as a series of transport sized reads.
+// The caller holds the bus
+int ReadOnce(const targetMLX90640 *target, unsigned int startAddress,
+             unsigned int nWordsRead, uint16_t *data) {
+    const transportMLX90640 *bus = target->bus;
+    uint32_t startMicros         = micros();
+    int error                    = 0;
+
+    if (bus->read == NULL) {
+        return MLX90640_I2C_NO_TRANSPORT;
     }
 
-    return (0);  // Success
+    while (nWordsRead > 0) {
+        unsigned int numberOfWordsToRead = nWordsRead;
+        if (numberOfWordsToRead > bus->maxReadWords)
+            numberOfWordsToRead = bus->maxReadWords;
+
+        busStats.readTransactions++;
+        busStats.bytesWritten += 2;
+        error = CountError(bus->read(bus->context, target->slaveAddr,
+                                     startAddress, numberOfWordsToRead, data));
+        if (error != 0) {
+            break;  // Truncated frame, do not use it
+        }
+        busStats.bytesRead += numberOfWordsToRead * 2;
+
+        data += numberOfWordsToRead;
+        nWordsRead -= numberOfWordsToRead;
+        startAddress += numberOfWordsToRead;
+    }
+    busStats.busMicros += micros() - startMicros;
+
+    return error;
 }
 
-// Set I2C Freq, in kHz
+// Set I2C Freq, in kHz, of the shared bus and of every attached one
 // MLX90640_I2CFreqSet(1000) sets frequency to 1MHz
 void MLX90640_I2CFreqSet(int freq) {
     // i2c.frequency(1000 * freq);
-    Wire.setClock((long)1000 * freq);
+    if (transport.setClock != NULL) {
+        LockBus(&sharedLock);
+        transport.setClock(transport.context, (uint32_t)1000 * freq);
+        UnlockBus(&sharedLock);
+    }
+    for (int i = 0; i < MLX90640_SHADOW_DEVICES; i++) {
+        if (shadows[i].used && shadows[i].attached &&
+            shadows[i].transport.setClock != NULL) {
+            LockBus(shadows[i].lock);
+            shadows[i].transport.setClock(shadows[i].transport.context,
+                                          (uint32_t)1000 * freq);
+            UnlockBus(shadows[i].lock);
+        }
+    }
 }
 
-// Write two bytes to a two byte address
+// Write two bytes to a two byte address and read them back
 int MLX90640_I2CWrite(uint8_t _deviceAddress, unsigned int writeAddress, uint16_t data) {
-    Wire.beginTransmission((uint8_t)_deviceAddress);
-    Wire.write(writeAddress >> 8);    // MSB
-    Wire.write(writeAddress & 0xFF);  // LSB
-    Wire.write(data >> 8);            // MSB
-    Wire.write(data & 0xFF);          // LSB
-    if (Wire.endTransmission() != 0) {
-        // Sensor did not ACK
-        Serial.println("Error: Sensor did not ack");
-        return (-1);
+    targetMLX90640 target;
+    int error = FindTarget(_deviceAddress, &target);
+    if (error != 0) {
+        return error;
+    }
+
+    for (int attempt = 0;; attempt++) {
+        LockBus(target.lock);
+        error = WriteOnce(&target, writeAddress, data, 1);
+        UnlockBus(target.lock);
+        if (error == 0 || !RetryAfter(&target, error, attempt)) {
+            break;
+        }
+    }
+
+    return error;
+}
+
+// Write without the read back, for registers the sensor changes by itself
+// (status) or commands. Saves a transaction on the per-frame path
+int MLX90640_I2CWriteUnverified(uint8_t _deviceAddress, unsigned int writeAddress, uint16_t data) {
+    targetMLX90640 target;
+    int error = FindTarget(_deviceAddress, &target);
+    if (error != 0) {
+        return error;
+    }
+
+    for (int attempt = 0;; attempt++) {
+        LockBus(target.lock);
+        error = WriteOnce(&target, writeAddress, data, 0);
+        UnlockBus(target.lock);
+        if (error == 0 || !RetryAfter(&target, error, attempt)) {
+            break;
+        }
+    }
+
+    return error;
+}
+
+// Single attempt of a write, with or without verification. The caller holds
+// the bus, so the read back belongs to the same turn
+int WriteOnce(const targetMLX90640 *target, unsigned int writeAddress,
+              uint16_t data, uint8_t verify) {
+    const transportMLX90640 *bus = target->bus;
+    uint32_t startMicros         = micros();
+
+    if (bus->write == NULL) {
+        return MLX90640_I2C_NO_TRANSPORT;
+    }
+
+    busStats.writeTransactions++;
+    busStats.bytesWritten += 4;
+    int error = CountError(
+        bus->write(bus->context, target->slaveAddr, writeAddress, data));
+    busStats.busMicros += micros() - startMicros;
+    if (error != 0) {
+        // The register may or may not have changed
+        InvalidateShadow(target->shadow);
+        return error;
+    }
+
+    if (!verify) {
+        // The sensor owns the data ready and subpage bits of the status
+        // register, so only a control write tells what the register holds
+        if (writeAddress == STATUS_REGISTER) {
+            if (target->shadow != NULL) {
+                target->shadow->statusValid = 0;
+            }
+        } else {
+            UpdateShadow(target->shadow, writeAddress, data);
+        }
+        return (0);
     }
 
     uint16_t dataCheck;
-    MLX90640_I2CRead(_deviceAddress, writeAddress, 1, &dataCheck);
+    error = ReadOnce(target, writeAddress, 1, &dataCheck);
+    if (error != 0) {
+        InvalidateShadow(target->shadow);
+        return error;
+    }
+    UpdateShadow(target->shadow, writeAddress, dataCheck);
     if (dataCheck != data) {
         // Serial.println("The write request didn't stick");
-        return -2;
+        busStats.verifyFailures++;
+        return MLX90640_I2C_VERIFY_FAILED;
     }
 
     return (0);  // Success
 }
 
+void MLX90640_I2CSetRetryPolicy(uint8_t retries, uint16_t backoff) {
+    retryLimit    = retries;
+    backoffMicros = backoff;
+}
+
+// Ask the transport of the shared bus to free it. Returns 0 when the bus is
+// usable again
+int MLX90640_I2CRecoverBus() {
+    return RecoverTransport(&transport, &sharedLock);
+}
+
+// Free a stuck bus, shared or attached, holding its lock
+int RecoverTransport(const transportMLX90640 *bus, busLockMLX90640 *lock) {
+    int error;
+
+    if (bus->recover == NULL) {
+        return MLX90640_I2C_BUS_ERROR;
+    }
+
+    LockBus(lock);
+    busStats.recoveries++;
+    error = bus->recover(bus->context);
+
+    // An interrupted write leaves the registers of all sensors on it unknown
+    for (int i = 0; i < MLX90640_SHADOW_DEVICES; i++) {
+        if (shadows[i].used && SameBus(BusOf(&shadows[i]), bus)) {
+            InvalidateShadow(&shadows[i]);
+        }
+    }
+    UnlockBus(lock);
+
+    return error;
+}
+
 int MLX90640_I2CGeneralReset(uint8_t _deviceAddress) {
-    return MLX90640_I2CWrite(_deviceAddress, 0x00, 0x06);
+    int error = MLX90640_I2CWriteUnverified(_deviceAddress, 0x00, 0x06);
+
+    // Registers are back at their power-up values
+    MLX90640_I2CInvalidateShadow(_deviceAddress);
+    return error;
+}
+
+// Read the status or control register, from the shadow when it holds a
+// value. Other addresses, and plain addresses, always go to the bus
+int MLX90640_I2CReadCached(uint8_t _deviceAddress, unsigned int address, uint16_t *data) {
+    targetMLX90640 target;
+    int hit = 0;
+
+    if (FindTarget(_deviceAddress, &target) == 0 && target.shadow != NULL) {
+        LockBus(target.lock);
+        if (address == STATUS_REGISTER && target.shadow->statusValid) {
+            *data = target.shadow->statusRegister;
+            hit   = 1;
+        } else if (address == CONTROL_REGISTER_1 &&
+                   target.shadow->controlValid) {
+            *data = target.shadow->controlRegister1;
+            hit   = 1;
+        }
+        UnlockBus(target.lock);
+    }
+    if (hit) {
+        busStats.shadowHits++;
+        return (0);
+    }
+
+    return MLX90640_I2CRead(_deviceAddress, address, 1, data);
+}
+
+// Drop the shadow copies, e.g. after the sensor was power cycled
+void MLX90640_I2CInvalidateShadow(uint8_t _deviceAddress) {
+    targetMLX90640 target;
+
+    if (FindTarget(_deviceAddress, &target) == 0 && target.shadow != NULL) {
+        LockBus(target.lock);
+        InvalidateShadow(target.shadow);
+        UnlockBus(target.lock);
+    }
+}
+
+// Reload the shadow copies from the sensor
+int MLX90640_I2CRefreshShadow(uint8_t _deviceAddress) {
+    uint16_t data;
+    int error;
+
+    error = MLX90640_I2CRead(_deviceAddress, STATUS_REGISTER, 1, &data);
+    if (error != 0) {
+        return error;
+    }
+
+    return MLX90640_I2CRead(_deviceAddress, CONTROL_REGISTER_1, 1, &data);
+}
+
+// Counters of the calling task
+void MLX90640_I2CGetStats(busStatsMLX90640 *stats) {
+    *stats = busStats;
+}
+
+void MLX90640_I2CResetStats() {
+    memset(&busStats, 0, sizeof(busStats));
+}
+
+#if defined(ARDUINO)
+
+//------------------------------------------------------------------------------
+// Wire transport
+
+// Map Wire.endTransmission() codes to driver errors: 2 and 3 are address and
+// data NACKs, 5 is the ESP32 core's timeout, the rest (bus busy, arbitration
+// lost) is a bus error
+int ClassifyWireError(uint8_t code) {
+    switch (code) {
+        case 0:
+            return (0);
+        case 2:
+        case 3:
+            return MLX90640_I2C_NACK;
+        case 5:
+            return MLX90640_I2C_TIMEOUT;
+        default:
+            return MLX90640_I2C_BUS_ERROR;
+    }
+}
+
+// One repeated start read, nWords never exceeds the Wire buffer
+int WireRead(void *context, uint8_t _deviceAddress, unsigned int startAddress,
+             unsigned int nWords, uint16_t *data) {
+    TwoWire *wire = static_cast<wireBusMLX90640 *>(context)->wire;
+
+    wire->beginTransmission(_deviceAddress);
+    wire->write(startAddress >> 8);    // MSB
+    wire->write(startAddress & 0xFF);  // LSB
+    int error = ClassifyWireError(wire->endTransmission(false));  // Do not release bus
+    if (error != 0) {
+        return error;
+    }
+
+    size_t numberOfBytesToRead = nWords * 2;
+    size_t received = wire->requestFrom((uint8_t)_deviceAddress,
+                                        numberOfBytesToRead, true);
+    error = MLX90640_I2CReceivedError(received, numberOfBytesToRead);
+    if (error != 0) {
+        return error;
+    }
+
+    for (unsigned int x = 0; x < nWords; x++) {
+        // Store data into array
+        data[x] = wire->read() << 8;  // MSB
+        data[x] |= wire->read();      // LSB
+    }
+
+    return (0);
+}
+
+int WireWrite(void *context, uint8_t _deviceAddress, unsigned int writeAddress,
+              uint16_t data) {
+    TwoWire *wire = static_cast<wireBusMLX90640 *>(context)->wire;
+
+    wire->beginTransmission((uint8_t)_deviceAddress);
+    wire->write(writeAddress >> 8);    // MSB
+    wire->write(writeAddress & 0xFF);  // LSB
+    wire->write(data >> 8);            // MSB
+    wire->write(data & 0xFF);          // LSB
+    return ClassifyWireError(wire->endTransmission());
+}
+
+void WireSetClock(void *context, uint32_t frequency) {
+    wireBusMLX90640 *bus = static_cast<wireBusMLX90640 *>(context);
+    bus->frequency       = frequency;
+    bus->wire->setClock(frequency);
+}
+
+// Pins used to bit-bang the bus free, Wire is restarted on them afterwards
+void MLX90640_I2CSetBusPins(int sdaPin, int sclPin) {
+    defaultBus.sdaPin = sdaPin;
+    defaultBus.sclPin = sclPin;
+}
+
+// Transport for a sensor on another Wire instance, to attach with
+// MLX90640_I2CAttach. The bus description has to outlive the transport. Like
+// MLX90640_I2CInit, it has to run before the bus is begun to get whole
+// subpage reads
+void MLX90640_I2CWireTransport(wireBusMLX90640 *bus,
+                               transportMLX90640 *wireBusTransport) {
+    *wireBusTransport              = wireTransport;
+    wireBusTransport->context      = bus;
+    wireBusTransport->maxReadWords = I2C_BUFFER_LENGTH / 2;
+#if defined(ARDUINO_ARCH_ESP32)
+    if (bus->wire->setBufferSize(MLX90640_I2C_BURST_BYTES) >=
+        MLX90640_I2C_BURST_BYTES) {
+        wireBusTransport->maxReadWords = MLX90640_I2C_BURST_BYTES / 2;
+    }
+#endif
+}
+
+// Free a bus held low by a slave stuck mid-byte: clock SCL until it releases
+// SDA, issue a STOP and restart Wire. Takes well under a millisecond instead
+// of a reboot. Returns 0 when SDA is high again
+int WireRecover(void *context) {
+    wireBusMLX90640 *bus = static_cast<wireBusMLX90640 *>(context);
+    int busSdaPin        = bus->sdaPin;
+    int busSclPin        = bus->sclPin;
+    int released         = 0;
+
+    if (busSdaPin < 0 || busSclPin < 0) {
+        return MLX90640_I2C_BUS_ERROR;
+    }
+
+    bus->wire->end();
+
+    pinMode(busSdaPin, INPUT_PULLUP);
+    pinMode(busSclPin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(busSclPin, HIGH);
+    for (int i = 0; i < 9 && digitalRead(busSdaPin) == LOW; i++) {
+        digitalWrite(busSclPin, LOW);
+        delayMicroseconds(5);
+        digitalWrite(busSclPin, HIGH);
+        delayMicroseconds(5);
+    }
+
+    // STOP: SDA rises while SCL is high
+    pinMode(busSdaPin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(busSdaPin, LOW);
+    delayMicroseconds(5);
+    digitalWrite(busSclPin, HIGH);
+    delayMicroseconds(5);
+    digitalWrite(busSdaPin, HIGH);
+    delayMicroseconds(5);
+    released = digitalRead(busSdaPin) == HIGH;
+
+    bus->wire->begin(busSdaPin, busSclPin, bus->frequency);
+
+    return released ? 0 : MLX90640_I2C_BUS_ERROR;
+}
+
+#else
+
+// No pins to clock a bus free on
+void MLX90640_I2CSetBusPins(int sdaPin, int sclPin) {
+    (void)sdaPin;
+    (void)sclPin;
 }
+
+#endif
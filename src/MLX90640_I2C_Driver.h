@@ -45,9 +45,97 @@
 #endif
 //-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 
+// Largest single read: one subpage of RAM (832 words) in one transaction.
+// MLX90640_I2CInit has to run before Wire.begin() to get a buffer this size
+#define MLX90640_I2C_BURST_BYTES 1664
+
+// Errors returned by the read and write functions
+#define MLX90640_I2C_NACK -1
+#define MLX90640_I2C_VERIFY_FAILED -2
+#define MLX90640_I2C_SHORT_READ -9
+#define MLX90640_I2C_TIMEOUT -10
+#define MLX90640_I2C_BUS_ERROR -11  // Arbitration lost, bus busy or stuck
+#define MLX90640_I2C_NO_TRANSPORT -12
+
+// Default policy: attempts after the first one, and the backoff before the
+// first retry, doubled for every further one
+#define MLX90640_I2C_RETRIES 2
+#define MLX90640_I2C_BACKOFF_MICROS 100
+
+// Number of sensors that can be attached, each with its status and control
+// register shadows and optionally a bus of its own
+#define MLX90640_SHADOW_DEVICES 4
+
+// Attached sensors are addressed by the handle MLX90640_I2CAttach returns,
+// in place of their 7 bit address: this bit and the slot. A plain address
+// still reaches the shared bus, without register shadows
+#define MLX90640_I2C_DEVICE 0x80
+
+// Bus activity counters, reset by the caller e.g. once per frame. Kept per
+// task, so sensors read from their own tasks count separately
+typedef struct {
+    uint32_t readTransactions;
+    uint32_t writeTransactions;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+    uint32_t busMicros;
+    uint32_t nacks;
+    uint32_t timeouts;
+    uint32_t busErrors;
+    uint32_t shortReads;
+    uint32_t verifyFailures;
+    uint32_t retries;
+    uint32_t recoveries;
+    uint32_t shadowHits;
+} busStatsMLX90640;
+
+// Bus access underneath the retry, statistics and shadow logic. read moves
+// nWords words in a single transaction, never more than maxReadWords. Both
+// return 0 or one of the MLX90640_I2C_* errors. recover and setClock may be
+// NULL when the bus has no such notion
+typedef struct {
+    int (*read)(void *context, uint8_t slaveAddr, unsigned int startAddress,
+                unsigned int nWords, uint16_t *data);
+    int (*write)(void *context, uint8_t slaveAddr, unsigned int writeAddress,
+                 uint16_t data);
+    int (*recover)(void *context);
+    void (*setClock)(void *context, uint32_t frequency);
+    void *context;
+    uint16_t maxReadWords;
+} transportMLX90640;
+
+#if defined(ARDUINO)
+class TwoWire;
+
+// A Wire instance as a transport's context: the pins to clock it free on and
+// its clock, restored after a recovery
+typedef struct {
+    TwoWire *wire;
+    int sdaPin;
+    int sclPin;
+    uint32_t frequency;
+} wireBusMLX90640;
+
+void MLX90640_I2CWireTransport(wireBusMLX90640 *bus,
+                               transportMLX90640 *wireBusTransport);
+#endif
+
 void MLX90640_I2CInit(void);
+void MLX90640_I2CSetTransport(const transportMLX90640 *newTransport);
+int MLX90640_I2CAttach(uint8_t slaveAddr, const transportMLX90640 *sensorTransport);
+void MLX90640_I2CDetach(uint8_t device);
 int MLX90640_I2CGeneralReset(uint8_t _deviceAddress);
 int MLX90640_I2CRead(uint8_t slaveAddr, unsigned int startAddress, unsigned int nWordsRead, uint16_t *data);
 int MLX90640_I2CWrite(uint8_t slaveAddr, unsigned int writeAddress, uint16_t data);
+int MLX90640_I2CWriteUnverified(uint8_t slaveAddr, unsigned int writeAddress, uint16_t data);
 void MLX90640_I2CFreqSet(int freq);
+void MLX90640_I2CSetBusPins(int sdaPin, int sclPin);
+void MLX90640_I2CSetRetryPolicy(uint8_t retries, uint16_t backoffMicros);
+int MLX90640_I2CRecoverBus(void);
+int MLX90640_I2CReceivedError(unsigned int received, unsigned int requested);
+int MLX90640_I2CReadCached(uint8_t slaveAddr, unsigned int address, uint16_t *data);
+void MLX90640_I2CInvalidateShadow(uint8_t slaveAddr);
+int MLX90640_I2CRefreshShadow(uint8_t slaveAddr);
+void MLX90640_I2CGetStats(busStatsMLX90640 *stats);
+void MLX90640_I2CResetStats(void);
 #endif
@@ -0,0 +1,440 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "MLX90640_Simulator.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#else
+#include <chrono>
+
+static uint32_t micros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+#endif
+
+#define STATUS_REGISTER 0x8000
+#define CONTROL_REGISTER_1 0x800D
+#define CONFIG_REGISTER 0x800F
+#define RAM_ADDRESS 0x0400
+#define EEPROM_ADDRESS 0x2400
+#define DATA_READY 0x0008
+
+// PTAT word of the generated frames, the VBE word is solved for the ambient
+#define SIMULATED_PTAT 1700
+
+int SimulatorRead(void *context, uint8_t slaveAddr, unsigned int startAddress,
+                  unsigned int nWords, uint16_t *data);
+int SimulatorWrite(void *context, uint8_t slaveAddr, unsigned int writeAddress,
+                   uint16_t data);
+int SimulatorRecover(void *context);
+void SimulatorAdvance(simulatorMLX90640 *sim);
+void SimulatorMeasure(simulatorMLX90640 *sim);
+void EncodeSubPage(simulatorMLX90640 *sim, const float *to);
+uint32_t RefreshPeriodMicros(const simulatorMLX90640 *sim);
+uint16_t EncodeWord(float value);
+
+int MLX90640_SimulatorInit(simulatorMLX90640 *sim, uint8_t slaveAddr,
+                           const uint16_t *eeData, uint8_t realTime) {
+    memset(sim, 0, sizeof(*sim));
+    sim->slaveAddr        = slaveAddr;
+    sim->realTime         = realTime;
+    sim->subPage          = 1;  // The first measurement is subpage 0
+    sim->controlRegister1 = 0x1901;  // Power-up: chess, 18 bit, 2 Hz
+    sim->ta               = 25;
+    sim->scene            = MLX90640_SimulatorDefaultScene;
+    memcpy(sim->eeprom, eeData, sizeof(sim->eeprom));
+
+    return MLX90640_ExtractParameters(sim->eeprom, &sim->params);
+}
+
+//------------------------------------------------------------------------------
+
+// NULL brings back the default scene
+void MLX90640_SimulatorSetScene(simulatorMLX90640 *sim, sceneMLX90640 scene,
+                                void *arg) {
+    sim->scene    = scene != NULL ? scene : MLX90640_SimulatorDefaultScene;
+    sim->sceneArg = arg;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_SimulatorSetAmbient(simulatorMLX90640 *sim, float ta) {
+    sim->ta = ta;
+}
+
+//------------------------------------------------------------------------------
+
+// Replay count frames of MLX90640_SIMULATOR_FRAME_WORDS words instead of the
+// scene, NULL goes back to the scene. The frames are not copied. A pending
+// subpage is dropped so that the next one is the first recorded frame
+void MLX90640_SimulatorSetRecording(simulatorMLX90640 *sim,
+                                    const uint16_t *frames, uint32_t count) {
+    sim->recording       = count > 0 ? frames : NULL;
+    sim->recordingFrames = count;
+    sim->recordingIndex  = 0;
+    sim->statusRegister &= ~DATA_READY;
+}
+
+//------------------------------------------------------------------------------
+
+// Held low by the slave until the bus is recovered
+void MLX90640_SimulatorSetStuckBus(simulatorMLX90640 *sim, uint8_t stuck) {
+    sim->stuckBus = stuck;
+}
+
+//------------------------------------------------------------------------------
+
+void MLX90640_SimulatorTransport(simulatorMLX90640 *sim,
+                                 transportMLX90640 *transport) {
+    transport->read         = SimulatorRead;
+    transport->write        = SimulatorWrite;
+    transport->recover      = SimulatorRecover;
+    transport->setClock     = NULL;
+    transport->context      = sim;
+    transport->maxReadWords = 0xFFFF;
+}
+
+//------------------------------------------------------------------------------
+
+// A plausible calibration: fixed scalar parameters and a deterministic
+// spread of the per pixel ones, no defective pixels
+void MLX90640_SimulatorSyntheticEE(uint16_t *eeData) {
+    static const uint16_t header[48] = {
+        0x4210, 0xFFC4, 0x0202, 0x0202, 0xF202, 0xF1F2, 0xE1E1, 0xD1E1,
+        0xF10F, 0xF00F, 0xE0EF, 0xE0EF, 0xE1E0, 0xF1F1, 0xF2F2, 0x0202,
+        0x4455, 0x2E2C, 0x1111, 0x2121, 0x2111, 0x1011, 0x0000, 0xF0FF,
+        0xE0EF, 0xE0EF, 0xF0EF, 0x1011, 0x2122, 0x2122, 0x1121, 0xF00F,
+        0x18EF, 0x2FF1, 0x5952, 0x9D68, 0x5354, 0x2A53, 0x7A6D, 0x6766,
+        0x2363, 0x04E0, 0xFBB5, 0x2650, 0xF020, 0xFDFD, 0xFEFC, 0x1794};
+    uint32_t seed = 0x4D4C5839;
+
+    memset(eeData, 0, 64 * sizeof(uint16_t));
+    eeData[10] = 0x0000;  // Calibrated in chess mode
+    memcpy(&eeData[16], header, sizeof(header));
+
+    for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++) {
+        seed = seed * 1103515245 + 12345;
+        uint16_t offset = (seed >> 8) & 0xFC00;
+        uint16_t alpha  = ((seed >> 4) & 0x01F0) | 0x0200;
+        uint16_t kta    = (seed >> 20) & 0x000E;
+        eeData[64 + pixelNumber] = offset | alpha | kta;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// Background a little above ambient with a vertical gradient, and a 34 C
+// spot circling the centre once every 64 frames
+void MLX90640_SimulatorDefaultScene(void *arg, uint32_t frameNumber, float ta,
+                                    float *to) {
+    (void)arg;
+    float angle   = (frameNumber % 64) * (6.2831853f / 64);
+    float centreX = 15.5f + 8 * cosf(angle);
+    float centreY = 11.5f + 5 * sinf(angle);
+
+    for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++) {
+        int row  = pixelNumber / 32;
+        int col  = pixelNumber % 32;
+        float dx = col - centreX;
+        float dy = row - centreY;
+        float r2 = dx * dx + dy * dy;
+
+        to[pixelNumber] = ta + 2 + row * 0.125f;
+        if (r2 < 9) {
+            to[pixelNumber] = 34 - r2 * 0.25f;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int SimulatorRead(void *context, uint8_t slaveAddr, unsigned int startAddress,
+                  unsigned int nWords, uint16_t *data) {
+    simulatorMLX90640 *sim = (simulatorMLX90640 *)context;
+
+    if (sim->stuckBus) {
+        return MLX90640_I2CReceivedError(0, nWords * 2);
+    }
+    if (slaveAddr != sim->slaveAddr) {
+        return MLX90640_I2C_NACK;
+    }
+
+    SimulatorAdvance(sim);
+
+    for (unsigned int i = 0; i < nWords; i++) {
+        unsigned int address = startAddress + i;
+
+        if (address >= RAM_ADDRESS && address < RAM_ADDRESS + 832) {
+            data[i] = sim->ram[address - RAM_ADDRESS];
+        } else if (address >= EEPROM_ADDRESS &&
+                   address < EEPROM_ADDRESS + 832) {
+            data[i] = sim->eeprom[address - EEPROM_ADDRESS];
+        } else if (address == STATUS_REGISTER) {
+            data[i] = sim->statusRegister;
+            // Without the clock a measurement completes right after every
+            // poll that found none: the read back after clearing data ready
+            // still sees it clear, the next poll sees the new subpage
+            if (!sim->realTime && !(sim->statusRegister & DATA_READY)) {
+                SimulatorMeasure(sim);
+            }
+        } else if (address == CONTROL_REGISTER_1) {
+            data[i] = sim->controlRegister1;
+        } else if (address == CONFIG_REGISTER) {
+            data[i] = sim->configRegister;
+        } else {
+            data[i] = 0;
+        }
+    }
+
+    return (0);
+}
+
+//------------------------------------------------------------------------------
+
+// RAM and EEPROM ignore writes, the EEPROM would need an erase cycle first,
+// so a verified write there fails the way it does on the sensor
+int SimulatorWrite(void *context, uint8_t slaveAddr, unsigned int writeAddress,
+                   uint16_t data) {
+    simulatorMLX90640 *sim = (simulatorMLX90640 *)context;
+
+    if (sim->stuckBus) {
+        return MLX90640_I2C_BUS_ERROR;  // Bus busy
+    }
+    if (slaveAddr != sim->slaveAddr) {
+        return MLX90640_I2C_NACK;
+    }
+
+    SimulatorAdvance(sim);
+
+    if (writeAddress == STATUS_REGISTER) {
+        // The subpage bits belong to the sensor
+        sim->statusRegister =
+            (sim->statusRegister & 0x0007) | (data & 0xFFF8);
+    } else if (writeAddress == CONTROL_REGISTER_1) {
+        sim->controlRegister1 = data;
+    } else if (writeAddress == CONFIG_REGISTER) {
+        sim->configRegister = data;
+    }
+
+    return (0);
+}
+
+//------------------------------------------------------------------------------
+
+// Clocking the bus free always succeeds
+int SimulatorRecover(void *context) {
+    simulatorMLX90640 *sim = (simulatorMLX90640 *)context;
+
+    sim->stuckBus = 0;
+    return (0);
+}
+
+//------------------------------------------------------------------------------
+
+// Measure every subpage whose refresh period has passed. After a long gap
+// only the last one is encoded, the skipped ones still alternate the subpage
+void SimulatorAdvance(simulatorMLX90640 *sim) {
+    uint32_t now;
+    uint32_t period;
+    uint32_t periods;
+
+    if (!sim->realTime) {
+        return;
+    }
+
+    now    = micros();
+    period = RefreshPeriodMicros(sim);
+    if (!sim->started) {
+        sim->started         = 1;
+        sim->nextReadyMicros = now + period;
+        return;
+    }
+    if ((int32_t)(now - sim->nextReadyMicros) < 0) {
+        return;
+    }
+
+    periods = (now - sim->nextReadyMicros) / period + 1;
+    if (periods > 1) {
+        sim->subPages += periods - 1;
+        sim->subPage ^= (periods - 1) & 1;
+        if (sim->recording != NULL) {
+            sim->recordingIndex =
+                (sim->recordingIndex + periods - 1) % sim->recordingFrames;
+        }
+    }
+    SimulatorMeasure(sim);
+    sim->nextReadyMicros += periods * period;
+}
+
+//------------------------------------------------------------------------------
+
+// Finish a measurement: new RAM contents, subpage number and data ready
+void SimulatorMeasure(simulatorMLX90640 *sim) {
+    if (sim->recording != NULL) {
+        const uint16_t *frame =
+            sim->recording + sim->recordingIndex * MLX90640_SIMULATOR_FRAME_WORDS;
+        memcpy(sim->ram, frame, sizeof(sim->ram));
+        sim->subPage        = frame[833] & 0x0001;
+        sim->recordingIndex = (sim->recordingIndex + 1) % sim->recordingFrames;
+    } else {
+        float to[768];
+
+        sim->subPage ^= 1;
+        sim->scene(sim->sceneArg, sim->subPages / 2, sim->ta, to);
+        EncodeSubPage(sim, to);
+    }
+
+    sim->subPages++;
+    sim->statusRegister =
+        (sim->statusRegister & 0xFFF0) | DATA_READY | sim->subPage;
+}
+
+//------------------------------------------------------------------------------
+
+// Subpage period for the refresh rate in control register 1: 2 s at code 0,
+// halved with every step
+uint32_t RefreshPeriodMicros(const simulatorMLX90640 *sim) {
+    return (uint32_t)2000000 >> ((sim->controlRegister1 & 0x0380) >> 7);
+}
+
+//------------------------------------------------------------------------------
+
+uint16_t EncodeWord(float value) {
+    value = roundf(value);
+    if (value > 32767) {
+        value = 32767;
+    } else if (value < -32768) {
+        value = -32768;
+    }
+
+    return (uint16_t)(int16_t)value;
+}
+
+//------------------------------------------------------------------------------
+
+// Raw pixel words of the current subpage for the object temperatures in to,
+// at Vdd 3.3 V and gain 1 so that the supply terms drop out. Follows
+// MLX90640_CalculateTo backwards with emissivity 1
+void EncodeSubPage(simulatorMLX90640 *sim, const float *to) {
+    const paramsMLX90640 *params = &sim->params;
+    uint16_t *ram                = sim->ram;
+    float ta                     = sim->ta;
+    float ta4;
+    float ptatArt;
+    float cpCompensation;
+    float irDataCP;
+    float alphaCorrR[4];
+    float alphaScale;
+    float ktaScale;
+    int resolutionRAM;
+    uint8_t mode;
+
+    resolutionRAM = (sim->controlRegister1 & 0x0C00) >> 10;
+    mode          = (sim->controlRegister1 & 0x1000) >> 5;
+
+    //------------------------- Supply, ambient and gain words
+    ram[810] = EncodeWord(params->vdd25 * pow(2, (double)resolutionRAM) /
+                          pow(2, (double)params->resolutionEE));
+    ptatArt  = (ta - 25) * params->KtPTAT + params->vPTAT25;
+    ram[800] = SIMULATED_PTAT;
+    ram[768] = EncodeWord(SIMULATED_PTAT * pow(2, (double)18) / ptatArt -
+                          SIMULATED_PTAT * params->alphaPTAT);
+    ram[778] = (uint16_t)params->gainEE;
+
+    //------------------------- Compensation pixels
+    cpCompensation = 1 + params->cpKta * (ta - 25);
+    if (sim->subPage == 0) {
+        ram[776] = EncodeWord(params->cpOffset[0] * cpCompensation);
+        irDataCP = (int16_t)ram[776] - params->cpOffset[0] * cpCompensation;
+    } else {
+        float cpOffset = params->cpOffset[1];
+        if (mode != params->calibrationModeEE) {
+            cpOffset += params->ilChessC[0];
+        }
+        ram[808] = EncodeWord(cpOffset * cpCompensation);
+        irDataCP = (int16_t)ram[808] - cpOffset * cpCompensation;
+    }
+
+    //------------------------- Pixels
+    ta4 = (ta + 273.15);
+    ta4 = ta4 * ta4;
+    ta4 = ta4 * ta4;
+
+    alphaScale = pow(2, (double)params->alphaScale);
+    ktaScale   = pow(2, (double)params->ktaScale);
+
+    alphaCorrR[0] = 1 / (1 + params->ksTo[0] * 40);
+    alphaCorrR[1] = 1;
+    alphaCorrR[2] = (1 + params->ksTo[1] * params->ct[2]);
+    alphaCorrR[3] =
+        alphaCorrR[2] * (1 + params->ksTo[2] * (params->ct[3] - params->ct[2]));
+
+    for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++) {
+        int8_t ilPattern    = pixelNumber / 32 - (pixelNumber / 64) * 2;
+        int8_t chessPattern = ilPattern ^ (pixelNumber - (pixelNumber / 2) * 2);
+        int8_t conversionPattern =
+            ((pixelNumber + 2) / 4 - (pixelNumber + 3) / 4 +
+             (pixelNumber + 1) / 4 - pixelNumber / 4) *
+            (1 - 2 * ilPattern);
+        int8_t pattern = mode == 0 ? ilPattern : chessPattern;
+        float To;
+        float to4;
+        float alphaCompensated;
+        float irData;
+        int8_t range;
+
+        if (pattern != sim->subPage) {
+            continue;  // Keeps the value of the other subpage
+        }
+
+        To = to[pixelNumber];
+        if (To < params->ct[1]) {
+            range = 0;
+        } else if (To < params->ct[2]) {
+            range = 1;
+        } else if (To < params->ct[3]) {
+            range = 2;
+        } else {
+            range = 3;
+        }
+
+        to4 = (To + 273.15);
+        to4 = to4 * to4;
+        to4 = to4 * to4;
+
+        alphaCompensated = SCALEALPHA * alphaScale / params->alpha[pixelNumber];
+        alphaCompensated = alphaCompensated * (1 + params->KsTa * (ta - 25));
+
+        irData = alphaCompensated * alphaCorrR[range] *
+                 (1 + params->ksTo[range] * (To - params->ct[range])) *
+                 (to4 - ta4);
+        irData = irData + params->tgc * irDataCP;
+        if (mode != params->calibrationModeEE) {
+            irData = irData - params->ilChessC[2] * (2 * ilPattern - 1) +
+                     params->ilChessC[1] * conversionPattern;
+        }
+        irData = irData + params->offset[pixelNumber] *
+                              (1 + params->kta[pixelNumber] / ktaScale *
+                                       (ta - 25));
+
+        ram[pixelNumber] = EncodeWord(irData);
+    }
+}
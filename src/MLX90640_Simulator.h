@@ -0,0 +1,87 @@
+/**
+ * @copyright (C) 2017 Melexis N.V.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _MLX90640_SIMULATOR_H_
+#define _MLX90640_SIMULATOR_H_
+
+#include <stdint.h>
+
+#include "MLX90640_API.h"
+#include "MLX90640_I2C_Driver.h"
+
+// Register level model of an MLX90640 behind a transportMLX90640, so the API
+// and everything above it runs without a sensor, e.g. on a host.
+//
+// Served: the EEPROM image at 0x2400, RAM at 0x0400, the status register
+// 0x8000 (subpage in bits 0..2, data ready in bit 3, cleared by writing it
+// 0), control register 0x800D (refresh rate, resolution, chess mode) and the
+// I2C configuration register 0x800F. Subpages alternate on every measurement.
+//
+// Real time: a subpage is measured every refresh period of the wall clock.
+// Otherwise the next one is done right after a status poll that found data
+// ready clear, i.e. frames arrive as fast as the host can take them.
+//
+// RAM comes from a recording, frames of 834 words as returned by
+// MLX90640_GetFrameData and replayed in a loop, or from a scene of object
+// temperatures encoded through the inverse of the calibration. Decoding
+// with emissivity 1 gives back the scene temperatures.
+//
+// A stuck bus fails every transaction the way Wire does on the ESP32, reads
+// with no bytes received, until the transport's recover is called.
+
+#define MLX90640_SIMULATOR_FRAME_WORDS 834
+
+// Fill to[768] with the object temperatures of a frame
+typedef void (*sceneMLX90640)(void *arg, uint32_t frameNumber, float ta,
+                              float *to);
+
+typedef struct {
+    uint8_t slaveAddr;
+    uint8_t realTime;
+    uint8_t started;
+    uint8_t subPage;
+    uint8_t stuckBus;
+    uint16_t statusRegister;
+    uint16_t controlRegister1;
+    uint16_t configRegister;
+    uint16_t eeprom[832];
+    uint16_t ram[832];
+    paramsMLX90640 params;
+    float ta;
+    uint32_t subPages;
+    uint32_t nextReadyMicros;
+    sceneMLX90640 scene;
+    void *sceneArg;
+    const uint16_t *recording;
+    uint32_t recordingFrames;
+    uint32_t recordingIndex;
+} simulatorMLX90640;
+
+int MLX90640_SimulatorInit(simulatorMLX90640 *sim, uint8_t slaveAddr,
+                           const uint16_t *eeData, uint8_t realTime);
+void MLX90640_SimulatorSetScene(simulatorMLX90640 *sim, sceneMLX90640 scene,
+                                void *arg);
+void MLX90640_SimulatorSetAmbient(simulatorMLX90640 *sim, float ta);
+void MLX90640_SimulatorSetRecording(simulatorMLX90640 *sim,
+                                    const uint16_t *frames, uint32_t count);
+void MLX90640_SimulatorSetStuckBus(simulatorMLX90640 *sim, uint8_t stuck);
+void MLX90640_SimulatorTransport(simulatorMLX90640 *sim,
+                                 transportMLX90640 *transport);
+void MLX90640_SimulatorSyntheticEE(uint16_t *eeData);
+void MLX90640_SimulatorDefaultScene(void *arg, uint32_t frameNumber, float ta,
+                                    float *to);
+
+#endif
@@ -0,0 +1,130 @@
+#include "acquisition.h"
+#include "MLX90640_API.h"
+
+#define MIN_GUARD_MICROS 1000
+#define POLL_INTERVAL_MICROS 1000
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+static uint32_t nowMicros()
+{
+  return micros();
+}
+
+// Give the core away for whole scheduler ticks, the guard time absorbs the remainder
+static void sleepMicros(uint32_t us)
+{
+  TickType_t ticks = us / 1000 / portTICK_PERIOD_MS;
+  if (ticks > 0) vTaskDelay(ticks);
+  else taskYIELD();
+}
+
+#else // Host build: the same scheduling on std::chrono for tests against a simulated sensor
+
+#include <chrono>
+#include <thread>
+
+static uint32_t nowMicros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleepMicros(uint32_t us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+#endif
+
+// Start unsynchronized, the first frame is found by polling and sets the phase
+void acquisitionBegin(Acquisition *acq, uint8_t slaveAddr, uint8_t refreshRate)
+{
+  acq->slaveAddr = slaveAddr;
+  acq->pollIntervalMicros = POLL_INTERVAL_MICROS;
+  acq->lastReadyMicros = 0;
+  acq->readMicros = 0;
+  acquisitionSetRefreshRate(acq, refreshRate);
+  acquisitionResetStats(acq);
+}
+
+// After the sensor switched its refresh rate: the phase is lost, find it again by polling
+void acquisitionSetRefreshRate(Acquisition *acq, uint8_t refreshRate)
+{
+  acq->periodMicros = 2000000 >> (refreshRate & 0x07); // 0x00: 0.5Hz ... 0x07: 64Hz
+  acq->guardMicros = 2 * MIN_GUARD_MICROS;
+  acq->synced = false;
+}
+
+// Sleep until shortly before the next subpage is due, poll for it and read it.
+// Returns the subpage number or a negative error like MLX90640_GetFrameData
+int acquisitionGetFrame(Acquisition *acq, uint16_t *frameData)
+{
+  uint32_t predictedMicros = acq->lastReadyMicros + acq->periodMicros;
+  bool slept = false;
+
+  if (acq->synced)
+  {
+    int32_t sleep = (int32_t)(predictedMicros - acq->guardMicros - nowMicros());
+    if (sleep > 0)
+    {
+      uint32_t sleepStart = nowMicros();
+      sleepMicros(sleep);
+      acq->sleptMicros += nowMicros() - sleepStart; // Whole ticks on the device, oversleeping on a busy host
+      slept = true;
+    }
+  }
+
+  uint32_t pollStart = nowMicros();
+  uint32_t polls = 0;
+  int ready;
+  for (;;)
+  {
+    ready = MLX90640_IsDataReady(acq->slaveAddr);
+    polls++;
+    if (ready != 0) break; // Data ready or bus error
+    sleepMicros(acq->pollIntervalMicros);
+  }
+  uint32_t readyMicros = nowMicros();
+  acq->polls += polls;
+
+  if (ready < 0)
+  {
+    acq->synced = false;
+    return ready;
+  }
+
+  if (polls > 1)
+  {
+    // Caught the edge within one poll interval, tighten the guard towards its minimum
+    acq->wastedMicros += readyMicros - pollStart;
+    if (acq->guardMicros > MIN_GUARD_MICROS) acq->guardMicros -= acq->guardMicros / 8;
+  }
+  else if (acq->synced)
+  {
+    // The data was already waiting, its real moment is unknown: keep the prediction unless a whole period was
+    // missed. Wake up earlier next time if it was the schedule, not a slow caller, that came late
+    acq->lateWakeups++;
+    if ((int32_t)(readyMicros - predictedMicros) < (int32_t)acq->periodMicros) readyMicros = predictedMicros;
+    if (slept && acq->guardMicros < acq->periodMicros / 4) acq->guardMicros += acq->guardMicros / 2;
+  }
+
+  acq->lastReadyMicros = readyMicros;
+  acq->synced = true;
+  acq->frames++;
+
+  uint32_t readStart = nowMicros();
+  int status = MLX90640_ReadFrameData(acq->slaveAddr, frameData);
+  acq->readMicros = nowMicros() - readStart;
+  return status;
+}
+
+void acquisitionResetStats(Acquisition *acq)
+{
+  acq->frames = 0;
+  acq->polls = 0;
+  acq->lateWakeups = 0;
+  acq->sleptMicros = 0;
+  acq->wastedMicros = 0;
+}
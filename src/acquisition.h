@@ -0,0 +1,31 @@
+// Frame acquisition scheduled around the sensor's data ready moments: sleeps through most of the
+// subpage period and polls the status register only inside a short window before the next subpage
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include <stdint.h>
+
+struct Acquisition
+{
+  uint8_t slaveAddr;
+  uint32_t periodMicros; // Subpage period of the configured refresh rate
+  uint32_t guardMicros; // Wake up this long before the predicted data ready moment
+  uint32_t pollIntervalMicros;
+  uint32_t lastReadyMicros; // Observed or, after a late wake up, predicted data ready moment
+  bool synced;
+  uint32_t readMicros; // Duration of the last frame data read
+
+  // Statistics, cleared by acquisitionResetStats
+  uint32_t frames;
+  uint32_t polls;
+  uint32_t lateWakeups; // Data was already waiting on the first poll
+  uint32_t sleptMicros; // Measured, not requested
+  uint32_t wastedMicros; // Polling before the data was ready
+};
+
+void acquisitionBegin(Acquisition *acq, uint8_t slaveAddr, uint8_t refreshRate);
+void acquisitionSetRefreshRate(Acquisition *acq, uint8_t refreshRate);
+int acquisitionGetFrame(Acquisition *acq, uint16_t *frameData);
+void acquisitionResetStats(Acquisition *acq);
+
+#endif // ACQUISITION_H
@@ -1,4 +1,3 @@
-#include <Arduino.h>
 #include "constants.h"
 
 // Color map array of 256 colors from cold to hot
@@ -2,8 +2,15 @@
 #ifndef INTERPOLAION_H
 #define INTERPOLAION_H
 
+#if defined(ARDUINO)
 #include <Arduino.h>
+#else
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#endif
 #include "constants.h"
+#include "simd.h"
 
 // Float to 0..255
 inline int mapf(float in, float a, float b) __attribute__((always_inline));
@@ -14,9 +21,356 @@ inline int mapf(float in, float a, float b)
   return (int)(in - a) * 255 / (b - a);
 }
 
-// Linear interpolation
-inline void interpolate(float *data, uint16_t *out, int matrixX, int matrixY, int imageW, int imageH, float tempRangeMin, float tempRangeMax) __attribute__((always_inline));
-inline void interpolate(float *data, uint16_t *out, int matrixX, int matrixY, int imageW, int imageH, float tempRangeMin, float tempRangeMax)
+#define INTERPOLATION_MAX_SOURCE 128 // Source columns or rows, e.g. a few stitched sensors
+#define INTERPOLATION_MAX_IMAGE 480 // Image columns or rows, up to the full screen
+#define INTERPOLATION_HEADROOM (4 * 65280) // Color indexes beyond the range that are still interpolated, within int32
+#define KERNEL_TAPS 4
+#define KERNEL_BITS 10 // Fractional bits of the kernel weights
+#define INTERPOLATION_GRID_COLOR 0x0000 // Black, the same in either byte order
+
+// Upscalers, from the cheapest to the sharpest
+enum InterpolationMode
+{
+  INTERPOLATION_BLOCKS, // Every source pixel a block, as drawn by fillRect
+  INTERPOLATION_GRID, // Blocks with grid lines between them
+  INTERPOLATION_BILINEAR,
+  INTERPOLATION_BICUBIC, // Catmull-Rom
+  INTERPOLATION_LANCZOS2
+};
+
+// Source position of every image column or row: the source pixel at or before it and the weight of the next one
+struct InterpolationAxis
+{
+  uint16_t index[INTERPOLATION_MAX_IMAGE];
+  uint16_t weight[INTERPOLATION_MAX_IMAGE]; // 0..255 of 256
+};
+
+// Four tap kernel of every image column or row: the source pixel at or before it, taps from the one before that
+// to the second after, weights summing up to 1 << KERNEL_BITS
+struct KernelAxis
+{
+  uint16_t index[INTERPOLATION_MAX_IMAGE];
+  int16_t weight[INTERPOLATION_MAX_IMAGE][KERNEL_TAPS];
+};
+
+// Weights of the bilinear interpolation and of one kernel, computed once for the source and image sizes and
+// again whenever the view changes
+struct InterpolationTables
+{
+  int matrixX;
+  int matrixY;
+  int imageW;
+  int imageH;
+  int32_t viewX; // Source region shown in the image, in source pixels with 8 fractional bits
+  int32_t viewY;
+  int32_t viewW;
+  int32_t viewH;
+  InterpolationAxis x;
+  InterpolationAxis y;
+  InterpolationMode kernel; // The one kernelX and kernelY hold, INTERPOLATION_BILINEAR: none
+  KernelAxis kernelX;
+  KernelAxis kernelY;
+};
+
+// Source pixel offset + n lands on image pixel n * image / span (offset and span with 8 fractional bits), past
+// the last one it is repeated. Indexes never decrease, the first and the last bound the source pixels read
+inline bool prepareInterpolationAxis(InterpolationAxis *axis, int source, int image, int32_t offset, int32_t span)
+{
+  if (source < 1 || source > INTERPOLATION_MAX_SOURCE || image < 1 || image > INTERPOLATION_MAX_IMAGE) return false;
+
+  for (int i = 0; i < image; i++)
+  {
+    uint32_t position = offset + (uint32_t)i * span / image; // 8 fractional bits
+    axis->index[i] = position >> 8;
+    axis->weight[i] = position & 0xFF;
+    if (axis->index[i] >= source - 1)
+    {
+      axis->index[i] = source - 1;
+      axis->weight[i] = 0;
+    }
+  }
+  return true;
+}
+
+// Tables for the whole source in the image. Returns false when a size exceeds the tables
+inline bool prepareInterpolationTables(InterpolationTables *tables, int matrixX, int matrixY, int imageW, int imageH)
+{
+  tables->matrixX = matrixX;
+  tables->matrixY = matrixY;
+  tables->imageW = imageW;
+  tables->imageH = imageH;
+  tables->viewX = 0;
+  tables->viewY = 0;
+  tables->viewW = matrixX * 256;
+  tables->viewH = matrixY * 256;
+  tables->kernel = INTERPOLATION_BILINEAR;
+  return prepareInterpolationAxis(&tables->x, matrixX, imageW, 0, tables->viewW) && prepareInterpolationAxis(&tables->y, matrixY, imageH, 0, tables->viewH);
+}
+
+// Weight of a source pixel at distance x
+inline float kernelWeight(InterpolationMode kernel, float x)
+{
+  x = fabsf(x);
+  if (x >= 2) return 0;
+
+  if (kernel == INTERPOLATION_BICUBIC)
+  {
+    if (x < 1) return (1.5f * x - 2.5f) * x * x + 1;
+    return ((-0.5f * x + 2.5f) * x - 4) * x + 2;
+  }
+
+  // Lanczos-2: sinc(x) * sinc(x / 2)
+  if (x < 1e-6f) return 1;
+  float px = (float)M_PI * x;
+  return 2 * sinf(px) * sinf(px / 2) / (px * px);
+}
+
+// Same source positions as prepareInterpolationAxis, the weights normalized and rounded to KERNEL_BITS
+inline void prepareKernelAxis(KernelAxis *axis, InterpolationMode kernel, int source, int image, int32_t offset, int32_t span)
+{
+  for (int i = 0; i < image; i++)
+  {
+    float position = (offset + (float)i * span / image) / 256;
+    int index = (int)position;
+    float fraction = position - index;
+    if (index >= source - 1)
+    {
+      index = source - 1;
+      fraction = 0;
+    }
+    axis->index[i] = index;
+
+    float weights[KERNEL_TAPS];
+    float sum = 0;
+    for (int k = 0; k < KERNEL_TAPS; k++)
+    {
+      weights[k] = kernelWeight(kernel, fraction + 1 - k);
+      sum += weights[k];
+    }
+
+    // The rounding error goes to the largest tap, so that flat areas stay flat
+    int total = 0;
+    int largest = 1;
+    for (int k = 0; k < KERNEL_TAPS; k++)
+    {
+      axis->weight[i][k] = (int16_t)lroundf(weights[k] / sum * (1 << KERNEL_BITS));
+      total += axis->weight[i][k];
+      if (weights[k] > weights[largest]) largest = k;
+    }
+    axis->weight[i][largest] += (1 << KERNEL_BITS) - total;
+  }
+}
+
+// Kernel tables for bicubic or Lanczos-2, once the bilinear ones are prepared. Returns false for other modes
+inline bool prepareInterpolationKernel(InterpolationTables *tables, InterpolationMode kernel)
+{
+  if (kernel != INTERPOLATION_BICUBIC && kernel != INTERPOLATION_LANCZOS2) return false;
+
+  prepareKernelAxis(&tables->kernelX, kernel, tables->matrixX, tables->imageW, tables->viewX, tables->viewW);
+  prepareKernelAxis(&tables->kernelY, kernel, tables->matrixY, tables->imageH, tables->viewY, tables->viewH);
+  tables->kernel = kernel;
+  return true;
+}
+
+// Zoom and pan: show the source region at x, y of w by h source pixels, all with 8 fractional bits, kept within
+// the source and at least a pixel in size. The tables are rebuilt only when the region changes, returns whether
+// they were. Not while rendering with them
+inline bool setInterpolationView(InterpolationTables *tables, int32_t x, int32_t y, int32_t w, int32_t h)
+{
+  int32_t sourceW = tables->matrixX * 256;
+  int32_t sourceH = tables->matrixY * 256;
+  w = w < 256 ? 256 : w > sourceW ? sourceW : w;
+  h = h < 256 ? 256 : h > sourceH ? sourceH : h;
+  x = x < 0 ? 0 : x > sourceW - w ? sourceW - w : x;
+  y = y < 0 ? 0 : y > sourceH - h ? sourceH - h : y;
+  if (x == tables->viewX && y == tables->viewY && w == tables->viewW && h == tables->viewH) return false;
+
+  tables->viewX = x;
+  tables->viewY = y;
+  tables->viewW = w;
+  tables->viewH = h;
+  prepareInterpolationAxis(&tables->x, tables->matrixX, tables->imageW, x, w);
+  prepareInterpolationAxis(&tables->y, tables->matrixY, tables->imageH, y, h);
+  if (tables->kernel != INTERPOLATION_BILINEAR) prepareInterpolationKernel(tables, tables->kernel);
+  return true;
+}
+
+// Temperatures to color indexes with 8 fractional bits, 0..255 within the range. Beyond it they are kept
+// within a few ranges only, the interpolation is clamped after the fact
+inline void normalizeRow(const float *data, int32_t *out, int count, float tempRangeMin, float scale) __attribute__((always_inline));
+inline void normalizeRow(const float *data, int32_t *out, int count, float tempRangeMin, float scale)
+{
+  for (int i = 0; i < count; i++)
+  {
+    float value = (data[i] - tempRangeMin) * scale;
+    if (!(value > -INTERPOLATION_HEADROOM)) out[i] = value != value ? 0 : -INTERPOLATION_HEADROOM; // NaN as the range minimum
+    else if (value >= 65280 + INTERPOLATION_HEADROOM) out[i] = 65280 + INTERPOLATION_HEADROOM;
+    else out[i] = (int32_t)(value + 0.5f);
+  }
+}
+
+// Bilinear interpolation of temperatures into image rows firstRow..firstRow + rows - 1, colored by palette and
+// written row by row in a single pass. Each image row is interpolated vertically at source width, then
+// horizontally; the color index is clamped and quantized only at the end
+inline void interpolateRows(const InterpolationTables *tables, const float *data, uint16_t *out, float tempRangeMin, float tempRangeMax, int firstRow, int rows, const uint16_t *palette)
+{
+  int32_t upper[INTERPOLATION_MAX_SOURCE];
+  int32_t lower[INTERPOLATION_MAX_SOURCE];
+  int32_t base[INTERPOLATION_MAX_SOURCE]; // Row interpolated vertically, 16 fractional bits
+  int32_t slope[INTERPOLATION_MAX_SOURCE]; // Difference to the next pixel, none past the last one
+  int matrixX = tables->matrixX;
+  float scale = 65280 / (tempRangeMax - tempRangeMin);
+  int loaded = -1;
+
+  // Columns the view reads, all of them unless zoomed in
+  int first = tables->x.index[0];
+  int last = tables->x.index[tables->imageW - 1] < matrixX - 1 ? tables->x.index[tables->imageW - 1] + 1 : matrixX - 1;
+
+  for (int h = firstRow; h < firstRow + rows; h++)
+  {
+    int y = tables->y.index[h];
+    if (y != loaded)
+    {
+      normalizeRow(data + y * matrixX + first, upper + first, last - first + 1, tempRangeMin, scale);
+      normalizeRow(data + (y < tables->matrixY - 1 ? y + 1 : y) * matrixX + first, lower + first, last - first + 1, tempRangeMin, scale);
+      loaded = y;
+    }
+
+    int32_t weightY = tables->y.weight[h];
+    int32_t previous = upper[first] * 256 + (lower[first] - upper[first]) * weightY;
+    for (int w = first; w < last; w++)
+    {
+      int32_t next = upper[w + 1] * 256 + (lower[w + 1] - upper[w + 1]) * weightY;
+      base[w] = previous;
+      slope[w] = (next - previous) >> 8;
+      previous = next;
+    }
+    base[last] = previous;
+    slope[last] = 0;
+
+    const uint16_t *index = tables->x.index;
+    const uint16_t *weight = tables->x.weight;
+    for (int w = 0; w < tables->imageW; w++)
+    {
+      int32_t value = base[index[w]] + slope[index[w]] * weight[w];
+      if (value < 0) value = 0;
+      else if (value > 0xFFFFFF) value = 0xFFFFFF;
+      *out++ = palette[value >> 16];
+    }
+  }
+}
+
+// Whole image in colorMap
+inline void interpolate(const InterpolationTables *tables, const float *data, uint16_t *out, float tempRangeMin, float tempRangeMax)
+{
+  interpolateRows(tables, data, out, tempRangeMin, tempRangeMax, 0, tables->imageH, colorMap);
+}
+
+// Image rows through the four tap kernel in the tables, like interpolateRows: vertically at source width from
+// the four source rows around, then horizontally, quantized at the end
+inline void kernelRows(const InterpolationTables *tables, const float *data, uint16_t *out, float tempRangeMin, float tempRangeMax, int firstRow, int rows, const uint16_t *palette)
+{
+  int32_t normalized[KERNEL_TAPS][INTERPOLATION_MAX_SOURCE]; // Source row y in slot y % KERNEL_TAPS
+  int cached[KERNEL_TAPS] = {-1, -1, -1, -1};
+  int32_t row[INTERPOLATION_MAX_SOURCE + KERNEL_TAPS - 1]; // 8 fractional bits, edge pixels repeated: one left, two right
+  int matrixX = tables->matrixX;
+  int matrixY = tables->matrixY;
+  float scale = 65280 / (tempRangeMax - tempRangeMin);
+
+  // Columns the view reads, all of them unless zoomed in
+  int first = tables->kernelX.index[0] > 0 ? tables->kernelX.index[0] - 1 : 0;
+  int last = tables->kernelX.index[tables->imageW - 1] + 2 < matrixX ? tables->kernelX.index[tables->imageW - 1] + 2 : matrixX - 1;
+
+  for (int h = firstRow; h < firstRow + rows; h++)
+  {
+    const int32_t *taps[KERNEL_TAPS];
+    for (int k = 0; k < KERNEL_TAPS; k++)
+    {
+      int y = tables->kernelY.index[h] - 1 + k;
+      y = y < 0 ? 0 : y >= matrixY ? matrixY - 1 : y;
+      int slot = y % KERNEL_TAPS;
+      if (cached[slot] != y)
+      {
+        normalizeRow(data + y * matrixX + first, normalized[slot] + first, last - first + 1, tempRangeMin, scale);
+        cached[slot] = y;
+      }
+      taps[k] = normalized[slot];
+    }
+
+    const int16_t *weightY = tables->kernelY.weight[h];
+    for (int w = first; w <= last; w++)
+      row[w + 1] = (taps[0][w] * weightY[0] + taps[1][w] * weightY[1] + taps[2][w] * weightY[2] + taps[3][w] * weightY[3]) >> KERNEL_BITS;
+    row[first] = row[first + 1]; // Edge pixels, or a tap that is never read when zoomed in
+    row[last + 2] = row[last + 1];
+    row[last + 3] = row[last + 1];
+
+    const uint16_t *index = tables->kernelX.index;
+    for (int w = 0; w < tables->imageW; w++)
+    {
+      const int32_t *p = row + index[w]; // The tap before the source pixel, shifted by the left edge pixel
+      const int16_t *weightX = tables->kernelX.weight[w];
+      int32_t value = (p[0] * weightX[0] + p[1] * weightX[1] + p[2] * weightX[2] + p[3] * weightX[3]) >> (KERNEL_BITS - 8); // 16 fractional bits
+      if (value < 0) value = 0;
+      else if (value > 0xFFFFFF) value = 0xFFFFFF;
+      *out++ = palette[value >> 16];
+    }
+  }
+}
+
+// Image rows without interpolation: every source pixel a block of its color, as drawn by fillRect. A row is
+// colored once per source row and copied for the rest of its blocks' height. With grid, the first row and column
+// of every block but the top and left ones are grid lines
+inline void blockRows(const InterpolationTables *tables, const float *data, uint16_t *out, float tempRangeMin, float tempRangeMax, int firstRow, int rows, const uint16_t *palette, bool grid)
+{
+  uint16_t colors[INTERPOLATION_MAX_SOURCE];
+  const uint16_t *index = tables->x.index;
+  int imageW = tables->imageW;
+  const uint16_t *built = NULL; // Last colored row in out
+  int builtY = -1;
+
+  for (int h = firstRow; h < firstRow + rows; h++, out += imageW)
+  {
+    int y = tables->y.index[h];
+    if (grid && h > 0 && y != tables->y.index[h - 1])
+    {
+      for (int w = 0; w < imageW; w++)
+        out[w] = INTERPOLATION_GRID_COLOR;
+      continue;
+    }
+    if (y == builtY)
+    {
+      memcpy(out, built, imageW * sizeof(uint16_t));
+      continue;
+    }
+
+    for (int w = index[0]; w <= index[imageW - 1]; w++)
+      colors[w] = palette[(uint8_t)mapf(data[y * tables->matrixX + w], tempRangeMin, tempRangeMax)];
+    for (int w = 0; w < imageW; w++)
+      out[w] = colors[index[w]];
+    if (grid)
+    {
+      for (int w = 1; w < imageW; w++)
+        if (index[w] != index[w - 1]) out[w] = INTERPOLATION_GRID_COLOR;
+    }
+    built = out;
+    builtY = y;
+  }
+}
+
+// Image rows in the given mode. Kernel modes other than the one prepared in the tables fall back to bilinear
+inline void upscaleRows(const InterpolationTables *tables, InterpolationMode mode, const float *data, uint16_t *out, float tempRangeMin, float tempRangeMax, int firstRow, int rows, const uint16_t *palette)
+{
+  if (mode == INTERPOLATION_BLOCKS || mode == INTERPOLATION_GRID)
+    blockRows(tables, data, out, tempRangeMin, tempRangeMax, firstRow, rows, palette, mode == INTERPOLATION_GRID);
+  else if (mode == tables->kernel && mode != INTERPOLATION_BILINEAR)
+    kernelRows(tables, data, out, tempRangeMin, tempRangeMax, firstRow, rows, palette);
+  else
+    interpolateRows(tables, data, out, tempRangeMin, tempRangeMax, firstRow, rows, palette);
+}
+
+// Linear interpolation in four passes over 0..255 color indexes, kept as the reference for profiling
+inline void interpolateLegacy(float *data, uint16_t *out, int matrixX, int matrixY, int imageW, int imageH, float tempRangeMin, float tempRangeMax) __attribute__((always_inline));
+inline void interpolateLegacy(float *data, uint16_t *out, int matrixX, int matrixY, int imageW, int imageH, float tempRangeMin, float tempRangeMax)
 {
   int scaleX = imageW / matrixX;
   int scaleY = imageH / matrixY;
@@ -46,12 +400,12 @@ inline void interpolate(float *data, uint16_t *out, int matrixX, int matrixY, in
   {
     for (int h = 1; h < (imageH - scaleY); h += scaleY)
     {
-      for (int i = 0; i < (scaleX - 1); i++)
+      for (int i = 0; i < (scaleY - 1); i++)
       {
-        out[(h + i) * imageW + w] = (out[(h - 1) * imageW + w] * ((scaleX - 1) - i) + out[(h + (scaleY - 1)) * imageW + w] * (i + 1)) / scaleX;
+        out[(h + i) * imageW + w] = (out[(h - 1) * imageW + w] * ((scaleY - 1) - i) + out[(h + (scaleY - 1)) * imageW + w] * (i + 1)) / scaleY;
       }
     }
-    for (int i = 0; i < (scaleX - 1); i++)
+    for (int i = 0; i < (scaleY - 1); i++)
     {
       out[((imageH - scaleY + 1) + i) * imageW + w] = out[(imageH - scaleY) * imageW + w];
     }
@@ -71,25 +425,16 @@ inline void filter(const float *in, float *out, int matrixX, int matrixY, bool m
 {
   if (mirroring)
   {
-    for (int i = 0; i < (matrixX * matrixY); i++)
-    {
-      if (filtering)
-        out[i] = (out[i] + in[i]) / 2;
-      else
-        out[i] = in[i];
-    }
+    if (filtering)
+      simdAverage(out, in, matrixX * matrixY);
+    else
+      memcpy(out, in, matrixX * matrixY * sizeof(float));
   }
   else
   {
     for (int i = 0; i < matrixY; i++)
-      for (int j = 0; j < matrixX; j++)
-      {
-        if (filtering)
-          out[matrixX * i + (matrixX - 1) - j] = (out[matrixX * i + (matrixX - 1) - j] + in[matrixX * i + j]) / 2;
-        else
-          out[matrixX * i + (matrixX - 1) - j] = in[matrixX * i + j];
-      }
+      simdAverageReversed(out + matrixX * i, in + matrixX * i, matrixX, filtering);
   }
 }
 
-#endif // INTERPOLAION_H
\ No newline at end of file
+#endif // INTERPOLAION_H
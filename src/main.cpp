@@ -1,6 +1,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <EEPROM.h>
+#include <Preferences.h>
 #include <Adafruit_I2CDevice.h>
 #include <Adafruit_FT6206.h>
 #include <SPI.h>
@@ -11,18 +12,33 @@
 #include <TFT_eSPI.h>
 #include "MLX90640_API.h"
 #include "MLX90640_I2C_Driver.h"
+#include "MLX90640_Simulator.h"
 #include "constants.h"
 #include "interpolation.h"
+#include "simd.h"
+#include "worker.h"
+#include "sensor.h"
+#include "triplebuffer.h"
+#include "recorder.h"
+#include "renderer.h"
 
 // Verbose screen status messages
 #define VERBOSE false
 
+// Serial port profiling output, printed every PROFILING_INTERVAL loops
+#define PROFILING false
+#define PROFILING_INTERVAL 100
+
 // EEPROM settings
 #define EEPROM_SIZE 6 // Allocating by 2 bytes for bootCounter (uint16_t), tempRangeMin and tempRangeMax (int16_t)
 #define EEPROM_BOOT_COUNTER_ADDRESS 0
 #define EEPROM_TEMP_RANGE_MIN_ADDRESS 4
 #define EEPROM_TEMP_RANGE_MAX_ADDRESS 8
 
+// Extracted MLX90640 parameters persisted in NVS, keyed by the sensor's EEPROM header fingerprint
+#define PARAMS_CACHE_NAMESPACE "mlx90640"
+#define PARAMS_CACHE_FORMAT 1 // Bump whenever paramsMLX90640 or its extraction changes
+
 // Touch screen I2C pins and params
 #define TOUCH_SDA_PIN 6
 #define TOUCH_SCL_PIN 5
@@ -34,6 +50,7 @@
 #define SENSOR_SCL_PIN 11
 #define SENSOR_I2C_ADDRESS 0x33
 #define SENSOR_I2C_FREQUENCY_KHZ 1000
+#define SIMULATED_SENSOR false // Serve the sensor's registers from MLX90640_Simulator (synthetic calibration and scene), e.g. to profile without one
 
 // TFT screen
 TFT_eSPI tft = TFT_eSPI();
@@ -65,13 +82,23 @@ Adafruit_FT6206 ts = Adafruit_FT6206();
 #define CHECKBOX_WIDTH 28
 #define CHECKBOX_HEIGHT 28
 
-// Sensor: addresses and parameters
-paramsMLX90640 mlx90640;
+// Sensor: address, calibration and pipeline state
+ThermalSensor sensor;
 #define REFRESH_RATE 0x06 // 0x00: 0.5Hz, 0x01: 1Hz, 0x02: 2Hz, 0x03: 4Hz, 0x04: 8Hz, 0x05: 16Hz, 0x06: 32Hz, 0x07: 64Hz
-#define TA_SHIFT 8 // Ambient temperature (TA) shift
-#define EMMISIVITY 0.95
+#define RESOLUTION 0x03 // 0x00: 16-bit, 0x01: 17-bit, 0x02: 18-bit, 0x03: 19-bit (maximum)
+#define ADAPTIVE_REFRESH_RATE true // Switch refresh rate and resolution at runtime (see ratecontrol.h), starting from the two above
+#define MIN_REFRESH_RATE 0x03 // Still scene
+#define MAX_REFRESH_RATE 0x07 // Moving scene, if the pipeline keeps up
 #define MIN_MEASURABLE_TEMP -40 // According to sensor's spec
 #define MAX_MEASURABLE_TEMP 300
+#define SUBPAGE_STREAMING true // Publish after every subpage (half of the pixels) instead of after both
+#define ACQUISITION_TASK true // Read and calculate frames in their own task, loop() only renders the newest one
+#define ACQUISITION_TASK_CORE 0 // Arduino loop() runs on core 1
+#define DUAL_CORE_CALCULATION true // Split each subpage's temperature calculation across both cores
+#define CALCULATION_WORKER_CORE (ACQUISITION_TASK ? 1 - ACQUISITION_TASK_CORE : 0) // The core not calculating
+#define RAW_RECORDING false // Append every raw subpage to a container on SD (see recorder.h) for offline analysis
+#define RECORDER_SLOTS 128 // PSRAM ring of 1676 byte subpages, rides out 2 s of SD stalls at 64 Hz
+#define RECORDER_CORE ACQUISITION_TASK_CORE // The writer runs at idle priority in the acquisition task's gaps
 
 // Sensor params and settings
 #define MATRIX_X 32 // INPUT_COLS
@@ -80,6 +107,11 @@ paramsMLX90640 mlx90640;
 #define MLX_MIRROR false // Set to true when the camera is facing the screen
 #define SCALE_X (IMAGE_WIDTH / MATRIX_X) // 10
 #define SCALE_Y (IMAGE_HEIGHT / MATRIX_Y) // 10
+#define BAND_RENDERING true // Send the image in bands while the next one is rendered (see renderer.h), no full frame buffers
+#define DISPLAY_TASK_CORE ACQUISITION_TASK_CORE // Sends the bands when the display has no DMA
+#define MAX_ZOOM 8 // Pinch zoom limit: the view spans at least 1 / MAX_ZOOM of the sensor's width
+#define INTERPOLATION_MODE INTERPOLATION_BILINEAR // Upscaler when interpolation is on: INTERPOLATION_BILINEAR, INTERPOLATION_BICUBIC or INTERPOLATION_LANCZOS2
+#define PIXEL_GRID false // Grid lines between the sensor's pixels when interpolation is off
 bool interpolation = true;
 bool filtering = true;
 
@@ -91,11 +123,24 @@ int16_t tempRangeMaxEEPROM = 0;
 int tempRangeChanged = 0; // 0: no change, 11: min--, 12: min++, 13: max--, 14 max++
 
 // Buffers for source and interpolated data & variables for other sensor data
-float frame[MATRIX_SIZE];
 float *frameFiltered = NULL;
 uint16_t *frameInterpolated = NULL;
-float ambientTemperature = tempRangeMin; // Ambient temparature calculated by sensor
-float vddVoltade = 0; // Sensor's VDD (Voltage Drain Drain, plus)
+InterpolationTables interpolationTables; // Bilinear and INTERPOLATION_MODE weights from the sensor's matrix to the image
+BandRenderer renderer;
+DisplayBackend tftBackend; // Blocking or DMA pushes to the panel
+DisplayBackend displayBackend; // What the renderer pushes to
+bool acquisitionTask = false;
+ulong acquiredFrames = 0;
+
+// Temperature calculation handed over to the worker core, on the stack of the sensor's task that waits for it
+struct CalculationJob
+{
+  ThermalSensor *sensor;
+  uint16_t *frameData;
+  float tr;
+  float *result;
+};
+bool dualCoreCalculation = false;
 
 // Touch screen objects and variables
 TFT_eSPI_Button resetBtn; // Invoke the TFT_eSPI buttons classes
@@ -107,6 +152,20 @@ int16_t tempX = IMAGE_WIDTH / 2;
 int16_t tempY = IMAGE_HEIGHT / 2;
 int16_t tempXPrinted = 0;
 int16_t tempYPrinted = 0;
+// Zoomed and panned region of the sensor's matrix shown, in sensor pixels with 8 fractional bits. Replaced as a
+// whole under viewLock by the touch task and copied under it by the render side, which never sees half a pinch
+struct ImageView
+{
+  int32_t x;
+  int32_t y;
+  int32_t w;
+  int32_t h;
+};
+ImageView view = {0, 0, MATRIX_X * 256, MATRIX_Y * 256};
+portMUX_TYPE viewLock = portMUX_INITIALIZER_UNLOCKED;
+float pinchDistance = 0; // Between the two fingers at the previous touch poll, 0: no pinch
+float pinchX = 0; // Their midpoint
+float pinchY = 0;
 bool touchEnabled = false;
 bool sdCardEnabled = false;
 bool webServerEnabled = false;
@@ -149,6 +208,16 @@ bool saveRequested = false;
 bool saveCompleted = false;
 bool saveSuccessful = true;
 String statusTextPrinted = "";
+float maxPrecisionDelta = 0; // Largest single vs double precision To difference seen while profiling
+busStatsMLX90640 frameBusStats; // I2C transactions spent on the last read (one or both subpages)
+ulong busRetries = 0; // I2C retries since boot
+ulong busRecoveries = 0; // I2C bus recoveries since boot
+uint32_t latencySum = 0; // us, data ready to image pushed, summed over latencyFrames
+uint32_t latencyMax = 0; // us
+uint32_t latencyFrames = 0;
+bool paramsFromCache = false; // MLX90640 parameters were restored from NVS instead of extracted
+simulatorMLX90640 *simulator = NULL; // Only allocated with SIMULATED_SENSOR
+ulong sensorInitDuration = 0; // ms
 
 
 // === Declarations of functions =====================================================================
@@ -166,15 +235,37 @@ void initializeButtons();
 void initializeTouch();
 bool isI2cDeviceConnected(TwoWire *wire, uint8_t i2cAddr);
 void initializeThermalSensor();
+void initializeSimulatedSensor();
+void initializeRecorder();
+int extractThermalParams(uint16_t *eeData);
+bool loadThermalParams(uint32_t fingerprint);
+void saveThermalParams(uint32_t fingerprint);
 void rebootThermalSensor();
-bool saveScreenshot(bool thermalImageOnly);
+bool saveScreenshot(bool thermalImageOnly, const uint16_t *image);
 void prepareInterpolation();
-void readTempValues();
-void processTempValues();
+void acquireTempValues();
+void acquireTempValuesTask(void *arg);
+bool readTempValues();
+void calculateTempValues(ThermalSensor *sensor, uint16_t *frameData, float tr, float *result);
+void calculateTempValuesOnWorker(void *arg);
+void profileTempCalculation(uint16_t *frameData, float tr);
+float maxTempDelta(const float *a, const float *b);
+void processTempValues(const float *temp);
+void measureLatency(uint32_t readyMicros);
 void processTouchScreen(void *arg);
 void processButtonPress(TFT_eSPI_Button *btn, bool touched, int tag);
+void processPinch(TS_Point first, TS_Point second);
 void processRequests();
 void drawThermalImage();
+InterpolationMode imageMode();
+void drawMeasurementMarker(BandRenderer *renderer, uint16_t *band, int firstRow, int rows);
+void profileInterpolation();
+void initializeRenderer();
+void displayBegin(void *context);
+void displayPush(void *context, int x, int y, int w, int h, uint16_t *pixels);
+void displayWait(void *context);
+void displayEnd(void *context);
+uint16_t *captureThermalImage();
 void drawLegend(float min, float max, float center, bool numbersOnly, int position);
 void drawInfo();
 
@@ -197,8 +288,10 @@ void setup()
   // Initialize SD card SPI interface
   SPI.begin(SD_CLK, SD_DO, SD_DI, -1);
 
-  // Initialize both I2C buses and increase the clock speed
+  // Initialize both I2C buses and increase the clock speed, the sensor's burst buffer has to be sized first
+  MLX90640_I2CInit();
   Wire.begin(SENSOR_SDA_PIN, SENSOR_SCL_PIN, 400000);
+  MLX90640_I2CSetBusPins(SENSOR_SDA_PIN, SENSOR_SCL_PIN); // Lets the driver clock a stuck bus free instead of rebooting
   Wire1.begin(TOUCH_SDA_PIN, TOUCH_SCL_PIN, TOUCH_I2C_FREQUENCY_KHZ * 1000);
 
   // Initialize the screen
@@ -216,6 +309,15 @@ void setup()
   // Initialize SD card
   initializeSDCard();
 
+  // Start recording raw subpages, before acquisition takes over the sensor's bus
+  if (RAW_RECORDING && sdCardEnabled) initializeRecorder();
+
+  // Start the second core helper for temperature calculation
+  if (DUAL_CORE_CALCULATION) dualCoreCalculation = workerBegin(CALCULATION_WORKER_CORE);
+
+  // Start reading the sensor in the background, loop() falls back to reading in line when it cannot
+  if (ACQUISITION_TASK) acquisitionTask = xTaskCreatePinnedToCore(acquireTempValuesTask, "acquireTempValues", 16384, NULL, 1, NULL, ACQUISITION_TASK_CORE) == pdPASS;
+
   // Initialize WebServer
   if (sdCardEnabled) initializeWebServer();
 
@@ -238,17 +340,38 @@ void setup()
 // Standard Arduino framework's loop function
 void loop()
 {
+  static ulong lastFrameTime = 0;
+
+  if (!acquisitionTask) acquireTempValues();
+
+  // Render only frames not shown yet, they arrive at the sensor's pace. Idle passes do not take, so the
+  // duplicate count stays a count of frames rendered twice
+  if (!tripleBufferFresh(&sensor.frames))
+  {
+    processRequests();
+    delay(1);
+    return;
+  }
+  bool fresh;
+  SensorFrame *thermalFrame = tripleBufferTake(&sensor.frames, &fresh);
+
   loopNumber++;
   ulong startTime = millis();
+  uint32_t startMicros = micros();
 
-  readTempValues();
-  processTempValues();
+  processTempValues(thermalFrame->temp);
   drawThermalImage();
+  measureLatency(thermalFrame->readyMicros);
   if ((loopNumber % 3) == 0) drawInfo();
   processRequests();
+  if (ADAPTIVE_REFRESH_RATE) rateControlRendered(&sensor.rateControl, micros() - startMicros);
 
-  loopDuration = millis() - startTime;
+  loopDuration = startTime - lastFrameTime; // Frame to frame, overlapping with acquisition
+  lastFrameTime = startTime;
   fps = (float)(1000.0 / loopDuration);
+
+  if (loopNumber == 1)
+    Serial.printf("Boot to first frame: %lu ms, sensor init %lu ms, parameters %s\n", millis(), sensorInitDuration, paramsFromCache ? "from cache" : "extracted");
 }
 
 
@@ -295,6 +418,15 @@ void saveTemperatureRangeToEEPROM()
 // Print text out
 void textOut(String text, int32_t x, int32_t y, uint8_t font, uint16_t fgcolor, uint16_t bgcolor)
 {
+  if (BAND_RENDERING)
+  {
+    // No image sprite, straight to the panel
+    tft.fillRect(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, TFT_BLACK);
+    tft.setTextColor(fgcolor, bgcolor);
+    tft.drawString(text, x, y, font);
+    return;
+  }
+
   img.fillSprite(TFT_BLACK);
   img.setTextColor(fgcolor, bgcolor);
   img.drawString(text, x, y, font);
@@ -319,7 +451,12 @@ void initializeScreen()
   inf.setTextSize(2);
   inf.pushSprite(0, IMAGE_HEIGHT);
 
-  // Create image sprite
+  // Create image sprite, not needed when the image is rendered in bands
+  if (BAND_RENDERING)
+  {
+    tft.fillRect(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, TFT_BLACK);
+    return;
+  }
   img.createSprite(IMAGE_WIDTH, IMAGE_HEIGHT);
   img.setSwapBytes(1);
   img.fillSprite(TFT_BLACK);
@@ -580,43 +717,69 @@ bool isI2cDeviceConnected(TwoWire *wire, uint8_t i2cAddr)
 // Initialize MLX90640 thermal sensor making that it is properly reset and initialized
 void initializeThermalSensor()
 {
+  sensorInit(&sensor, SENSOR_I2C_ADDRESS, NULL); // On the shared bus, Wire or the simulator, emissivity and TA shift from sensor.h
+  sensor.adaptiveRate = ADAPTIVE_REFRESH_RATE;
+  sensor.calculate = calculateTempValues;
+
+  if (SIMULATED_SENSOR) initializeSimulatedSensor();
+
   // Check if MLX90640 responds
-  if (!isI2cDeviceConnected(&Wire, SENSOR_I2C_ADDRESS))
+  if (!SIMULATED_SENSOR && !isI2cDeviceConnected(&Wire, sensor.slaveAddr))
   {
     textOut("MLX90640 is not detected at default I2C address, freezing");
     while (1);
   }
 
-  // Get device parameters - We only have to do this once
+  ulong startTime = millis();
+
+  // Read only the EEPROM header and reuse the parameters extracted on a previous boot when it still matches
   int status;
   uint16_t eeMLX90640[MATRIX_SIZE + 64]; // 832
-    
+
   for (int i = 0; i < 15; i++)
   {
-    status = MLX90640_DumpEE(SENSOR_I2C_ADDRESS, eeMLX90640);
+    status = MLX90640_DumpEEHeader(sensor.device, eeMLX90640);
     if (status == 0) break;
     delay(10);
   }
-  if (status == 0)
-  {
-    if (VERBOSE)
-    {
-      textOut("MLX90640 params loaded");
-      delay(250);
-    }
-  }
-  else
-  {
-    textOut("Failed to load MLX90640 params: " + String(status));
-    delay(750);
-  }
+  paramsFromCache = status == 0 && loadThermalParams(MLX90640_GetEEFingerprint(eeMLX90640));
 
-  for (int i = 0; i < 15; i++)
+  if (!paramsFromCache && extractThermalParams(eeMLX90640) == 0)
+    saveThermalParams(MLX90640_GetEEFingerprint(eeMLX90640));
+
+  // Precompute per-pixel coefficients used by every frame calculation, then enable reading out the temperatures
+  // at the starting refresh rate and resolution
+  sensorConfigure(&sensor, REFRESH_RATE, RESOLUTION, MIN_REFRESH_RATE, MAX_REFRESH_RATE, SUBPAGE_STREAMING ? 1 : 2);
+
+  // Once EEPROM has been read at 400kHz, we can increase to 1000kHz
+  MLX90640_I2CFreqSet(SENSOR_I2C_FREQUENCY_KHZ);
+
+  sensorInitDuration = millis() - startTime;
+}
+
+// Route the sensor's traffic to a simulated MLX90640 that measures in real time
+void initializeSimulatedSensor()
+{
+  static transportMLX90640 simulatorTransport;
+  uint16_t eeData[MATRIX_SIZE + 64]; // 832
+
+  simulator = static_cast<simulatorMLX90640 *>(malloc(sizeof(simulatorMLX90640)));
+  if (simulator == NULL)
   {
-    status = MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
-    if (status == 0) break;
-    delay(10);
+    textOut("simulator malloc error, freezing");
+    while (1);
   }
+
+  MLX90640_SimulatorSyntheticEE(eeData);
+  MLX90640_SimulatorInit(simulator, sensor.slaveAddr, eeData, true);
+  MLX90640_SimulatorTransport(simulator, &simulatorTransport);
+  MLX90640_I2CSetTransport(&simulatorTransport);
+}
+
+// Read the whole EEPROM and extract device parameters from it, returns the extraction status
+int extractThermalParams(uint16_t *eeData)
+{
+  int status = sensorReadParameters(&sensor, eeData);
   if (status == 0)
   {
     if (VERBOSE)
@@ -627,30 +790,82 @@ void initializeThermalSensor()
   }
   else
   {
-    textOut("MLX90640 params extraction failed: " + String(status));
+    textOut("Failed to load MLX90640 params: " + String(status));
     delay(750);
   }
 
-  MLX90640_I2CWrite(SENSOR_I2C_ADDRESS, 0x800D, 6401); // Writes the value 1901 (HEX) = 6401 (DEC) in the register at position 0x800D to enable reading out the temperatures
-  
-  // Set MLX90640 device at slave i2cAddress address 0x33, refresh rate and resolution
-  MLX90640_SetRefreshRate(SENSOR_I2C_ADDRESS, REFRESH_RATE);
-  MLX90640_SetResolution(SENSOR_I2C_ADDRESS, 0x03); // 0x03: 19-bit (maximum) resolution
+  return status;
+}
 
-  // Once EEPROM has been read at 400kHz, we can increase to 1000kHz
-  Wire.setClock(SENSOR_I2C_FREQUENCY_KHZ * 1000);
+// Restore parameters extracted on a previous boot, only if they belong to the same sensor and calibration
+bool loadThermalParams(uint32_t fingerprint)
+{
+  Preferences paramsCache;
+  if (!paramsCache.begin(PARAMS_CACHE_NAMESPACE, true)) return false;
+
+  bool loaded = paramsCache.getUInt("format", 0) == PARAMS_CACHE_FORMAT &&
+                paramsCache.getUInt("fingerprint", 0) == fingerprint &&
+                paramsCache.getBytesLength("params") == sizeof(sensor.params) &&
+                paramsCache.getBytes("params", &sensor.params, sizeof(sensor.params)) == sizeof(sensor.params);
+  paramsCache.end();
+
+  if (loaded && VERBOSE)
+  {
+    textOut("MLX90640 params restored");
+    delay(250);
+  }
+  return loaded;
+}
+
+// Persist freshly extracted parameters for the next boot
+void saveThermalParams(uint32_t fingerprint)
+{
+  Preferences paramsCache;
+  if (!paramsCache.begin(PARAMS_CACHE_NAMESPACE, false)) return;
+
+  // Invalidate first so that a power loss mid-write never leaves a matching key over partial params
+  paramsCache.putUInt("fingerprint", 0);
+  paramsCache.putBytes("params", &sensor.params, sizeof(sensor.params));
+  paramsCache.putUInt("format", PARAMS_CACHE_FORMAT);
+  paramsCache.putUInt("fingerprint", fingerprint);
+  paramsCache.end();
 }
 
 // General reset to I2C bus and variables
 void rebootThermalSensor()
 {
   saveTemperatureRangeToEEPROM();
-  MLX90640_I2CGeneralReset(SENSOR_I2C_ADDRESS);
+  recorderEnd(); // Writes out the ring and closes the recording, a no-op when not recording
+  MLX90640_I2CGeneralReset(sensor.device);
   ESP.restart();
 }
 
+// Create the raw recording, named like the screenshots, with the full EEPROM in its header
+void initializeRecorder()
+{
+  uint16_t eeData[MATRIX_SIZE + 64]; // 832
+  int status = sensorReadEE(&sensor, eeData);
+
+  char buffer[5];
+  sprintf(buffer, "%04d", bootCounter);
+  String bootNumber = String(buffer);
+  sprintf(buffer, "%04d", fileCounter + 1);
+  String fileNumber = String(buffer);
+  String fileName = "/" + bootNumber + "_" + fileNumber + "_R.mlx"; // 0001_0002_R.mlx
+
+  if (status == 0 && recorderBegin(fileName.c_str(), eeData, RECORDER_SLOTS, RECORDER_CORE))
+  {
+    fileCounter++;
+  }
+  else
+  {
+    textOut("Failed to start raw recording");
+    delay(750);
+  }
+}
+
 // Saving the screenshot
-bool saveScreenshot(bool thermalImageOnly)
+bool saveScreenshot(bool thermalImageOnly, const uint16_t *image)
 {
   byte vh, vl;
   int width, height;
@@ -718,12 +933,12 @@ bool saveScreenshot(bool thermalImageOnly)
       uint16_t rgb;
       if (thermalImageOnly) // getting color in rgb565 format
       {
-        rgb = frameInterpolated[((h - 1) * width) + w];
+        rgb = image[((h - 1) * width) + w];
       }
       else
       {
         if (h <= IMAGE_HEIGHT)
-          rgb = img.readPixel(w, h - 1);
+          rgb = BAND_RENDERING ? image[((h - 1) * width) + w] : img.readPixel(w, h - 1);
         else
           rgb = inf.readPixel(w, h - 1 - IMAGE_HEIGHT);
       }
@@ -753,8 +968,8 @@ bool saveScreenshot(bool thermalImageOnly)
 // Prepare interpolation arrays and data
 void prepareInterpolation()
 {
-  // Interpolation array init
-  if (interpolation)
+  // Interpolation array init, only the full frame path needs one, with or without interpolation
+  if (!BAND_RENDERING)
   {
     frameInterpolated = static_cast<uint16_t*>(malloc(IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(uint16_t)));
     if (frameInterpolated == NULL)
@@ -768,6 +983,9 @@ void prepareInterpolation()
     for (int i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++)
       *(frameInterpolated + i) = colorMap[0];
   }
+  prepareInterpolationTables(&interpolationTables, MATRIX_X, MATRIX_Y, IMAGE_WIDTH, IMAGE_HEIGHT);
+  prepareInterpolationKernel(&interpolationTables, INTERPOLATION_MODE);
+  if (BAND_RENDERING) initializeRenderer();
 
   // Filtered frame array init
   frameFiltered = static_cast<float *>(malloc(MATRIX_SIZE * sizeof(float)));
@@ -790,55 +1008,195 @@ void prepareInterpolation()
   }
 }
 
-// Read temperature data from MLX90640
-void readTempValues()
+// Read a subpage or a full frame and publish it for the render loop. A frame no read got into is not
+// published again, so the render loop never takes it as fresh
+void acquireTempValues()
+{
+  acquiredFrames++;
+  if (readTempValues()) sensorPublish(&sensor);
+}
+
+// Acquisition and calibration: will be executed as a pinned xTask job, paced by the sensor's data ready
+void acquireTempValuesTask(void *arg)
+{
+  for (;;)
+    acquireTempValues();
+}
+
+// Read temperature data from MLX90640: the next subpage only when streaming, both otherwise.
+// Returns whether at least one subpage made it into the frame
+bool readTempValues()
 {
   lastFrameReadStatus = 1;
-  uint16_t mlx90640Frame[MATRIX_SIZE + 64 + 2]; // 834
+  bool readFailed = false;
+  bool readAny = false;
+  byte subpages = SUBPAGE_STREAMING ? 1 : 2;
+  MLX90640_I2CResetStats();
 
-  for (byte x = 0; x < 2; x++)
+  for (byte x = 0; x < subpages; x++)
   {
-    int status = MLX90640_GetFrameData(SENSOR_I2C_ADDRESS, mlx90640Frame);
+    int status = sensorReadSubpage(&sensor); // Sleeps until shortly before the subpage is due, then reads and calculates it
+    if (status < 0)
+    {
+      // NACK or truncated read: keep the previous temperatures of this subpage
+      readFailed = true;
+      continue;
+    }
+    readAny = true;
     lastFrameReadStatus = lastFrameReadStatus * status;
-   
-    vddVoltade = MLX90640_GetVdd(mlx90640Frame, &mlx90640);
-    ambientTemperature = MLX90640_GetTa(mlx90640Frame, &mlx90640);
+    recorderRecord(sensor.frameData, sensor.acquisition.lastReadyMicros); // Copy only, does nothing unless recording
 
-    float tr = ambientTemperature - TA_SHIFT; // Reflected temperature based on the sensor ambient temperature
-
-    MLX90640_CalculateTo(mlx90640Frame, &mlx90640, EMMISIVITY, tr, frame);
-    MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, frame, MLX90640_GetCurMode(SENSOR_I2C_ADDRESS), &mlx90640);
+    if (PROFILING && (acquiredFrames % PROFILING_INTERVAL) == 0) profileTempCalculation(sensor.frameData, sensor.ambientTemperature - sensor.taShift);
   }
   
-  if (lastFrameReadStatus != 0) errorsCount++;
+  // Two reads in a row must have returned both subpages
+  if (readFailed || (subpages == 2 && lastFrameReadStatus != 0)) errorsCount++;
+  MLX90640_I2CGetStats(&frameBusStats);
+  busRetries += frameBusStats.retries;
+  busRecoveries += frameBusStats.recoveries;
+
+  sensorAdaptRate(&sensor); // Switches refresh rate and resolution here, on the side that owns the sensor's bus
+  return readAny;
 }
 
-// Filter and sort temperature data from MLX90640
-void processTempValues()
+// Calculate subpage temperatures, split in two halves across both cores when the worker is running and not
+// busy with another sensor's subpage
+void calculateTempValues(ThermalSensor *sensor, uint16_t *frameData, float tr, float *result)
 {
-  bool corruptedFrame = false;
+  CalculationJob job = {sensor, frameData, tr, result};
 
-  for (int i = 1; i < MATRIX_SIZE; i++)
+  if (!dualCoreCalculation || !workerRun(calculateTempValuesOnWorker, &job))
   {
-    if (frame[i] < MIN_MEASURABLE_TEMP || frame[i] > MAX_MEASURABLE_TEMP)
-    {
-      corruptedFrame = true;
-      break;
-    }
+    MLX90640_CalculateToCached(frameData, &sensor->params, &sensor->compiled, &sensor->context, sensor->emissivity, tr, result);
+    return;
   }
 
+  MLX90640_CalculateToCachedPart(frameData, &sensor->params, &sensor->compiled, &sensor->context, sensor->emissivity, tr, result, 0, 2);
+
+  // Bad pixel correction reads neighbours from both halves, wait for the worker
+  workerWait();
+}
+
+// Second half of the subpage, executed on the worker core
+void calculateTempValuesOnWorker(void *arg)
+{
+  CalculationJob *job = static_cast<CalculationJob *>(arg);
+  ThermalSensor *sensor = job->sensor;
+  MLX90640_CalculateToCachedPart(job->frameData, &sensor->params, &sensor->compiled, &sensor->context, sensor->emissivity, job->tr, job->result, 1, 2);
+}
+
+// Compare CPU cycles spent on one subpage by the reference, compiled, cached and double precision calculations
+void profileTempCalculation(uint16_t *frameData, float tr)
+{
+  float reference[MATRIX_SIZE];
+  float result[MATRIX_SIZE];
+  float resultDouble[MATRIX_SIZE];
+
+  // Pixels of the other subpage are left untouched, start all from the same frame
+  memcpy(reference, sensor.frame, sizeof(reference));
+  memcpy(result, sensor.frame, sizeof(result));
+  memcpy(resultDouble, sensor.frame, sizeof(resultDouble));
+
+  uint32_t startCycles = ESP.getCycleCount();
+  MLX90640_CalculateTo(frameData, &sensor.params, sensor.emissivity, tr, reference);
+  uint32_t referenceCycles = ESP.getCycleCount() - startCycles;
+
+  startCycles = ESP.getCycleCount();
+  MLX90640_CalculateToCompiled(frameData, &sensor.params, &sensor.compiled, sensor.emissivity, tr, result);
+  uint32_t compiledCycles = ESP.getCycleCount() - startCycles;
+  bool compiledIdentical = memcmp(result, reference, sizeof(result)) == 0; // Plan-driven path must match bit for bit
+
+  startCycles = ESP.getCycleCount();
+  MLX90640_CalculateToCached(frameData, &sensor.params, &sensor.compiled, &sensor.context, sensor.emissivity, tr, result);
+  uint32_t cachedCycles = ESP.getCycleCount() - startCycles;
+
+  startCycles = ESP.getCycleCount();
+  calculateTempValues(&sensor, frameData, tr, result);
+  uint32_t splitCycles = ESP.getCycleCount() - startCycles;
+
+  startCycles = ESP.getCycleCount();
+  MLX90640_CalculateToReference(frameData, &sensor.params, &sensor.compiled, sensor.emissivity, tr, resultDouble);
+  uint32_t doubleCycles = ESP.getCycleCount() - startCycles;
+
+
+  // Accuracy of the drift-tolerant cache against the uncached path, and of single against double precision
+  float cacheDelta = maxTempDelta(result, reference);
+  float precisionDelta = maxTempDelta(result, resultDouble);
+  if (precisionDelta > maxPrecisionDelta) maxPrecisionDelta = precisionDelta;
+
+  // Per-frame bad pixel search against the precompiled correction plan, on copies of the same result
+  memcpy(reference, result, sizeof(reference));
+  startCycles = ESP.getCycleCount();
+  MLX90640_BadPixelsCorrection(sensor.params.brokenPixels, reference, MLX90640_GetCurMode(sensor.device), &sensor.params);
+  uint32_t legacyCorrectionCycles = ESP.getCycleCount() - startCycles;
+
+  memcpy(resultDouble, result, sizeof(resultDouble));
+  startCycles = ESP.getCycleCount();
+  MLX90640_CorrectPixels(frameData, &sensor.compiled, resultDouble);
+  uint32_t correctionCycles = ESP.getCycleCount() - startCycles;
+
+  Serial.printf("CalculateTo cycles per subpage: reference %u, compiled %u (%s), cached %u, %s %u, double %u\n", referenceCycles, compiledCycles, compiledIdentical ? "identical" : "MISMATCH", cachedCycles, dualCoreCalculation ? "dual core" : "single core", splitCycles, doubleCycles);
+  Serial.printf("Coefficient cache: hits %u, rebuilds %u, max delta %.4f C\n", sensor.context.cacheHits, sensor.context.cacheRebuilds, cacheDelta);
+  Serial.printf("Single vs double precision: max delta %.6f C, session max %.6f C\n", precisionDelta, maxPrecisionDelta);
+  float busMbps = frameBusStats.busMicros ? (frameBusStats.bytesRead + frameBusStats.bytesWritten) * 9.0 / frameBusStats.busMicros : 0; // 8 data bits + ACK per byte
+  Serial.printf("I2C per frame: %u reads, %u writes, %u bytes in, %u bytes out, %u us on the bus (%.2f Mbit/s), %u register shadow hits\n", frameBusStats.readTransactions, frameBusStats.writeTransactions, frameBusStats.bytesRead, frameBusStats.bytesWritten, frameBusStats.busMicros, busMbps, frameBusStats.shadowHits);
+  Serial.printf("I2C errors per frame: %u NACK, %u timeout, %u bus, %u short read, %u verify; %lu retries, %lu recoveries since boot\n", frameBusStats.nacks, frameBusStats.timeouts, frameBusStats.busErrors, frameBusStats.shortReads, frameBusStats.verifyFailures, busRetries, busRecoveries);
+  Serial.printf("Acquisition: %u subpages, %.2f polls each, %u late wake ups, slept %u ms, polled %u ms, guard %u us\n", sensor.acquisition.frames, sensor.acquisition.frames ? (float)sensor.acquisition.polls / sensor.acquisition.frames : 0, sensor.acquisition.lateWakeups, sensor.acquisition.sleptMicros / 1000, sensor.acquisition.wastedMicros / 1000, sensor.acquisition.guardMicros);
+  acquisitionResetStats(&sensor.acquisition);
+  Serial.printf("Rate control: refresh 0x%02x (%.1f subpages/s), %d-bit, capacity %.1f subpages/s, motion %.3f, %u switches\n", sensor.rateControl.refreshRate, rateControlSubpageRate(sensor.rateControl.refreshRate), 16 + sensor.rateControl.resolution, sensor.rateControl.capacity, sensor.rateControl.motion, sensor.rateControl.switches);
+  Serial.printf("Frame exchange: %u published, %u dropped, %u rendered, %u duplicate takes\n", sensor.frames.published, sensor.frames.dropped, sensor.frames.taken, sensor.frames.duplicates);
+  Serial.printf("Pixel correction cycles: legacy %u (broken only), plan %u (%u pixels)\n", legacyCorrectionCycles, correctionCycles, sensor.compiled.correction[(frameData[832] & 0x1000) >> 12].count);
+  if (recorderActive())
+  {
+    RecorderStats recorderStats;
+    recorderGetStats(&recorderStats);
+    Serial.printf("Recorder: %u subpages recorded, %u written, %u overruns, %u write errors, ring high water %u/%u, slowest write %u us\n", recorderStats.recorded, recorderStats.written, recorderStats.overruns, recorderStats.writeErrors, recorderStats.maxFill, RECORDER_SLOTS, recorderStats.maxWriteMicros);
+  }
+}
+
+// Largest per-pixel difference between two temperature frames
+float maxTempDelta(const float *a, const float *b)
+{
+  float maxDelta = 0;
+  for (int i = 0; i < MATRIX_SIZE; i++)
+  {
+    float delta = fabs(a[i] - b[i]);
+    if (delta > maxDelta) maxDelta = delta;
+  }
+  return maxDelta;
+}
+
+// Input to photon latency: from the sensor's data ready to the image pushed to the screen
+void measureLatency(uint32_t readyMicros)
+{
+  uint32_t latency = micros() - readyMicros;
+  latencySum += latency;
+  if (latency > latencyMax) latencyMax = latency;
+  latencyFrames++;
+
+  if (latencyFrames == PROFILING_INTERVAL)
+  {
+    if (PROFILING) Serial.printf("Input to photon latency over %u frames (%s): avg %u us, max %u us\n", latencyFrames, SUBPAGE_STREAMING ? "per subpage" : "per frame", latencySum / latencyFrames, latencyMax);
+    latencySum = 0;
+    latencyMax = 0;
+    latencyFrames = 0;
+  }
+}
+
+// Filter and sort temperature data from MLX90640
+void processTempValues(const float *temp)
+{
+  float frameMin, frameMax;
+
+  simdMinMax(temp + 1, MATRIX_SIZE - 1, &frameMin, &frameMax);
+  bool corruptedFrame = frameMin < MIN_MEASURABLE_TEMP || frameMax > MAX_MEASURABLE_TEMP;
+
   // Filter temperature data
   if (!corruptedFrame)
-    filter(frame, frameFiltered, MATRIX_X, MATRIX_Y, MLX_MIRROR, filtering);
+    filter(temp, frameFiltered, MATRIX_X, MATRIX_Y, MLX_MIRROR, filtering);
 
   // Find max and max temperature data
-  minTemp = frameFiltered[0];
-  maxTemp = frameFiltered[0];
-  for (int i = 1; i < MATRIX_SIZE; i++)
-  {
-    if (frameFiltered[i] < minTemp) minTemp = frameFiltered[i];
-    if (frameFiltered[i] > maxTemp) maxTemp = frameFiltered[i];
-  }
+  simdMinMax(frameFiltered, MATRIX_SIZE, &minTemp, &maxTemp);
   if (minTemp < minMinTemp) minMinTemp = minTemp;
   if (maxTemp > maxMaxTemp) maxMaxTemp = maxTemp;
 }
@@ -851,14 +1209,25 @@ void processTouchScreen(void *arg)
     if (touchEnabled)
     {
       bool touched = false;
+      uint8_t touches = ts.touched();
 
-      if (ts.touched())
+      // Two fingers on the thermal image zoom and pan it
+      if (touches == 2)
+      {
+        TS_Point first = ts.getPoint(0);
+        TS_Point second = ts.getPoint(1);
+        if (first.y < IMAGE_HEIGHT && second.y < IMAGE_HEIGHT) processPinch(first, second);
+      }
+      else
+        pinchDistance = 0;
+
+      if (touches == 1)
       {
         touched = true;
         touch = ts.getPoint(); // Retrieve a point
 
         // Is touch point in the thermal image area?
-        if (touch.x <= IMAGE_WIDTH && touch.y <= IMAGE_HEIGHT)
+        if (touch.x < IMAGE_WIDTH && touch.y < IMAGE_HEIGHT)
         {
           tempX = touch.x; // temparature measurment point
           tempY = touch.y;
@@ -920,6 +1289,35 @@ void processTouchScreen(void *arg)
   }
 }
 
+// Pinch to zoom, move both fingers to pan: the sensor point under their midpoint follows it. The view is
+// picked up by drawThermalImage
+void processPinch(TS_Point first, TS_Point second)
+{
+  float distance = sqrtf((float)(first.x - second.x) * (first.x - second.x) + (float)(first.y - second.y) * (first.y - second.y));
+  float x = (first.x + second.x) / 2.0;
+  float y = (first.y + second.y) / 2.0;
+
+  if (pinchDistance > 0 && distance > 0)
+  {
+    ImageView current = view; // Only this task writes it
+    ImageView next;
+    float sourceX = current.x + pinchX * current.w / IMAGE_WIDTH; // Under the previous midpoint
+    float sourceY = current.y + pinchY * current.h / IMAGE_HEIGHT;
+    next.w = constrain(current.w * pinchDistance / distance, MATRIX_X * 256 / MAX_ZOOM, MATRIX_X * 256);
+    next.h = next.w * MATRIX_Y / MATRIX_X;
+    next.x = constrain((int32_t)(sourceX - x * next.w / IMAGE_WIDTH), 0, MATRIX_X * 256 - next.w);
+    next.y = constrain((int32_t)(sourceY - y * next.h / IMAGE_HEIGHT), 0, MATRIX_Y * 256 - next.h);
+
+    portENTER_CRITICAL(&viewLock);
+    view = next;
+    portEXIT_CRITICAL(&viewLock);
+  }
+
+  pinchDistance = distance;
+  pinchX = x;
+  pinchY = y;
+}
+
 // Process buttons press
 void processButtonPress(TFT_eSPI_Button *btn, bool touched, int tag)
 {
@@ -992,8 +1390,11 @@ void processRequests()
     saveTemperatureRangeToEEPROM();
     inf.pushSprite(0, IMAGE_HEIGHT);
     saveCompleted = false;
-    saveSuccessful = saveScreenshot(true);
-    saveSuccessful = saveSuccessful && saveScreenshot(false);
+    uint16_t *image = captureThermalImage();
+    saveSuccessful = image != NULL && saveScreenshot(true, image);
+    if (BAND_RENDERING && image != NULL) rendererDrawMarker(image, IMAGE_WIDTH, 0, IMAGE_HEIGHT, tempX, tempY, false); // As on the screen
+    saveSuccessful = saveSuccessful && saveScreenshot(false, image);
+    if (image != frameInterpolated) free(image);
     saveRequested = false;
     saveCompleted = true;
   }
@@ -1002,14 +1403,69 @@ void processRequests()
 // Draw interpolated infrared image
 void drawThermalImage()
 {
-  if (interpolation)
+  portENTER_CRITICAL(&viewLock);
+  ImageView shown = view;
+  portEXIT_CRITICAL(&viewLock);
+  setInterpolationView(&interpolationTables, shown.x, shown.y, shown.w, shown.h); // Rebuilt only after a pinch
+
+  if (BAND_RENDERING)
   {
-    interpolate(frameFiltered, frameInterpolated, MATRIX_X, MATRIX_Y, IMAGE_WIDTH, IMAGE_HEIGHT, tempRangeMin, tempRangeMax);
-    //interpolate(float *data, uint16_t *out, int matrixX, int matrixY, int imageW, int imageH, float tempRangeMin, float tempRangeMax)
-    img.pushImage(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, frameInterpolated);
+    rendererDraw(&renderer, frameFiltered, tempRangeMin, tempRangeMax, imageMode());
+    if (PROFILING && (loopNumber % PROFILING_INTERVAL) == 0) profileInterpolation();
+    return;
+  }
+
+  // Interpolated or in blocks, the image goes to the sprite in one piece
+  if (PROFILING && (loopNumber % PROFILING_INTERVAL) == 0) profileInterpolation();
+  upscaleRows(&interpolationTables, imageMode(), frameFiltered, frameInterpolated, tempRangeMin, tempRangeMax, 0, IMAGE_HEIGHT, colorMap);
+  img.pushImage(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, frameInterpolated);
+
+  // Mark temperature measurment point
+  img.drawCircle(tempX, tempY, 8, TFT_BLACK);
+  img.drawCircle(tempX, tempY, 7, TFT_WHITE);
+  img.drawCircle(tempX, tempY, 6, TFT_BLACK);
+  img.drawCircle(tempX, tempY, 5, TFT_WHITE);
+  img.fillCircle(tempX, tempY, 2, TFT_BLACK);
+
+  img.pushSprite(0, 0);
+}
+
+// Upscaler for the interpolation checkbox
+InterpolationMode imageMode()
+{
+  if (interpolation) return INTERPOLATION_MODE;
+  return PIXEL_GRID ? INTERPOLATION_GRID : INTERPOLATION_BLOCKS;
+}
+
+// Measurement point marker, composited into every band it touches
+void drawMeasurementMarker(BandRenderer *renderer, uint16_t *band, int firstRow, int rows)
+{
+  rendererDrawMarker(band, IMAGE_WIDTH, firstRow, rows, tempX, tempY, renderer->swapBytes);
+}
+
+// Compare CPU cycles spent on one image by the legacy four pass and the single pass interpolation, or report the
+// band renderer's time split when there is no full frame buffer to interpolate into. Then the frame time of every
+// upscaler, to pick the sharpest INTERPOLATION_MODE that fits the frame budget
+void profileInterpolation()
+{
+  if (BAND_RENDERING)
+  {
+    uint32_t frames = renderer.frames ? renderer.frames : 1;
+    Serial.printf("Band rendering over %u frames: %u us per frame, %u us rendering, %u us waiting on the display; %u bytes of bands instead of %u of frame buffers\n", renderer.frames, renderer.frameMicros / frames, renderer.renderMicros / frames, renderer.waitMicros / frames, 2 * rendererBandBytes(&renderer), 2 * IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(uint16_t));
+    rendererResetStats(&renderer);
   }
   else
   {
+    uint32_t startCycles = ESP.getCycleCount();
+    interpolateLegacy(frameFiltered, frameInterpolated, MATRIX_X, MATRIX_Y, IMAGE_WIDTH, IMAGE_HEIGHT, tempRangeMin, tempRangeMax);
+    uint32_t legacyCycles = ESP.getCycleCount() - startCycles;
+
+    startCycles = ESP.getCycleCount();
+    interpolate(&interpolationTables, frameFiltered, frameInterpolated, tempRangeMin, tempRangeMax);
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+
+    // Blocks as they used to be drawn, a fillRect per sensor pixel. The sprite is redrawn after profiling
+    startCycles = ESP.getCycleCount();
     for (uint8_t h = 0; h < MATRIX_Y; h++)
     {
       for (uint8_t w = 0; w < MATRIX_X; w++)
@@ -1018,16 +1474,98 @@ void drawThermalImage()
         img.fillRect(SCALE_X * w, SCALE_Y * h, SCALE_X, SCALE_Y, colorMap[colorIndex]);
       }
     }
+    uint32_t fillRectCycles = ESP.getCycleCount() - startCycles;
+
+    startCycles = ESP.getCycleCount();
+    blockRows(&interpolationTables, frameFiltered, frameInterpolated, tempRangeMin, tempRangeMax, 0, IMAGE_HEIGHT, colorMap, false);
+    img.pushImage(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, frameInterpolated);
+    uint32_t blockCycles = ESP.getCycleCount() - startCycles;
+
+    Serial.printf("Interpolation cycles per image: legacy %u, single pass %u; blocks by fillRect %u, by rows %u\n", legacyCycles, cycles, fillRectCycles, blockCycles);
   }
 
-  // Mark temperature measurment point
-  img.drawCircle(tempX, tempY, 8, TFT_BLACK);
-  img.drawCircle(tempX, tempY, 7, TFT_WHITE);
-  img.drawCircle(tempX, tempY, 6, TFT_BLACK);
-  img.drawCircle(tempX, tempY, 5, TFT_WHITE);
-  img.fillCircle(tempX, tempY, 2, TFT_BLACK);
+  const InterpolationMode modes[] = {INTERPOLATION_BLOCKS, INTERPOLATION_GRID, INTERPOLATION_BILINEAR, INTERPOLATION_BICUBIC, INTERPOLATION_LANCZOS2};
+  uint32_t frameMicros[5];
+  for (int i = 0; i < 5; i++)
+  {
+    prepareInterpolationKernel(&interpolationTables, modes[i]); // Outside the timing, done once at startup
+    if (BAND_RENDERING)
+    {
+      frameMicros[i] = rendererRenderMicros(&renderer, frameFiltered, tempRangeMin, tempRangeMax, modes[i]);
+      continue;
+    }
+    uint32_t start = micros();
+    upscaleRows(&interpolationTables, modes[i], frameFiltered, frameInterpolated, tempRangeMin, tempRangeMax, 0, IMAGE_HEIGHT, colorMap);
+    frameMicros[i] = micros() - start;
+  }
+  prepareInterpolationKernel(&interpolationTables, INTERPOLATION_MODE);
 
-  img.pushSprite(0, 0);
+  Serial.printf("Upscaling us per frame: blocks %u, grid %u, bilinear %u, bicubic %u, lanczos2 %u\n", frameMicros[0], frameMicros[1], frameMicros[2], frameMicros[3], frameMicros[4]);
+}
+
+// Band renderer on the panel: by DMA where TFT_eSPI supports it, otherwise pushed by a task on the other core
+void initializeRenderer()
+{
+  tftBackend.context = NULL;
+  tftBackend.begin = displayBegin;
+  tftBackend.push = displayPush;
+  tftBackend.wait = displayWait;
+  tftBackend.end = displayEnd;
+
+#if defined(ESP32_DMA)
+  bool started = tft.initDMA();
+  displayBackend = tftBackend;
+#else
+  bool started = rendererDisplayTask(&tftBackend, DISPLAY_TASK_CORE, &displayBackend);
+#endif
+
+  if (!started || !rendererBegin(&renderer, &displayBackend, &interpolationTables, 0, 0, RENDERER_BAND_ROWS, true))
+  {
+    textOut("renderer init error, freezing");
+    while (1);
+  }
+  renderer.overlay = drawMeasurementMarker;
+}
+
+// Display backend on TFT_eSPI: bands arrive in the panel's byte order, sent as they are
+void displayBegin(void *context)
+{
+#if defined(ESP32_DMA)
+  tft.startWrite();
+#endif
+}
+
+void displayPush(void *context, int x, int y, int w, int h, uint16_t *pixels)
+{
+#if defined(ESP32_DMA)
+  tft.pushImageDMA(x, y, w, h, pixels);
+#else
+  tft.pushImage(x, y, w, h, pixels);
+#endif
+}
+
+void displayWait(void *context)
+{
+#if defined(ESP32_DMA)
+  tft.dmaWait();
+#endif
+}
+
+void displayEnd(void *context)
+{
+#if defined(ESP32_DMA)
+  tft.endWrite();
+#endif
+}
+
+// The thermal image without the marker for a screenshot, in a temporary buffer when rendering in bands
+uint16_t *captureThermalImage()
+{
+  if (!BAND_RENDERING) return frameInterpolated;
+
+  uint16_t *image = static_cast<uint16_t *>(malloc(IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(uint16_t)));
+  if (image != NULL) rendererRenderImage(&renderer, frameFiltered, tempRangeMin, tempRangeMax, imageMode(), image);
+  return image;
 }
 
 // Draw a legend
@@ -1128,7 +1666,7 @@ void drawLegend(float min, float max, float center, bool numbersOnly, int positi
 void drawInfo()
 {
   // Draw min/max and center temperatures on legend
-  float centerTemp = frameFiltered[tempY / SCALE_Y * MATRIX_X + tempX / SCALE_X];
+  float centerTemp = frameFiltered[interpolationTables.y.index[tempY] * MATRIX_X + interpolationTables.x.index[tempX]]; // Sensor pixel shown there
   if (tempRangeChanged == 0)
   {
     drawLegend(minTemp, maxTemp, centerTemp, true, 1);
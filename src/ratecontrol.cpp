@@ -0,0 +1,168 @@
+#include "ratecontrol.h"
+
+#include <math.h>
+#include <string.h>
+
+#define WINDOW_MICROS 1000000
+#define DWELL_MICROS 3000000 // The display needs a few frames to settle, the filter even more
+#define NOISE_AT_1HZ 0.1 // Datasheet NETD at 1 Hz
+#define MOTION_SIGMAS 4 // A pixel moved when it changed by this many standard deviations of two noisy readings
+#define MOTION_FAST 0.02 // Fraction of moved pixels that asks for a faster rate, about 8 pixels per subpage
+#define MOTION_STILL 0.004 // One rate step changes the fraction by up to 3x (frame period and noise), less than this band
+#define FASTER_VOTES 2 // Consecutive windows before stepping up
+#define SLOWER_VOTES 3 // Consecutive still windows before stepping down, a pause in motion is not a still scene
+#define CAPACITY_CLIMB 0.75 // Step up only to rates the pipeline handles with this much of its capacity
+#define CAPACITY_KEEP 0.9 // Step down at once when the current rate needs more than this
+#define MIN_RESOLUTION 0x00 // 16 bit
+#define WORD_HEADROOM 16384 // Step the resolution up only when the peak word leaves room for doubling
+
+// Subpages per second at a refresh rate code, 0x00: 0.5 ... 0x07: 64
+float rateControlSubpageRate(uint8_t refreshRate)
+{
+  return 0.5f * (1 << (refreshRate & 0x07));
+}
+
+static void resetWindow(RateControl *rc, uint32_t nowMicros)
+{
+  rc->windowStartMicros = nowMicros;
+  rc->subpages = 0;
+  rc->acquisitionBusyMicros = 0;
+  rc->movedPixels = 0;
+  rc->measuredPixels = 0;
+  rc->clippedWords = 0;
+  rc->peakWord = 0;
+  rc->windowRenderedFrames = rc->renderedFrames.load(std::memory_order_relaxed);
+  rc->windowRenderBusyMicros = rc->renderBusyMicros.load(std::memory_order_relaxed);
+}
+
+// Start from the setting the sensor was configured with
+void rateControlBegin(RateControl *rc, uint8_t refreshRate, uint8_t resolution, uint8_t minRefreshRate, uint8_t maxRefreshRate, uint8_t subpagesPerRender, uint32_t nowMicros)
+{
+  rc->minRefreshRate = minRefreshRate;
+  rc->maxRefreshRate = maxRefreshRate;
+  rc->maxResolution = resolution;
+  rc->subpagesPerRender = subpagesPerRender;
+  rc->windowMicros = WINDOW_MICROS;
+  rc->dwellMicros = DWELL_MICROS;
+  rc->noiseAt1Hz = NOISE_AT_1HZ;
+  rc->refreshRate = refreshRate;
+  rc->resolution = resolution;
+  rc->lastSwitchMicros = nowMicros;
+  rc->settleSubpages = 2;
+  rc->renderedFrames.store(0);
+  rc->renderBusyMicros.store(0);
+  rc->capacity = 0;
+  rc->motion = 0;
+  rc->fasterVotes = 0;
+  rc->slowerVotes = 0;
+  rc->switches = 0;
+  resetWindow(rc, nowMicros);
+}
+
+// Acquisition side, after every calculated subpage: temp is the whole frame, the pixels of the other subpage
+// unchanged since the previous call. busyMicros is the time spent reading and calculating it
+void rateControlSubpage(RateControl *rc, const uint16_t *frameData, const float *temp, uint32_t busyMicros)
+{
+  rc->subpages++;
+  rc->acquisitionBusyMicros += busyMicros;
+
+  for (int i = 0; i < 768; i++)
+  {
+    int32_t word = (int16_t)frameData[i];
+    if (word == INT16_MAX || word == INT16_MIN) rc->clippedWords++;
+    if (word < 0) word = -word;
+    if (word > rc->peakWord) rc->peakWord = word;
+  }
+
+  if (rc->settleSubpages > 0)
+  {
+    rc->settleSubpages--;
+    memcpy(rc->previous, temp, sizeof(rc->previous));
+    return;
+  }
+
+  // Only the pixels of this subpage changed since the previous call
+  float threshold = MOTION_SIGMAS * M_SQRT2 * rc->noiseAt1Hz * sqrtf(rateControlSubpageRate(rc->refreshRate));
+  for (int i = 0; i < 768; i++)
+  {
+    if (fabsf(temp[i] - rc->previous[i]) > threshold) rc->movedPixels++;
+    rc->previous[i] = temp[i];
+  }
+  rc->measuredPixels += 384;
+}
+
+// Render side, after every frame drawn: busyMicros is the time spent on it
+void rateControlRendered(RateControl *rc, uint32_t busyMicros)
+{
+  rc->renderedFrames.fetch_add(1, std::memory_order_relaxed);
+  rc->renderBusyMicros.fetch_add(busyMicros, std::memory_order_relaxed);
+}
+
+// Evaluate a finished window. Returns true with the new setting when the sensor should switch, which the caller
+// confirms with rateControlSwitched once the registers are written
+bool rateControlUpdate(RateControl *rc, uint32_t nowMicros, uint8_t *refreshRate, uint8_t *resolution)
+{
+  if (nowMicros - rc->windowStartMicros < rc->windowMicros) return false;
+
+  // Capacity of both sides from their busy time, independent of the rate they ran at
+  float acquisitionCapacity = rc->acquisitionBusyMicros ? rc->subpages * 1e6f / rc->acquisitionBusyMicros : INFINITY;
+  uint32_t rendered = rc->renderedFrames.load(std::memory_order_relaxed) - rc->windowRenderedFrames;
+  uint32_t renderBusy = rc->renderBusyMicros.load(std::memory_order_relaxed) - rc->windowRenderBusyMicros;
+  float renderCapacity = renderBusy ? rendered * rc->subpagesPerRender * 1e6f / renderBusy : INFINITY;
+  rc->capacity = acquisitionCapacity < renderCapacity ? acquisitionCapacity : renderCapacity;
+  rc->motion = rc->measuredPixels ? (float)rc->movedPixels / rc->measuredPixels : 0;
+  uint32_t clippedWords = rc->clippedWords;
+  int32_t peakWord = rc->peakWord;
+  bool measured = rc->subpages > 0;
+  resetWindow(rc, nowMicros);
+
+  if (!measured) return false;
+
+  if (rc->motion >= MOTION_FAST)
+  {
+    rc->slowerVotes = 0;
+    if (rc->fasterVotes < FASTER_VOTES) rc->fasterVotes++;
+  }
+  else if (rc->motion <= MOTION_STILL)
+  {
+    rc->fasterVotes = 0;
+    if (rc->slowerVotes < SLOWER_VOTES) rc->slowerVotes++;
+  }
+  else
+  {
+    rc->fasterVotes = 0;
+    rc->slowerVotes = 0;
+  }
+
+  if (nowMicros - rc->lastSwitchMicros < rc->dwellMicros) return false;
+
+  // One step at a time towards the scene's needs, then as far down as the pipeline requires
+  uint8_t rate = rc->refreshRate;
+  if (rc->fasterVotes >= FASTER_VOTES && rate < rc->maxRefreshRate && rateControlSubpageRate(rate + 1) <= rc->capacity * CAPACITY_CLIMB) rate++;
+  else if (rc->slowerVotes >= SLOWER_VOTES && rate > rc->minRefreshRate) rate--;
+  while (rate > rc->minRefreshRate && rateControlSubpageRate(rate) > rc->capacity * CAPACITY_KEEP)
+    rate--;
+
+  // Clipped words are wrong temperatures, otherwise the finest resolution has the least quantization noise
+  uint8_t res = rc->resolution;
+  if (clippedWords > 0 && res > MIN_RESOLUTION) res--;
+  else if (clippedWords == 0 && peakWord < WORD_HEADROOM && res < rc->maxResolution) res++;
+
+  if (rate == rc->refreshRate && res == rc->resolution) return false;
+  *refreshRate = rate;
+  *resolution = res;
+  return true;
+}
+
+// The sensor runs at the new setting: restart the measurements and the dwell time
+void rateControlSwitched(RateControl *rc, uint8_t refreshRate, uint8_t resolution, uint32_t nowMicros)
+{
+  rc->refreshRate = refreshRate;
+  rc->resolution = resolution;
+  rc->lastSwitchMicros = nowMicros;
+  rc->settleSubpages = 2;
+  rc->fasterVotes = 0;
+  rc->slowerVotes = 0;
+  rc->switches++;
+  resetWindow(rc, nowMicros);
+}
@@ -0,0 +1,58 @@
+// Adaptive refresh rate and ADC resolution: the sensor runs at the fastest rate the pipeline can consume while
+// the scene moves and falls back to slower, less noisy rates while it is still. The resolution is the highest one
+// whose raw pixel words do not clip. Measured over windows, switches are held for a dwell time
+#ifndef RATECONTROL_H
+#define RATECONTROL_H
+
+#include <atomic>
+#include <stdint.h>
+
+struct RateControl
+{
+  // Settings
+  uint8_t minRefreshRate; // Rate for a still scene
+  uint8_t maxRefreshRate;
+  uint8_t maxResolution;
+  uint8_t subpagesPerRender; // 1 when streaming subpages, 2 when rendering whole frames
+  uint32_t windowMicros;
+  uint32_t dwellMicros; // Minimum time between two switches
+  float noiseAt1Hz; // C RMS per pixel at refresh rate 0x01, grows with the square root of the rate
+
+  // Current sensor setting
+  uint8_t refreshRate;
+  uint8_t resolution;
+  uint32_t lastSwitchMicros;
+
+  // Window being measured, acquisition side
+  uint32_t windowStartMicros;
+  uint32_t subpages;
+  uint32_t acquisitionBusyMicros; // Reading and calculating, without the waits for data ready
+  uint32_t movedPixels; // Pixels that changed by more than the noise between their last two measurements
+  uint32_t measuredPixels;
+  uint32_t clippedWords; // Raw pixel words at the ADC's limits
+  int32_t peakWord; // Largest raw pixel word magnitude
+  uint8_t settleSubpages; // Motion is not measured until both subpages were taken at the current setting
+  float previous[768];
+
+  // Render side, counted from the render task by rateControlRendered
+  std::atomic<uint32_t> renderedFrames;
+  std::atomic<uint32_t> renderBusyMicros;
+  uint32_t windowRenderedFrames;
+  uint32_t windowRenderBusyMicros;
+
+  // Last evaluation
+  float capacity; // Subpages per second that the slower of acquisition and rendering can take
+  float motion; // Fraction of measured pixels that moved
+  uint8_t fasterVotes; // Consecutive windows asking for a faster rate
+  uint8_t slowerVotes; // Consecutive windows asking for a slower rate
+  uint32_t switches;
+};
+
+void rateControlBegin(RateControl *rc, uint8_t refreshRate, uint8_t resolution, uint8_t minRefreshRate, uint8_t maxRefreshRate, uint8_t subpagesPerRender, uint32_t nowMicros);
+void rateControlSubpage(RateControl *rc, const uint16_t *frameData, const float *temp, uint32_t busyMicros);
+void rateControlRendered(RateControl *rc, uint32_t busyMicros);
+bool rateControlUpdate(RateControl *rc, uint32_t nowMicros, uint8_t *refreshRate, uint8_t *resolution);
+void rateControlSwitched(RateControl *rc, uint8_t refreshRate, uint8_t resolution, uint32_t nowMicros);
+float rateControlSubpageRate(uint8_t refreshRate);
+
+#endif // RATECONTROL_H
@@ -0,0 +1,389 @@
+#include "recorder.h"
+
+#include <atomic>
+#include <string.h>
+
+#define RECORDER_BATCH 8 // Subpages per SD write, about 13 kB
+#define RECORDER_FLUSH_MICROS 1000000 // Commit the file at least this often, bounds the loss on power off
+
+static_assert(sizeof(RecordingFrame) == 8 + RECORDING_FRAME_WORDS * 2, "RecordingFrame must not be padded");
+
+static RecordingFrame *ring = NULL;
+static uint32_t ringSlots = 0;
+static std::atomic<uint32_t> ringHead(0); // Subpages recorded, advanced by the acquisition side only
+static std::atomic<uint32_t> ringTail(0); // Subpages written, advanced by the writer only
+static std::atomic<bool> stopRequested(false);
+static std::atomic<bool> active(false);
+static std::atomic<uint32_t> producers(0); // Inside recorderRecord, recorderEnd waits for them to leave
+static std::atomic<bool> failed(false); // The file could not be put back in order after a write error
+static uint32_t fileBytes = 0; // End of the last whole record in the file, owned by the writer
+static uint16_t pendingDropped = 0;
+
+// RecorderStats, each counter written by one side only and read by recorderGetStats from any task
+static std::atomic<uint32_t> recorded(0); // Acquisition side
+static std::atomic<uint32_t> overruns(0);
+static std::atomic<uint32_t> maxFill(0);
+static std::atomic<uint32_t> written(0); // Writer side
+static std::atomic<uint32_t> writeErrors(0);
+static std::atomic<uint32_t> maxWriteMicros(0);
+
+static void writerLoop();
+static bool recordSubpage(const uint16_t *frameData, uint32_t readyMicros);
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+#include <SD.h>
+
+static File recording;
+static TaskHandle_t writerTask = NULL;
+static SemaphoreHandle_t writerStopped = NULL;
+
+static uint32_t nowMicros()
+{
+  return micros();
+}
+
+static bool openRecording(const char *path)
+{
+  recording = SD.open(path, FILE_WRITE);
+  return (bool)recording;
+}
+
+static bool writeRecording(const void *data, size_t bytes)
+{
+  return recording.write(static_cast<const uint8_t *>(data), bytes) == bytes;
+}
+
+static bool seekRecording(uint32_t offset)
+{
+  return recording.seek(offset);
+}
+
+static void flushRecording()
+{
+  recording.flush();
+}
+
+static void closeRecording()
+{
+  recording.close();
+}
+
+// The ring lives in PSRAM, internal RAM is kept for the frame buffers
+static void *allocateRing(size_t bytes)
+{
+  return ps_malloc(bytes);
+}
+
+static void wakeWriter()
+{
+  xTaskNotifyGive(writerTask);
+}
+
+static void waitForWork(uint32_t timeoutMicros)
+{
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMicros / 1000) + 1);
+}
+
+// A tick, so that a producer of any priority gets to finish
+static void pauseBriefly()
+{
+  vTaskDelay(1);
+}
+
+static void writerTaskMain(void *arg)
+{
+  writerLoop();
+  xSemaphoreGive(writerStopped);
+  vTaskDelete(NULL);
+}
+
+// Idle priority: the writer only gets what acquisition, rendering and WiFi leave over
+static bool startWriter(int core)
+{
+  if (writerStopped == NULL) writerStopped = xSemaphoreCreateBinary();
+  if (writerStopped == NULL) return false;
+
+  return xTaskCreatePinnedToCore(writerTaskMain, "recorder", 4096, NULL, tskIDLE_PRIORITY, &writerTask, core) == pdPASS;
+}
+
+static void stopWriter()
+{
+  xTaskNotifyGive(writerTask);
+  xSemaphoreTake(writerStopped, portMAX_DELAY);
+  writerTask = NULL;
+}
+
+#else // Host build: the same recorder on stdio and std::thread for tests and benchmarks
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+static FILE *recording = NULL;
+static std::thread writerThread;
+
+// Never destroyed, like the worker's: a writer may still wait on them when the process exits
+static std::mutex &writerMutex = *new std::mutex;
+static std::condition_variable &writerSignal = *new std::condition_variable;
+static bool workPending = false;
+
+static uint32_t nowMicros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool openRecording(const char *path)
+{
+  recording = fopen(path, "wb");
+  return recording != NULL;
+}
+
+static bool writeRecording(const void *data, size_t bytes)
+{
+  return fwrite(data, 1, bytes, recording) == bytes;
+}
+
+static bool seekRecording(uint32_t offset)
+{
+  clearerr(recording);
+  return fseek(recording, offset, SEEK_SET) == 0;
+}
+
+static void flushRecording()
+{
+  fflush(recording);
+}
+
+static void closeRecording()
+{
+  fclose(recording);
+  recording = NULL;
+}
+
+static void *allocateRing(size_t bytes)
+{
+  return malloc(bytes);
+}
+
+static void wakeWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    workPending = true;
+  }
+  writerSignal.notify_one();
+}
+
+static void waitForWork(uint32_t timeoutMicros)
+{
+  std::unique_lock<std::mutex> lock(writerMutex);
+  writerSignal.wait_for(lock, std::chrono::microseconds(timeoutMicros), [] { return workPending; });
+  workPending = false;
+}
+
+static void pauseBriefly()
+{
+  std::this_thread::yield();
+}
+
+static bool startWriter(int core)
+{
+  (void)core;
+  writerThread = std::thread(writerLoop);
+  return true;
+}
+
+static void stopWriter()
+{
+  wakeWriter();
+  writerThread.join();
+}
+
+#endif
+
+// Write up to RECORDER_BATCH subpages that sit contiguously in the ring, then hand their slots back. A failed or
+// short write loses the batch: the file goes back to the end of the last whole record so that the next batch
+// lines up, and the recording stops when even that fails
+static void writeBatch(uint32_t pending)
+{
+  uint32_t tail = ringTail.load(std::memory_order_relaxed);
+  uint32_t first = tail % ringSlots;
+  uint32_t count = pending;
+  if (count > RECORDER_BATCH) count = RECORDER_BATCH;
+  if (count > ringSlots - first) count = ringSlots - first;
+
+  uint32_t startMicros = nowMicros();
+  if (!failed.load(std::memory_order_relaxed))
+  {
+    if (writeRecording(&ring[first], count * sizeof(RecordingFrame)))
+    {
+      fileBytes += count * sizeof(RecordingFrame);
+      written.store(written.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+    else
+    {
+      writeErrors.store(writeErrors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      if (!seekRecording(fileBytes)) failed.store(true, std::memory_order_relaxed);
+    }
+  }
+  uint32_t writeMicros = nowMicros() - startMicros;
+  if (writeMicros > maxWriteMicros.load(std::memory_order_relaxed)) maxWriteMicros.store(writeMicros, std::memory_order_relaxed);
+
+  ringTail.store(tail + count, std::memory_order_release);
+}
+
+// Writer side: whole batches as soon as they are complete, the remainder when a flush is due or on stop
+static void writerLoop()
+{
+  uint32_t lastFlushMicros = nowMicros();
+  bool dirty = false;
+
+  for (;;)
+  {
+    bool stopping = stopRequested.load(std::memory_order_acquire);
+    uint32_t pending = ringHead.load(std::memory_order_acquire) - ringTail.load(std::memory_order_relaxed);
+    bool flushDue = nowMicros() - lastFlushMicros >= RECORDER_FLUSH_MICROS;
+
+    if (pending >= RECORDER_BATCH || (pending > 0 && (flushDue || stopping)))
+    {
+      writeBatch(pending);
+      dirty = true;
+      continue;
+    }
+
+    if (dirty && (flushDue || stopping))
+    {
+      flushRecording();
+      dirty = false;
+    }
+    if (flushDue) lastFlushMicros = nowMicros();
+    if (stopping) break;
+
+    waitForWork(RECORDER_FLUSH_MICROS);
+  }
+}
+
+// Create the container with the EEPROM dump in its header and start the writer on the given core
+bool recorderBegin(const char *path, const uint16_t *eeData, uint32_t slots, int core)
+{
+  if (active.load() || slots == 0) return false;
+
+  ring = static_cast<RecordingFrame *>(allocateRing(slots * sizeof(RecordingFrame)));
+  if (ring == NULL) return false;
+  ringSlots = slots;
+
+  if (!openRecording(path))
+  {
+    free(ring);
+    ring = NULL;
+    return false;
+  }
+
+  static RecordingHeader header; // Too large for the caller's stack on the device
+  memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.version = RECORDING_VERSION;
+  header.headerBytes = sizeof(RecordingHeader);
+  header.frameBytes = sizeof(RecordingFrame);
+  header.frameWords = RECORDING_FRAME_WORDS;
+  memcpy(header.eeData, eeData, sizeof(header.eeData));
+
+  recorded.store(0, std::memory_order_relaxed);
+  overruns.store(0, std::memory_order_relaxed);
+  maxFill.store(0, std::memory_order_relaxed);
+  written.store(0, std::memory_order_relaxed);
+  writeErrors.store(0, std::memory_order_relaxed);
+  maxWriteMicros.store(0, std::memory_order_relaxed);
+  failed.store(false, std::memory_order_relaxed);
+  fileBytes = sizeof(header);
+  pendingDropped = 0;
+  ringHead.store(0, std::memory_order_relaxed);
+  ringTail.store(0, std::memory_order_relaxed);
+  stopRequested.store(false, std::memory_order_relaxed);
+
+  if (!writeRecording(&header, sizeof(header)) || !startWriter(core))
+  {
+    closeRecording();
+    free(ring);
+    ring = NULL;
+    return false;
+  }
+
+  active.store(true);
+  return true;
+}
+
+// Producer side, called for every subpage read: copies it into the ring and never waits for the card.
+// Returns false when not recording or when the ring is full and the subpage is dropped
+bool recorderRecord(const uint16_t *frameData, uint32_t readyMicros)
+{
+  // Announced before active is checked, so recorderEnd either sees this call or this call sees it
+  producers.fetch_add(1);
+  bool recording = active.load() && !failed.load(std::memory_order_relaxed);
+  bool taken = recording && recordSubpage(frameData, readyMicros);
+  producers.fetch_sub(1, std::memory_order_release);
+  return taken;
+}
+
+// Copy one subpage into the ring, while recording
+static bool recordSubpage(const uint16_t *frameData, uint32_t readyMicros)
+{
+  uint32_t head = ringHead.load(std::memory_order_relaxed);
+  uint32_t fill = head - ringTail.load(std::memory_order_acquire);
+  if (fill >= ringSlots)
+  {
+    overruns.store(overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (pendingDropped < UINT16_MAX) pendingDropped++;
+    return false;
+  }
+
+  RecordingFrame *slot = &ring[head % ringSlots];
+  slot->micros = readyMicros;
+  slot->controlRegister1 = frameData[832];
+  slot->dropped = pendingDropped;
+  memcpy(slot->frameData, frameData, sizeof(slot->frameData));
+  pendingDropped = 0;
+
+  ringHead.store(head + 1, std::memory_order_release);
+  recorded.store(recorded.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if (fill + 1 > maxFill.load(std::memory_order_relaxed)) maxFill.store(fill + 1, std::memory_order_relaxed);
+
+  wakeWriter();
+  return true;
+}
+
+// Write out what is still in the ring and close the container. From any task, a subpage being recorded meanwhile
+// is either the last one written or not taken
+void recorderEnd()
+{
+  if (!active.exchange(false)) return;
+  while (producers.load() > 0)
+    pauseBriefly();
+
+  stopRequested.store(true, std::memory_order_release);
+  stopWriter();
+  closeRecording();
+
+  free(ring);
+  ring = NULL;
+}
+
+// Recording, and not stopped by a write error the file could not recover from
+bool recorderActive()
+{
+  return active.load() && !failed.load(std::memory_order_relaxed);
+}
+
+void recorderGetStats(RecorderStats *out)
+{
+  out->recorded = recorded.load(std::memory_order_relaxed);
+  out->written = written.load(std::memory_order_relaxed);
+  out->overruns = overruns.load(std::memory_order_relaxed);
+  out->writeErrors = writeErrors.load(std::memory_order_relaxed);
+  out->maxFill = maxFill.load(std::memory_order_relaxed);
+  out->maxWriteMicros = maxWriteMicros.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,50 @@
+// Raw frame recorder: appends every subpage as it came from the sensor to a binary container on SD. The
+// acquisition side only copies into a ring in PSRAM, a low priority writer task drains it in batches, so SD
+// latency never stalls a sensor read
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+
+#define RECORDING_MAGIC "MLXR"
+#define RECORDING_VERSION 1
+#define RECORDING_FRAME_WORDS 834 // 832 RAM words, control register 1 and subpage, as MLX90640_GetFrameData fills them
+#define RECORDING_EE_WORDS 832
+
+// Container layout, little-endian: one RecordingHeader, then RecordingFrame records up to the end of the file
+
+struct RecordingHeader
+{
+  char magic[4]; // RECORDING_MAGIC, not terminated
+  uint16_t version;
+  uint16_t headerBytes; // Records start at this offset
+  uint16_t frameBytes; // Size of one record
+  uint16_t frameWords;
+  uint16_t eeData[RECORDING_EE_WORDS]; // Full EEPROM dump, enough to extract the calibration parameters
+};
+
+struct RecordingFrame
+{
+  uint32_t micros; // Data ready moment of the subpage
+  uint16_t controlRegister1;
+  uint16_t dropped; // Subpages lost to ring overruns right before this one, saturates
+  uint16_t frameData[RECORDING_FRAME_WORDS];
+};
+
+struct RecorderStats
+{
+  uint32_t recorded; // Subpages taken into the ring
+  uint32_t written; // Subpages on SD
+  uint32_t overruns; // Subpages dropped because the ring was full
+  uint32_t writeErrors; // Failed or short SD writes, their subpages are lost
+  uint32_t maxFill; // Ring high water mark, in subpages
+  uint32_t maxWriteMicros; // Slowest single SD write
+};
+
+bool recorderBegin(const char *path, const uint16_t *eeData, uint32_t slots, int core);
+bool recorderRecord(const uint16_t *frameData, uint32_t readyMicros);
+void recorderEnd();
+bool recorderActive();
+void recorderGetStats(RecorderStats *stats);
+
+#endif // RECORDER_H
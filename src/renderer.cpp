@@ -0,0 +1,384 @@
+#include "renderer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Band handed over to the display task
+static struct
+{
+  int x;
+  int y;
+  int w;
+  int h;
+  uint16_t *pixels;
+} taskBand;
+
+static void sendBand();
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+static uint32_t nowMicros()
+{
+  return micros();
+}
+
+static void sleepMicros(uint32_t us)
+{
+  delayMicroseconds(us);
+}
+
+// DMA can only read internal RAM
+static uint16_t *allocateBand(size_t bytes)
+{
+  return static_cast<uint16_t *>(heap_caps_malloc(bytes, MALLOC_CAP_DMA));
+}
+
+static void freeBand(uint16_t *band)
+{
+  heap_caps_free(band);
+}
+
+static SemaphoreHandle_t pushStarted = NULL;
+static SemaphoreHandle_t pushFinished = NULL;
+static const DisplayBackend *taskTarget = NULL;
+static volatile bool pushPending = false; // Touched by the renderer only
+
+static void displayTaskMain(void *arg)
+{
+  for (;;)
+  {
+    xSemaphoreTake(pushStarted, portMAX_DELAY);
+    sendBand();
+    xSemaphoreGive(pushFinished);
+  }
+}
+
+static bool startDisplayTask(int core)
+{
+  pushStarted = xSemaphoreCreateBinary();
+  pushFinished = xSemaphoreCreateBinary();
+  if (pushStarted == NULL || pushFinished == NULL) return false;
+
+  return xTaskCreatePinnedToCore(displayTaskMain, "display", 4096, NULL, 1, NULL, core) == pdPASS;
+}
+
+static void startPush()
+{
+  pushPending = true;
+  xSemaphoreGive(pushStarted);
+}
+
+static void waitPush()
+{
+  if (!pushPending) return;
+  xSemaphoreTake(pushFinished, portMAX_DELAY);
+  pushPending = false;
+}
+
+#else // Host build: the same renderer for benchmarks against MockDisplay
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static uint32_t nowMicros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleepMicros(uint32_t us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static uint16_t *allocateBand(size_t bytes)
+{
+  return static_cast<uint16_t *>(malloc(bytes));
+}
+
+static void freeBand(uint16_t *band)
+{
+  free(band);
+}
+
+// Never destroyed, like the worker's: the detached thread still waits on them when the process exits
+static std::mutex &displayMutex = *new std::mutex;
+static std::condition_variable &displaySignal = *new std::condition_variable;
+static const DisplayBackend *taskTarget = NULL;
+static bool pushPending = false;
+
+static void displayTaskMain()
+{
+  for (;;)
+  {
+    std::unique_lock<std::mutex> lock(displayMutex);
+    displaySignal.wait(lock, [] { return pushPending; });
+    lock.unlock();
+
+    sendBand();
+
+    lock.lock();
+    pushPending = false;
+    displaySignal.notify_all();
+  }
+}
+
+static bool startDisplayTask(int core)
+{
+  (void)core;
+  std::thread(displayTaskMain).detach();
+  return true;
+}
+
+static void startPush()
+{
+  std::lock_guard<std::mutex> lock(displayMutex);
+  pushPending = true;
+  displaySignal.notify_all();
+}
+
+static void waitPush()
+{
+  std::unique_lock<std::mutex> lock(displayMutex);
+  displaySignal.wait(lock, [] { return !pushPending; });
+}
+
+#endif
+
+static inline uint16_t swap16(uint16_t color)
+{
+  return (color >> 8) | (color << 8);
+}
+
+// Two bands of bandRows scanlines, false when they cannot be allocated or the tables are not prepared
+bool rendererBegin(BandRenderer *renderer, const DisplayBackend *display, const InterpolationTables *tables, int x, int y, int bandRows, bool swapBytes)
+{
+  renderer->display = display;
+  renderer->tables = tables;
+  renderer->x = x;
+  renderer->y = y;
+  renderer->bandRows = bandRows < tables->imageH ? bandRows : tables->imageH;
+  renderer->swapBytes = swapBytes;
+  renderer->overlay = NULL;
+  for (int i = 0; i < 256; i++)
+    renderer->palette[i] = swapBytes ? swap16(colorMap[i]) : colorMap[i];
+
+  for (int i = 0; i < 2; i++)
+    renderer->bands[i] = allocateBand(rendererBandBytes(renderer));
+  rendererResetStats(renderer);
+
+  if (renderer->bandRows < 1 || renderer->bands[0] == NULL || renderer->bands[1] == NULL)
+  {
+    rendererEnd(renderer);
+    return false;
+  }
+  return true;
+}
+
+void rendererEnd(BandRenderer *renderer)
+{
+  for (int i = 0; i < 2; i++)
+  {
+    if (renderer->bands[i] != NULL) freeBand(renderer->bands[i]);
+    renderer->bands[i] = NULL;
+  }
+}
+
+// Bytes of one band, two of them are allocated
+uint32_t rendererBandBytes(const BandRenderer *renderer)
+{
+  return renderer->tables->imageW * renderer->bandRows * sizeof(uint16_t);
+}
+
+void rendererResetStats(BandRenderer *renderer)
+{
+  renderer->frames = 0;
+  renderer->renderMicros = 0;
+  renderer->waitMicros = 0;
+  renderer->frameMicros = 0;
+}
+
+// Draw a frame band by band: a band is rendered while the previous one is sent, the band before that has been
+// sent by then and its buffer is reused. Returns once the last band is on the display
+void rendererDraw(BandRenderer *renderer, const float *data, float tempRangeMin, float tempRangeMax, InterpolationMode mode)
+{
+  const DisplayBackend *display = renderer->display;
+  int width = renderer->tables->imageW;
+  int height = renderer->tables->imageH;
+  uint32_t frameStart = nowMicros();
+  uint32_t waitMicros = 0;
+
+  if (display->begin != NULL) display->begin(display->context);
+  for (int row = 0, band = 0; row < height; row += renderer->bandRows, band ^= 1)
+  {
+    int rows = height - row < renderer->bandRows ? height - row : renderer->bandRows;
+    uint16_t *pixels = renderer->bands[band];
+    upscaleRows(renderer->tables, mode, data, pixels, tempRangeMin, tempRangeMax, row, rows, renderer->palette);
+    if (renderer->overlay != NULL) renderer->overlay(renderer, pixels, row, rows);
+
+    uint32_t waitStart = nowMicros();
+    display->wait(display->context);
+    waitMicros += nowMicros() - waitStart;
+    display->push(display->context, renderer->x, renderer->y + row, width, rows, pixels);
+  }
+
+  uint32_t waitStart = nowMicros();
+  display->wait(display->context);
+  if (display->end != NULL) display->end(display->context);
+  waitMicros += nowMicros() - waitStart;
+
+  uint32_t frameMicros = nowMicros() - frameStart;
+  renderer->frames++;
+  renderer->frameMicros += frameMicros;
+  renderer->waitMicros += waitMicros;
+  renderer->renderMicros += frameMicros - waitMicros;
+}
+
+// The whole image without overlays in native byte order, e.g. for a screenshot
+void rendererRenderImage(const BandRenderer *renderer, const float *data, float tempRangeMin, float tempRangeMax, InterpolationMode mode, uint16_t *out)
+{
+  upscaleRows(renderer->tables, mode, data, out, tempRangeMin, tempRangeMax, 0, renderer->tables->imageH, colorMap);
+}
+
+// Time to render every band of a frame without sending any, for comparing the modes. Not while drawing
+uint32_t rendererRenderMicros(BandRenderer *renderer, const float *data, float tempRangeMin, float tempRangeMax, InterpolationMode mode)
+{
+  int height = renderer->tables->imageH;
+  uint32_t start = nowMicros();
+  for (int row = 0; row < height; row += renderer->bandRows)
+  {
+    int rows = height - row < renderer->bandRows ? height - row : renderer->bandRows;
+    upscaleRows(renderer->tables, mode, data, renderer->bands[0], tempRangeMin, tempRangeMax, row, rows, renderer->palette);
+  }
+  return nowMicros() - start;
+}
+
+// The measurement point: black and white rings around a black dot, clipped to the rows held in pixels
+void rendererDrawMarker(uint16_t *pixels, int width, int firstRow, int rows, int x, int y, bool swapBytes)
+{
+  const int radius = 8;
+  uint16_t black = 0x0000;
+  uint16_t white = swapBytes ? swap16(0xFFFF) : 0xFFFF;
+
+  for (int h = y - radius; h <= y + radius; h++)
+  {
+    if (h < firstRow || h >= firstRow + rows) continue;
+    uint16_t *line = pixels + (h - firstRow) * width;
+    for (int w = x - radius; w <= x + radius; w++)
+    {
+      if (w < 0 || w >= width) continue;
+      // Pixels within half a pixel of a ring's radius: distance squared from r * r - r + 1 to r * r + r
+      int distanceSquared = (w - x) * (w - x) + (h - y) * (h - y);
+      if (distanceSquared <= 5) line[w] = black; // Dot of radius 2
+      else if (distanceSquared >= 21 && distanceSquared <= 72)
+      {
+        int ring = distanceSquared <= 30 ? 5 : distanceSquared <= 42 ? 6 : distanceSquared <= 56 ? 7 : 8;
+        line[w] = ring % 2 ? white : black;
+      }
+    }
+  }
+}
+
+// Copy the band that was in flight, once its time on the bus is over
+static void mockWait(void *context)
+{
+  MockDisplay *mock = static_cast<MockDisplay *>(context);
+  if (mock->pending == NULL) return;
+
+  int32_t remaining = (int32_t)(mock->busyUntilMicros - nowMicros());
+  if (remaining > 0) sleepMicros(remaining);
+
+  if (mock->framebuffer != NULL)
+  {
+    for (int h = 0; h < mock->pendingH; h++)
+    {
+      int y = mock->pendingY + h;
+      if (y < 0 || y >= mock->height) continue;
+      for (int w = 0; w < mock->pendingW; w++)
+      {
+        int x = mock->pendingX + w;
+        if (x < 0 || x >= mock->width) continue;
+        uint16_t color = mock->pending[h * mock->pendingW + w];
+        mock->framebuffer[y * mock->width + x] = mock->swapBytes ? swap16(color) : color;
+      }
+    }
+  }
+  mock->pending = NULL;
+}
+
+static void mockPush(void *context, int x, int y, int w, int h, uint16_t *pixels)
+{
+  MockDisplay *mock = static_cast<MockDisplay *>(context);
+  mockWait(context); // One transfer at a time, like TFT_eSPI's DMA
+
+  uint32_t busMicros = (uint32_t)((uint64_t)w * h * 16 * 1000000 / mock->bitsPerSecond);
+  mock->pending = pixels;
+  mock->pendingX = x;
+  mock->pendingY = y;
+  mock->pendingW = w;
+  mock->pendingH = h;
+  mock->busyUntilMicros = nowMicros() + busMicros;
+  mock->pushes++;
+  mock->pixels += w * h;
+  mock->busMicros += busMicros;
+}
+
+// Backend for a MockDisplay whose size, clock, byte order and framebuffer are set
+void rendererMockDisplay(MockDisplay *mock, DisplayBackend *out)
+{
+  mock->pending = NULL;
+  mock->busyUntilMicros = 0;
+  mock->pushes = 0;
+  mock->pixels = 0;
+  mock->busMicros = 0;
+
+  out->context = mock;
+  out->begin = NULL;
+  out->push = mockPush;
+  out->wait = mockWait;
+  out->end = NULL;
+}
+
+// Send a band with the blocking backend, in the display task
+static void sendBand()
+{
+  taskTarget->push(taskTarget->context, taskBand.x, taskBand.y, taskBand.w, taskBand.h, taskBand.pixels);
+  taskTarget->wait(taskTarget->context);
+}
+
+static void taskPush(void *context, int x, int y, int w, int h, uint16_t *pixels)
+{
+  (void)context; // The target backend's context is used by the task
+  waitPush();
+  taskBand.x = x;
+  taskBand.y = y;
+  taskBand.w = w;
+  taskBand.h = h;
+  taskBand.pixels = pixels;
+  startPush();
+}
+
+static void taskWait(void *context)
+{
+  (void)context;
+  waitPush();
+}
+
+// Turn a display that blocks until a band is sent, e.g. a parallel bus written by the CPU, into one that sends
+// from a task on the given core while the renderer goes on. There is one such task, for one display
+bool rendererDisplayTask(const DisplayBackend *target, int core, DisplayBackend *out)
+{
+  taskTarget = target;
+  if (!startDisplayTask(core)) return false;
+
+  out->context = NULL;
+  out->begin = target->begin;
+  out->push = taskPush;
+  out->wait = taskWait;
+  out->end = target->end;
+  return true;
+}
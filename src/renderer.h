@@ -0,0 +1,83 @@
+// Band renderer: the thermal image is produced a few scanlines at a time into two small buffers. While one band
+// is on its way to the display, by DMA or by a task on the other core, the next one is interpolated, colored and
+// overlaid, so neither a full frame buffer nor a full screen sprite is needed
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <stdint.h>
+
+#include "interpolation.h"
+
+#define RENDERER_BAND_ROWS 16 // 10 KB per band at 320 columns
+
+// Where the bands go. push starts sending a band and may return before it is sent, wait returns once the last
+// push is done with its pixels. begin and end bracket a frame and may be NULL
+struct DisplayBackend
+{
+  void *context;
+  void (*begin)(void *context);
+  void (*push)(void *context, int x, int y, int w, int h, uint16_t *pixels);
+  void (*wait)(void *context);
+  void (*end)(void *context);
+};
+
+struct BandRenderer;
+
+// Draws over image rows firstRow..firstRow + rows - 1 held in band, e.g. with rendererDrawMarker
+typedef void (*rendererOverlay)(BandRenderer *renderer, uint16_t *band, int firstRow, int rows);
+
+struct BandRenderer
+{
+  const DisplayBackend *display;
+  const InterpolationTables *tables; // Source and image sizes
+  int x; // Image position on the display
+  int y;
+  int bandRows;
+  bool swapBytes; // Bands in the display's byte order, which TFT_eSPI sends without swapping
+  uint16_t palette[256]; // colorMap in the bands' byte order
+  uint16_t *bands[2];
+  rendererOverlay overlay; // NULL: none
+
+  // Statistics since rendererResetStats
+  uint32_t frames;
+  uint32_t renderMicros; // Interpolating, coloring and overlaying
+  uint32_t waitMicros; // Blocked on the display
+  uint32_t frameMicros;
+};
+
+// A display that takes bitsPerSecond on the bus for every pixel it is sent, without a bus: for host benchmarks
+// and for checking the bands, which it only copies into framebuffer once their transfer is over
+struct MockDisplay
+{
+  uint16_t *framebuffer; // width * height in native byte order, NULL: not kept
+  int width;
+  int height;
+  uint32_t bitsPerSecond;
+  bool swapBytes; // Bands arrive in the display's byte order
+
+  // Transfer in flight
+  uint16_t *pending;
+  int pendingX;
+  int pendingY;
+  int pendingW;
+  int pendingH;
+  uint32_t busyUntilMicros;
+
+  // Statistics
+  uint32_t pushes;
+  uint32_t pixels;
+  uint32_t busMicros;
+};
+
+bool rendererBegin(BandRenderer *renderer, const DisplayBackend *display, const InterpolationTables *tables, int x, int y, int bandRows, bool swapBytes);
+void rendererEnd(BandRenderer *renderer);
+void rendererDraw(BandRenderer *renderer, const float *data, float tempRangeMin, float tempRangeMax, InterpolationMode mode);
+void rendererRenderImage(const BandRenderer *renderer, const float *data, float tempRangeMin, float tempRangeMax, InterpolationMode mode, uint16_t *out);
+uint32_t rendererRenderMicros(BandRenderer *renderer, const float *data, float tempRangeMin, float tempRangeMax, InterpolationMode mode);
+void rendererDrawMarker(uint16_t *pixels, int width, int firstRow, int rows, int x, int y, bool swapBytes);
+void rendererResetStats(BandRenderer *renderer);
+uint32_t rendererBandBytes(const BandRenderer *renderer);
+void rendererMockDisplay(MockDisplay *mock, DisplayBackend *out);
+bool rendererDisplayTask(const DisplayBackend *target, int core, DisplayBackend *out);
+
+#endif // RENDERER_H
@@ -0,0 +1,569 @@
+// Offline reprocessing of raw recordings (see recorder.h) on a host: the firmware's calibration, filter and
+// interpolation code replayed as fast as the cores allow. Built by the native PlatformIO environment:
+//
+//   pio run -e native
+//   .pio/build/native/program [options] 0000_0001_R.mlx ...
+//
+// Every recording is cut into segments that are calibrated in parallel. A sequential pre-pass records the
+// Vdd/Ta coefficient cache at each segment start, and the two subpages before it are replayed again without
+// output, so a segment ends up with the same state as the device and the results match it bit for bit.
+// The display stage (filter, min/max, rendering) depends on the whole history and runs per recording in order.
+#if !defined(ARDUINO)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MLX90640_API.h"
+#include "interpolation.h"
+#include "recorder.h"
+#include "sensor.h"
+#include "simd.h"
+
+#define MATRIX_X 32
+#define MATRIX_Y 24
+#define MATRIX_SIZE (MATRIX_X * MATRIX_Y)
+#define IMAGE_WIDTH 320
+#define IMAGE_HEIGHT 240
+
+// Firmware settings, keep in step with main.cpp. Emissivity, TA shift and cache tolerances come from sensor.h
+#define TEMP_RANGE_MIN 25
+#define TEMP_RANGE_MAX 37
+#define MIN_MEASURABLE_TEMP -40
+#define MAX_MEASURABLE_TEMP 300
+#define MLX_MIRROR false
+
+#define DEFAULT_SEGMENT_SUBPAGES 1024
+#define WARMUP_SUBPAGES 2 // Both subpages before a segment restore the pixels its bad pixel correction reads
+
+struct Options
+{
+  float emissivity = SENSOR_DEFAULT_EMISSIVITY;
+  float taShift = SENSOR_DEFAULT_TA_SHIFT;
+  float rangeMin = TEMP_RANGE_MIN;
+  float rangeMax = TEMP_RANGE_MAX;
+  bool filtering = true;
+  InterpolationMode upscaling = INTERPOLATION_BILINEAR;
+  int imageWidth = IMAGE_WIDTH;
+  int imageHeight = IMAGE_HEIGHT;
+  float view[4] = {0, 0, MATRIX_X, MATRIX_Y}; // Zoomed region: x, y, width, height in sensor pixels
+  bool mirroring = MLX_MIRROR;
+  const char *csvDir = NULL;
+  const char *npyDir = NULL;
+  const char *bmpDir = NULL;
+  uint32_t imageEvery = 1;
+  bool stats = false;
+  unsigned threads = 0;
+  uint32_t segmentSubpages = DEFAULT_SEGMENT_SUBPAGES;
+};
+
+// Calibrated subpages of one segment, waiting for the display stage
+struct SegmentResult
+{
+  uint32_t first;
+  uint32_t count;
+  std::vector<float> temp; // count * MATRIX_SIZE, the device's frame after each subpage
+  std::vector<float> ta;
+  std::vector<float> vdd;
+  std::vector<uint32_t> micros;
+  std::vector<uint16_t> dropped;
+  std::string csv;
+};
+
+struct Recording
+{
+  std::string path;
+  std::string name; // File name without directory and extension
+  RecordingHeader header;
+  uint32_t subpages;
+  uint32_t segments;
+  paramsMLX90640 params;
+  compiledParamsMLX90640 compiled;
+  std::vector<frameContextMLX90640> contexts; // Coefficient cache before each segment's warm up
+  uint32_t cacheRebuilds;
+  bool valid;
+
+  // Display stage, fed in segment order
+  std::mutex mutex;
+  std::map<uint32_t, SegmentResult *> finished;
+  uint32_t nextSegment;
+  bool displaying;
+  FILE *csv;
+  FILE *npy;
+  float frameFiltered[MATRIX_SIZE];
+  uint16_t image[INTERPOLATION_MAX_IMAGE * INTERPOLATION_MAX_IMAGE];
+
+  // Statistics
+  uint32_t dropped;
+  uint32_t corrupted; // Subpages the display stage skipped as out of the measurable range
+  uint64_t spanMicros;
+  uint32_t lastMicros;
+  float taMin, taMax, vddMin, vddMax;
+  float minMinTemp, maxMaxTemp;
+  double meanSum;
+};
+
+static Options options;
+static std::vector<Recording *> recordings;
+static InterpolationTables interpolationTables;
+
+// === Input =========================================================================================
+
+static bool readFrames(FILE *file, const Recording *rec, uint32_t first, uint32_t count, RecordingFrame *frames)
+{
+  long offset = rec->header.headerBytes + (long)first * rec->header.frameBytes;
+  return fseek(file, offset, SEEK_SET) == 0 && fread(frames, sizeof(RecordingFrame), count, file) == count;
+}
+
+// Header checks, calibration parameters and the sequential pass over the coefficient cache
+static bool openRecording(Recording *rec)
+{
+  FILE *file = fopen(rec->path.c_str(), "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "%s: cannot open\n", rec->path.c_str());
+    return false;
+  }
+
+  bool ok = fread(&rec->header, sizeof(rec->header), 1, file) == 1 && memcmp(rec->header.magic, RECORDING_MAGIC, 4) == 0 &&
+            rec->header.version == RECORDING_VERSION && rec->header.frameBytes == sizeof(RecordingFrame) &&
+            rec->header.headerBytes >= sizeof(RecordingHeader);
+  if (!ok)
+  {
+    fprintf(stderr, "%s: not a version %d recording\n", rec->path.c_str(), RECORDING_VERSION);
+    fclose(file);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long fileBytes = ftell(file);
+  rec->subpages = (fileBytes - rec->header.headerBytes) / rec->header.frameBytes; // A torn last record is ignored
+  rec->segments = (rec->subpages + options.segmentSubpages - 1) / options.segmentSubpages;
+
+  if (MLX90640_ExtractParameters(rec->header.eeData, &rec->params) != 0)
+    fprintf(stderr, "%s: EEPROM reports too many bad pixels, continuing\n", rec->path.c_str());
+  MLX90640_CompileParameters(&rec->params, &rec->compiled);
+
+  frameContextMLX90640 context;
+  MLX90640_InitFrameContext(&context, SENSOR_VDD_CACHE_TOLERANCE, SENSOR_TA_CACHE_TOLERANCE);
+  rec->contexts.resize(rec->segments);
+
+  static RecordingFrame frames[256];
+  uint32_t segment = 0;
+  for (uint32_t i = 0; i < rec->subpages; i += 256)
+  {
+    uint32_t count = std::min<uint32_t>(256, rec->subpages - i);
+    if (!readFrames(file, rec, i, count, frames))
+    {
+      fprintf(stderr, "%s: read error\n", rec->path.c_str());
+      fclose(file);
+      return false;
+    }
+    for (uint32_t j = 0; j < count; j++)
+    {
+      while (segment < rec->segments && i + j == std::max<int64_t>(0, (int64_t)segment * options.segmentSubpages - WARMUP_SUBPAGES))
+        rec->contexts[segment++] = context;
+      MLX90640_UpdateFrameContext(frames[j].frameData, &rec->params, &rec->compiled, &context);
+    }
+  }
+  rec->cacheRebuilds = context.cacheRebuilds;
+  fclose(file);
+
+  rec->nextSegment = 0;
+  rec->displaying = false;
+  for (int i = 0; i < MATRIX_SIZE; i++)
+    rec->frameFiltered[i] = options.rangeMin;
+  rec->dropped = 0;
+  rec->corrupted = 0;
+  rec->spanMicros = 0;
+  rec->lastMicros = 0;
+  rec->taMin = rec->vddMin = 1e9f;
+  rec->taMax = rec->vddMax = -1e9f;
+  rec->minMinTemp = options.rangeMin;
+  rec->maxMaxTemp = options.rangeMax;
+  rec->meanSum = 0;
+  return true;
+}
+
+// === Output ========================================================================================
+
+static std::string outputPath(const char *dir, const Recording *rec, const char *suffix)
+{
+  return std::string(dir) + "/" + rec->name + suffix;
+}
+
+// NumPy .npy v1.0 header for a float32 array of shape (subpages, 24, 32)
+static void writeNpyHeader(FILE *file, uint32_t subpages)
+{
+  char dict[128];
+  int length = snprintf(dict, sizeof(dict), "{'descr': '<f4', 'fortran_order': False, 'shape': (%u, %d, %d), }", subpages, MATRIX_Y, MATRIX_X);
+  int padded = (10 + length + 1 + 63) / 64 * 64 - 10; // Data aligned to 64 bytes, header ends with a newline
+  memset(dict + length, ' ', padded - length - 1);
+  dict[padded - 1] = '\n';
+
+  uint8_t preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, (uint8_t)padded, (uint8_t)(padded >> 8)};
+  fwrite(preamble, 1, sizeof(preamble), file);
+  fwrite(dict, 1, padded, file);
+}
+
+static bool openOutputs(Recording *rec)
+{
+  rec->csv = NULL;
+  rec->npy = NULL;
+
+  if (options.csvDir)
+  {
+    rec->csv = fopen(outputPath(options.csvDir, rec, ".csv").c_str(), "w");
+    if (rec->csv == NULL) return false;
+    fprintf(rec->csv, "index,micros,subpage,dropped,ta,vdd");
+    for (int i = 0; i < MATRIX_SIZE; i++)
+      fprintf(rec->csv, ",t%d", i);
+    fprintf(rec->csv, "\n");
+  }
+
+  if (options.npyDir)
+  {
+    rec->npy = fopen(outputPath(options.npyDir, rec, ".npy").c_str(), "wb");
+    if (rec->npy == NULL) return false;
+    writeNpyHeader(rec->npy, rec->subpages);
+  }
+
+  return true;
+}
+
+// 16 bit BMP the way the firmware saves screenshots
+static bool writeBmp(const char *path, const uint16_t *rgb565, int width, int height)
+{
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) return false;
+
+  int rowBytes = (width * 2 + 3) & ~3; // Rows padded to 4 bytes
+  uint32_t fileSize = rowBytes * height + 54;
+  uint8_t header[54] = {'B', 'M', (uint8_t)fileSize, (uint8_t)(fileSize >> 8), (uint8_t)(fileSize >> 16), (uint8_t)(fileSize >> 24), 0, 0, 0, 0, 54, 0, 0, 0,
+                        40, 0, 0, 0, (uint8_t)width, (uint8_t)(width >> 8), 0, 0, (uint8_t)height, (uint8_t)(height >> 8), 0, 0, 1, 0, 16, 0};
+  fwrite(header, 1, sizeof(header), file);
+
+  std::vector<uint8_t> row(rowBytes, 0);
+  for (int h = height; h > 0; h--)
+  {
+    for (int w = 0; w < width; w++)
+    {
+      uint16_t rgb = rgb565[(h - 1) * width + w];
+      uint8_t vh = (rgb & 0xFF00) >> 8;
+      uint8_t vl = rgb & 0x00FF;
+
+      // RGB565 to RGB555 conversion, 555 is default for uncompressed BMP
+      row[w * 2] = (vh << 7) | ((vl & 0xC0) >> 1) | (vl & 0x1f);
+      row[w * 2 + 1] = vh >> 1;
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+
+  return fclose(file) == 0;
+}
+
+// drawThermalImage without the measurement point marker
+static void renderImage(Recording *rec, uint32_t index)
+{
+  upscaleRows(&interpolationTables, options.upscaling, rec->frameFiltered, rec->image, options.rangeMin, options.rangeMax, 0, options.imageHeight, colorMap);
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "_%06u.bmp", index);
+  if (!writeBmp(outputPath(options.bmpDir, rec, suffix).c_str(), rec->image, options.imageWidth, options.imageHeight))
+    fprintf(stderr, "%s: cannot write image %u\n", rec->path.c_str(), index);
+}
+
+// === Processing ====================================================================================
+
+// Calibration of one segment, the device's readTempValues for every subpage
+static SegmentResult *calibrateSegment(Recording *rec, uint32_t segment)
+{
+  SegmentResult *result = new SegmentResult;
+  result->first = segment * options.segmentSubpages;
+  result->count = std::min(options.segmentSubpages, rec->subpages - result->first);
+  uint32_t start = result->first >= WARMUP_SUBPAGES ? result->first - WARMUP_SUBPAGES : 0;
+  uint32_t total = result->first + result->count - start;
+
+  result->temp.resize((size_t)result->count * MATRIX_SIZE);
+  result->ta.resize(result->count);
+  result->vdd.resize(result->count);
+  result->micros.resize(result->count);
+  result->dropped.resize(result->count);
+
+  std::vector<RecordingFrame> frames(total);
+  FILE *file = fopen(rec->path.c_str(), "rb");
+  bool ok = file != NULL && readFrames(file, rec, start, total, frames.data());
+  if (file != NULL) fclose(file);
+  if (!ok)
+  {
+    fprintf(stderr, "%s: read error in segment %u\n", rec->path.c_str(), segment);
+    result->count = 0;
+    return result;
+  }
+
+  frameContextMLX90640 context = rec->contexts[segment];
+  float frame[MATRIX_SIZE] = {0};
+  char number[64];
+
+  for (uint32_t i = 0; i < total; i++)
+  {
+    uint16_t *frameData = frames[i].frameData;
+    MLX90640_UpdateFrameContext(frameData, &rec->params, &rec->compiled, &context);
+    float tr = context.ta - options.taShift;
+    MLX90640_CalculateToCached(frameData, &rec->params, &rec->compiled, &context, options.emissivity, tr, frame);
+    MLX90640_CorrectPixels(frameData, &rec->compiled, frame);
+
+    if (start + i < result->first) continue; // Warm up
+    uint32_t n = start + i - result->first;
+    memcpy(&result->temp[(size_t)n * MATRIX_SIZE], frame, sizeof(frame));
+    result->ta[n] = context.ta;
+    result->vdd[n] = context.vdd;
+    result->micros[n] = frames[i].micros;
+    result->dropped[n] = frames[i].dropped;
+
+    if (options.csvDir)
+    {
+      snprintf(number, sizeof(number), "%u,%u,%u,%u,%.3f,%.4f", result->first + n, frames[i].micros, frameData[833], frames[i].dropped, context.ta, context.vdd);
+      result->csv += number;
+      for (int p = 0; p < MATRIX_SIZE; p++)
+      {
+        snprintf(number, sizeof(number), ",%.3f", frame[p]);
+        result->csv += number;
+      }
+      result->csv += '\n';
+    }
+  }
+
+  return result;
+}
+
+// Display stage of one segment, the device's processTempValues and drawThermalImage for every subpage
+static void displaySegment(Recording *rec, SegmentResult *result)
+{
+  if (rec->csv) fwrite(result->csv.data(), 1, result->csv.size(), rec->csv);
+  if (rec->npy) fwrite(result->temp.data(), sizeof(float), result->temp.size(), rec->npy);
+
+  for (uint32_t n = 0; n < result->count; n++)
+  {
+    const float *temp = &result->temp[(size_t)n * MATRIX_SIZE];
+    uint32_t index = result->first + n;
+    float frameMin, frameMax, minTemp, maxTemp;
+
+    simdMinMax(temp + 1, MATRIX_SIZE - 1, &frameMin, &frameMax);
+    bool corruptedFrame = frameMin < MIN_MEASURABLE_TEMP || frameMax > MAX_MEASURABLE_TEMP;
+    if (!corruptedFrame)
+      filter(temp, rec->frameFiltered, MATRIX_X, MATRIX_Y, options.mirroring, options.filtering);
+    else
+      rec->corrupted++;
+
+    simdMinMax(rec->frameFiltered, MATRIX_SIZE, &minTemp, &maxTemp);
+    if (minTemp < rec->minMinTemp) rec->minMinTemp = minTemp;
+    if (maxTemp > rec->maxMaxTemp) rec->maxMaxTemp = maxTemp;
+
+    double sum = 0;
+    for (int p = 0; p < MATRIX_SIZE; p++)
+      sum += rec->frameFiltered[p];
+    rec->meanSum += sum / MATRIX_SIZE;
+
+    rec->dropped += result->dropped[n];
+    if (index > 0) rec->spanMicros += (uint32_t)(result->micros[n] - rec->lastMicros); // Survives the micros() wrap
+    rec->lastMicros = result->micros[n];
+    rec->taMin = std::min(rec->taMin, result->ta[n]);
+    rec->taMax = std::max(rec->taMax, result->ta[n]);
+    rec->vddMin = std::min(rec->vddMin, result->vdd[n]);
+    rec->vddMax = std::max(rec->vddMax, result->vdd[n]);
+
+    if (options.bmpDir && index % options.imageEvery == 0) renderImage(rec, index);
+  }
+}
+
+// Hand a calibrated segment over. Whoever completes the next segment in order displays it and any that
+// finished early behind it, the other threads go back to calibrating
+static void finishSegment(Recording *rec, uint32_t segment, SegmentResult *result)
+{
+  std::unique_lock<std::mutex> lock(rec->mutex);
+  rec->finished[segment] = result;
+  if (rec->displaying) return;
+  rec->displaying = true;
+
+  for (;;)
+  {
+    auto next = rec->finished.find(rec->nextSegment);
+    if (next == rec->finished.end()) break;
+    SegmentResult *ready = next->second;
+    rec->finished.erase(next);
+
+    lock.unlock();
+    displaySegment(rec, ready);
+    delete ready;
+    lock.lock();
+
+    rec->nextSegment++;
+  }
+
+  rec->displaying = false;
+}
+
+// === Command line ==================================================================================
+
+static void usage()
+{
+  fprintf(stderr,
+          "Usage: replay [options] recording.mlx...\n"
+          "  -e <emissivity>    default %.2f\n"
+          "  -s <shift>         reflected temperature below Ta, default %d C\n"
+          "  -r <min>:<max>     palette range, default %d:%d C\n"
+          "  --no-filter        no frame to frame softening\n"
+          "  --no-interpolation sensor pixels as blocks instead of the interpolated image\n"
+          "  --grid             blocks with grid lines between them\n"
+          "  --upscale <mode>   bilinear (default), bicubic or lanczos2\n"
+          "  --size <w>x<h>     image size, default %dx%d\n"
+          "  --view <x>,<y>,<w>,<h> zoomed region in sensor pixels, default the whole %dx%d\n"
+          "  --mirror           camera facing the screen\n"
+          "  --csv <dir>        calibrated temperatures, one row per subpage\n"
+          "  --npy <dir>        calibrated temperatures, float32 (subpages, 24, 32)\n"
+          "  --bmp <dir>        rendered images, as the device shows them\n"
+          "  --every <n>        render every n-th subpage only\n"
+          "  --stats            per recording statistics\n"
+          "  -j <threads>       default: all cores\n"
+          "  --segment <n>      subpages per parallel job, default %d\n",
+          SENSOR_DEFAULT_EMISSIVITY, SENSOR_DEFAULT_TA_SHIFT, TEMP_RANGE_MIN, TEMP_RANGE_MAX, IMAGE_WIDTH, IMAGE_HEIGHT, MATRIX_X, MATRIX_Y, DEFAULT_SEGMENT_SUBPAGES);
+  exit(2);
+}
+
+static const char *argument(int argc, char **argv, int *i)
+{
+  if (*i + 1 >= argc) usage();
+  return argv[++*i];
+}
+
+static void parseOptions(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    if (!strcmp(arg, "-e")) options.emissivity = atof(argument(argc, argv, &i));
+    else if (!strcmp(arg, "-s")) options.taShift = atof(argument(argc, argv, &i));
+    else if (!strcmp(arg, "-r"))
+    {
+      if (sscanf(argument(argc, argv, &i), "%f:%f", &options.rangeMin, &options.rangeMax) != 2) usage();
+    }
+    else if (!strcmp(arg, "--no-filter")) options.filtering = false;
+    else if (!strcmp(arg, "--no-interpolation")) options.upscaling = INTERPOLATION_BLOCKS;
+    else if (!strcmp(arg, "--grid")) options.upscaling = INTERPOLATION_GRID;
+    else if (!strcmp(arg, "--upscale"))
+    {
+      const char *mode = argument(argc, argv, &i);
+      if (!strcmp(mode, "bilinear")) options.upscaling = INTERPOLATION_BILINEAR;
+      else if (!strcmp(mode, "bicubic")) options.upscaling = INTERPOLATION_BICUBIC;
+      else if (!strcmp(mode, "lanczos2")) options.upscaling = INTERPOLATION_LANCZOS2;
+      else usage();
+    }
+    else if (!strcmp(arg, "--size"))
+    {
+      if (sscanf(argument(argc, argv, &i), "%dx%d", &options.imageWidth, &options.imageHeight) != 2) usage();
+    }
+    else if (!strcmp(arg, "--view"))
+    {
+      float *view = options.view;
+      if (sscanf(argument(argc, argv, &i), "%f,%f,%f,%f", &view[0], &view[1], &view[2], &view[3]) != 4) usage();
+    }
+    else if (!strcmp(arg, "--mirror")) options.mirroring = true;
+    else if (!strcmp(arg, "--csv")) options.csvDir = argument(argc, argv, &i);
+    else if (!strcmp(arg, "--npy")) options.npyDir = argument(argc, argv, &i);
+    else if (!strcmp(arg, "--bmp")) options.bmpDir = argument(argc, argv, &i);
+    else if (!strcmp(arg, "--every")) options.imageEvery = std::max(1, atoi(argument(argc, argv, &i)));
+    else if (!strcmp(arg, "--stats")) options.stats = true;
+    else if (!strcmp(arg, "-j")) options.threads = std::max(1, atoi(argument(argc, argv, &i)));
+    else if (!strcmp(arg, "--segment")) options.segmentSubpages = std::max(WARMUP_SUBPAGES + 1, atoi(argument(argc, argv, &i)));
+    else if (arg[0] == '-') usage();
+    else
+    {
+      Recording *rec = new Recording;
+      rec->path = arg;
+      size_t slash = rec->path.find_last_of('/');
+      rec->name = rec->path.substr(slash == std::string::npos ? 0 : slash + 1);
+      rec->name = rec->name.substr(0, rec->name.find_last_of('.'));
+      recordings.push_back(rec);
+    }
+  }
+
+  if (recordings.empty()) usage();
+  if (options.threads == 0) options.threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+static void printStats(const Recording *rec)
+{
+  printf("%s: %u subpages over %.1f s, %u dropped while recording, %u out of range\n", rec->path.c_str(), rec->subpages, rec->spanMicros / 1e6, rec->dropped, rec->corrupted);
+  if (rec->subpages == 0) return;
+  printf("  Ta %.2f..%.2f C, Vdd %.3f..%.3f V, %u coefficient cache rebuilds\n", rec->taMin, rec->taMax, rec->vddMin, rec->vddMax, rec->cacheRebuilds);
+  printf("  scene %.2f..%.2f C, mean %.2f C\n", rec->minMinTemp, rec->maxMaxTemp, rec->meanSum / rec->subpages);
+}
+
+int main(int argc, char **argv)
+{
+  parseOptions(argc, argv);
+  if (!prepareInterpolationTables(&interpolationTables, MATRIX_X, MATRIX_Y, options.imageWidth, options.imageHeight))
+  {
+    fprintf(stderr, "Image size beyond %dx%d\n", INTERPOLATION_MAX_IMAGE, INTERPOLATION_MAX_IMAGE);
+    return 2;
+  }
+  setInterpolationView(&interpolationTables, options.view[0] * 256, options.view[1] * 256, options.view[2] * 256, options.view[3] * 256);
+  prepareInterpolationKernel(&interpolationTables, options.upscaling);
+  auto startTime = std::chrono::steady_clock::now();
+
+  // Jobs in recording and segment order, so the display stages can follow closely behind
+  std::vector<std::pair<Recording *, uint32_t>> jobs;
+  uint64_t totalSubpages = 0;
+  for (Recording *rec : recordings)
+  {
+    rec->valid = openRecording(rec) && openOutputs(rec);
+    if (!rec->valid) continue;
+    for (uint32_t segment = 0; segment < rec->segments; segment++)
+      jobs.push_back(std::make_pair(rec, segment));
+    totalSubpages += rec->subpages;
+  }
+
+  std::atomic<size_t> nextJob(0);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < options.threads; t++)
+  {
+    threads.push_back(std::thread([&] {
+      for (size_t job; (job = nextJob++) < jobs.size();)
+      {
+        Recording *rec = jobs[job].first;
+        uint32_t segment = jobs[job].second;
+        finishSegment(rec, segment, calibrateSegment(rec, segment));
+      }
+    }));
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  int failed = 0;
+  for (Recording *rec : recordings)
+  {
+    if (!rec->valid)
+    {
+      failed++;
+      continue;
+    }
+    if (rec->csv) fclose(rec->csv);
+    if (rec->npy) fclose(rec->npy);
+    if (options.stats) printStats(rec);
+  }
+
+  printf("%llu subpages in %.3f s: %.0f subpages/s on %u threads\n", (unsigned long long)totalSubpages, seconds, seconds > 0 ? totalSubpages / seconds : 0, options.threads);
+  return failed ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,229 @@
+#include "sensor.h"
+
+#include <string.h>
+
+#define EE_READ_ATTEMPTS 15
+
+static void sensorLoop(ThermalSensor *sensor);
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+static uint32_t nowMicros()
+{
+  return micros();
+}
+
+static void sleepMillis(uint32_t ms)
+{
+  delay(ms);
+}
+
+static void sensorTaskMain(void *arg)
+{
+  sensorLoop(static_cast<ThermalSensor *>(arg));
+  vTaskDelete(NULL);
+}
+
+static bool startTask(ThermalSensor *sensor, int core)
+{
+  return xTaskCreatePinnedToCore(sensorTaskMain, "sensor", 16384, sensor, 1, NULL, core) == pdPASS;
+}
+
+#else // Host build: the same sensor pipeline on std::thread for tests and benchmarks with simulated sensors
+
+#include <chrono>
+#include <thread>
+
+static uint32_t nowMicros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleepMillis(uint32_t ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static bool startTask(ThermalSensor *sensor, int core)
+{
+  (void)core;
+  std::thread(sensorLoop, sensor).detach();
+  return true;
+}
+
+#endif
+
+// Defaults for a sensor at slaveAddr, on its own bus when a transport is given and on the shared one otherwise.
+// Returns the driver's error when no slot was left, the sensor is then reached by its plain address on the shared bus
+int sensorInit(ThermalSensor *sensor, uint8_t slaveAddr, const transportMLX90640 *transport)
+{
+  sensor->slaveAddr = slaveAddr;
+  sensor->emissivity = SENSOR_DEFAULT_EMISSIVITY;
+  sensor->taShift = SENSOR_DEFAULT_TA_SHIFT;
+  sensor->adaptiveRate = false;
+  sensor->calculate = NULL;
+  sensor->ambientTemperature = 0;
+  sensor->vdd = 0;
+  sensor->subpages = 0;
+  sensor->errors = 0;
+  memset(sensor->frame, 0, sizeof(sensor->frame));
+  tripleBufferInit(&sensor->frames);
+  sensor->running.store(false);
+  sensor->taskActive.store(false);
+
+  int device = MLX90640_I2CAttach(slaveAddr, transport);
+  sensor->device = device >= 0 ? device : slaveAddr;
+  return device >= 0 ? 0 : device;
+}
+
+// Dump the whole EEPROM, retrying while the bus is busy. Returns 0 or the last read's status
+int sensorReadEE(ThermalSensor *sensor, uint16_t *eeData)
+{
+  int status;
+
+  for (int i = 0; i < EE_READ_ATTEMPTS; i++)
+  {
+    status = MLX90640_DumpEE(sensor->device, eeData);
+    if (status == 0) break;
+    sleepMillis(10);
+  }
+  return status;
+}
+
+// Dump the whole EEPROM and extract the calibration from it, returns the first failing step's status
+int sensorReadParameters(ThermalSensor *sensor, uint16_t *eeData)
+{
+  int status = sensorReadEE(sensor, eeData);
+  if (status != 0) return status;
+
+  return MLX90640_ExtractParameters(eeData, &sensor->params);
+}
+
+// Precompile the calibration and start measuring: chess mode, refresh rate and resolution.
+// Returns 0 or the first failed register write
+int sensorConfigure(ThermalSensor *sensor, uint8_t refreshRate, uint8_t resolution, uint8_t minRefreshRate, uint8_t maxRefreshRate, uint8_t subpagesPerRender)
+{
+  MLX90640_CompileParameters(&sensor->params, &sensor->compiled);
+  MLX90640_InitFrameContext(&sensor->context, SENSOR_VDD_CACHE_TOLERANCE, SENSOR_TA_CACHE_TOLERANCE);
+
+  int status = MLX90640_I2CWrite(sensor->device, 0x800D, 0x1901); // Enables reading out the temperatures
+  if (status == 0) status = MLX90640_SetRefreshRate(sensor->device, refreshRate);
+  if (status == 0) status = MLX90640_SetResolution(sensor->device, resolution);
+
+  acquisitionBegin(&sensor->acquisition, sensor->device, refreshRate);
+  rateControlBegin(&sensor->rateControl, refreshRate, resolution, minRefreshRate, maxRefreshRate, subpagesPerRender, nowMicros());
+  return status;
+}
+
+// Wait for the next subpage, read and calculate it into the frame.
+// Returns the subpage number or a negative error like MLX90640_GetFrameData, the frame is left alone then
+int sensorReadSubpage(ThermalSensor *sensor)
+{
+  int status = acquisitionGetFrame(&sensor->acquisition, sensor->frameData); // Sleeps until shortly before the subpage is due
+  if (status < 0)
+  {
+    sensor->errors++;
+    return status;
+  }
+  uint32_t calculationStart = nowMicros();
+
+  // Decode Vdd and Ta once per subpage, recompensating pixel offsets only on drift
+  MLX90640_UpdateFrameContext(sensor->frameData, &sensor->params, &sensor->compiled, &sensor->context);
+  sensor->vdd = sensor->context.vdd;
+  sensor->ambientTemperature = sensor->context.ta;
+
+  float tr = sensor->ambientTemperature - sensor->taShift; // Reflected temperature based on the sensor ambient temperature
+  if (sensor->calculate != NULL)
+    sensor->calculate(sensor, sensor->frameData, tr, sensor->frame);
+  else
+    MLX90640_CalculateToCached(sensor->frameData, &sensor->params, &sensor->compiled, &sensor->context, sensor->emissivity, tr, sensor->frame);
+  MLX90640_CorrectPixels(sensor->frameData, &sensor->compiled, sensor->frame); // Broken and outlier pixels, mode taken from the frame
+  sensor->subpages++;
+
+  if (sensor->adaptiveRate) rateControlSubpage(&sensor->rateControl, sensor->frameData, sensor->frame, sensor->acquisition.readMicros + (nowMicros() - calculationStart));
+  return status;
+}
+
+// Apply the rate controller's decision, on the side that reads the sensor
+void sensorAdaptRate(ThermalSensor *sensor)
+{
+  uint8_t refreshRate;
+  uint8_t resolution;
+  if (!sensor->adaptiveRate || !rateControlUpdate(&sensor->rateControl, nowMicros(), &refreshRate, &resolution)) return;
+
+  // Not confirmed on a failed write, the controller asks again after its next window
+  if (MLX90640_SetRefreshRate(sensor->device, refreshRate) != 0) return;
+  acquisitionSetRefreshRate(&sensor->acquisition, refreshRate);
+  if (MLX90640_SetResolution(sensor->device, resolution) != 0) resolution = sensor->rateControl.resolution;
+
+  rateControlSwitched(&sensor->rateControl, refreshRate, resolution, nowMicros());
+}
+
+// Hand the current frame over to the renderer
+void sensorPublish(ThermalSensor *sensor)
+{
+  SensorFrame *sensorFrame = tripleBufferBack(&sensor->frames);
+  memcpy(sensorFrame->temp, sensor->frame, sizeof(sensor->frame));
+  sensorFrame->readyMicros = sensor->acquisition.lastReadyMicros;
+  tripleBufferPublish(&sensor->frames);
+}
+
+// The sensor's task: every subpage is published as it arrives
+static void sensorLoop(ThermalSensor *sensor)
+{
+  while (sensor->running.load(std::memory_order_relaxed))
+  {
+    if (sensorReadSubpage(sensor) >= 0) sensorPublish(sensor);
+    sensorAdaptRate(sensor);
+  }
+  sensor->taskActive.store(false, std::memory_order_release);
+}
+
+// Read the sensor in a task of its own, pinned to core on the device. The sensor has to be configured
+bool sensorStart(ThermalSensor *sensor, int core)
+{
+  sensor->running.store(true);
+  sensor->taskActive.store(true);
+  if (startTask(sensor, core)) return true;
+  sensor->running.store(false);
+  sensor->taskActive.store(false);
+  return false;
+}
+
+// Stop the sensor's task after the subpage it is waiting for
+void sensorStop(ThermalSensor *sensor)
+{
+  sensor->running.store(false);
+  while (sensor->taskActive.load(std::memory_order_acquire))
+    sleepMillis(1);
+}
+
+// Columns of count frames that share overlap columns with their neighbours
+int sensorStitchedWidth(int count, int overlap)
+{
+  return count * SENSOR_MATRIX_X - (count - 1) * overlap;
+}
+
+// Place frames side by side, in the order of the raw frames' columns (the display mirrors them unless
+// MLX_MIRROR). Overlapping columns are cross-faded from one sensor to the next
+void sensorStitch(const float *const *frames, int count, int overlap, float *out)
+{
+  int width = sensorStitchedWidth(count, overlap);
+  memset(out, 0, width * SENSOR_MATRIX_Y * sizeof(float));
+
+  for (int k = 0; k < count; k++)
+  {
+    int left = k * (SENSOR_MATRIX_X - overlap);
+    for (int c = 0; c < SENSOR_MATRIX_X; c++)
+    {
+      float weight = 1;
+      if (k > 0 && c < overlap) weight = (float)(c + 1) / (overlap + 1);
+      else if (k < count - 1 && c >= SENSOR_MATRIX_X - overlap) weight = (float)(SENSOR_MATRIX_X - c) / (overlap + 1);
+
+      for (int h = 0; h < SENSOR_MATRIX_Y; h++)
+        out[h * width + left + c] += weight * frames[k][h * SENSOR_MATRIX_X + c];
+    }
+  }
+}
@@ -0,0 +1,81 @@
+// MLX90640 sensor instance: address and bus, calibration, acquisition schedule, rate control and temperature
+// frame of one sensor. Several of them are read concurrently, each from its own task on its own bus, and their
+// frames stitched side by side into one wider image
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "MLX90640_API.h"
+#include "MLX90640_I2C_Driver.h"
+#include "acquisition.h"
+#include "ratecontrol.h"
+#include "triplebuffer.h"
+
+#define SENSOR_MATRIX_X 32
+#define SENSOR_MATRIX_Y 24
+#define SENSOR_MATRIX_SIZE (SENSOR_MATRIX_X * SENSOR_MATRIX_Y)
+#define SENSOR_FRAME_WORDS 834 // 832 RAM words, control register 1 and subpage
+
+// Defaults of sensorInit, also taken by the host tools that reprocess recorded frames
+#define SENSOR_DEFAULT_EMISSIVITY 0.95
+#define SENSOR_DEFAULT_TA_SHIFT 8 // Ambient temperature (TA) shift
+#define SENSOR_VDD_CACHE_TOLERANCE 0.005 // V, Vdd drift that triggers per-pixel offset/alpha recompensation
+#define SENSOR_TA_CACHE_TOLERANCE 0.1 // C, Ta drift that triggers per-pixel offset/alpha recompensation
+
+// Temperatures handed from a sensor's task to the renderer
+struct SensorFrame
+{
+  float temp[SENSOR_MATRIX_SIZE];
+  uint32_t readyMicros; // Data ready moment of the newest subpage in it
+};
+
+struct ThermalSensor;
+
+// Temperature calculation of one subpage into result, e.g. split across cores
+typedef void (*sensorCalculation)(ThermalSensor *sensor, uint16_t *frameData, float tr, float *result);
+
+struct ThermalSensor
+{
+  // Settings, sensorInit fills in defaults
+  uint8_t slaveAddr;
+  uint8_t device; // Handle the driver knows the sensor by, pass it to the MLX90640_* functions
+  float emissivity;
+  float taShift; // Reflected temperature below the sensor's ambient temperature
+  bool adaptiveRate; // Let rateControl pick refresh rate and resolution
+  sensorCalculation calculate; // NULL: on the calling core
+
+  // Calibration and pipeline state
+  paramsMLX90640 params;
+  compiledParamsMLX90640 compiled;
+  frameContextMLX90640 context;
+  Acquisition acquisition;
+  RateControl rateControl;
+
+  uint16_t frameData[SENSOR_FRAME_WORDS]; // Last subpage as read
+  float frame[SENSOR_MATRIX_SIZE]; // Both subpages as they are read
+  float ambientTemperature;
+  float vdd;
+  uint32_t subpages;
+  uint32_t errors; // Failed reads
+
+  // Output of the sensor's task
+  TripleBuffer<SensorFrame> frames;
+  std::atomic<bool> running; // Asked to keep reading
+  std::atomic<bool> taskActive;
+};
+
+int sensorInit(ThermalSensor *sensor, uint8_t slaveAddr, const transportMLX90640 *transport);
+int sensorReadEE(ThermalSensor *sensor, uint16_t *eeData);
+int sensorReadParameters(ThermalSensor *sensor, uint16_t *eeData);
+int sensorConfigure(ThermalSensor *sensor, uint8_t refreshRate, uint8_t resolution, uint8_t minRefreshRate, uint8_t maxRefreshRate, uint8_t subpagesPerRender);
+int sensorReadSubpage(ThermalSensor *sensor);
+void sensorAdaptRate(ThermalSensor *sensor);
+void sensorPublish(ThermalSensor *sensor);
+bool sensorStart(ThermalSensor *sensor, int core);
+void sensorStop(ThermalSensor *sensor);
+int sensorStitchedWidth(int count, int overlap);
+void sensorStitch(const float *const *frames, int count, int overlap, float *out);
+
+#endif // SENSOR_H
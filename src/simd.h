@@ -0,0 +1,241 @@
+// Thin SIMD layer for the float kernels: 4-lane vectors on SSE and NEON hosts,
+// esp-dsp bulk routines on ESP32-S3, plain scalar code everywhere else.
+// SIMD_F32X4_NATIVE tells whether simd_f32x4 maps to vector registers; where
+// it does not, per-pixel kernels are better off with their scalar loops
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// Define SIMD_FORCE_SCALAR to benchmark or debug against the scalar backend
+#if defined(SIMD_FORCE_SCALAR)
+#define SIMD_BACKEND_SCALAR
+#define SIMD_BACKEND_NAME "scalar"
+#elif defined(CONFIG_IDF_TARGET_ESP32S3) && __has_include(<esp_dsp.h>)
+#include <esp_dsp.h>
+#define SIMD_BACKEND_DSPS
+#define SIMD_BACKEND_NAME "esp-dsp"
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define SIMD_BACKEND_SSE
+#define SIMD_BACKEND_NAME "SSE"
+#define SIMD_F32X4_NATIVE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_BACKEND_NEON
+#define SIMD_BACKEND_NAME "NEON"
+#define SIMD_F32X4_NATIVE 1
+#else
+#define SIMD_BACKEND_SCALAR
+#define SIMD_BACKEND_NAME "scalar"
+#endif
+
+#if !defined(SIMD_F32X4_NATIVE)
+#define SIMD_F32X4_NATIVE 0
+#endif
+
+// === 4-lane float vector ===========================================================================
+
+// simdSelectNotLess(a, b, x, y) takes x in the lanes where a < b does not hold, NaN ones included, y elsewhere
+
+#if defined(SIMD_BACKEND_SSE)
+
+typedef __m128 simd_f32x4;
+inline simd_f32x4 simdLoad(const float *p) { return _mm_loadu_ps(p); }
+inline void simdStore(float *p, simd_f32x4 v) { _mm_storeu_ps(p, v); }
+inline simd_f32x4 simdSet1(float x) { return _mm_set1_ps(x); }
+inline simd_f32x4 simdSet4(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+inline simd_f32x4 simdAdd(simd_f32x4 a, simd_f32x4 b) { return _mm_add_ps(a, b); }
+inline simd_f32x4 simdSub(simd_f32x4 a, simd_f32x4 b) { return _mm_sub_ps(a, b); }
+inline simd_f32x4 simdMul(simd_f32x4 a, simd_f32x4 b) { return _mm_mul_ps(a, b); }
+inline simd_f32x4 simdDiv(simd_f32x4 a, simd_f32x4 b) { return _mm_div_ps(a, b); }
+inline simd_f32x4 simdSqrt(simd_f32x4 v) { return _mm_sqrt_ps(v); }
+inline simd_f32x4 simdMin(simd_f32x4 a, simd_f32x4 b) { return _mm_min_ps(a, b); }
+inline simd_f32x4 simdMax(simd_f32x4 a, simd_f32x4 b) { return _mm_max_ps(a, b); }
+inline simd_f32x4 simdReverse(simd_f32x4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+inline simd_f32x4 simdSelectNotLess(simd_f32x4 a, simd_f32x4 b, simd_f32x4 x, simd_f32x4 y)
+{
+  __m128 mask = _mm_cmpnlt_ps(a, b);
+  return _mm_or_ps(_mm_and_ps(mask, x), _mm_andnot_ps(mask, y));
+}
+
+#elif defined(SIMD_BACKEND_NEON)
+
+typedef float32x4_t simd_f32x4;
+inline simd_f32x4 simdLoad(const float *p) { return vld1q_f32(p); }
+inline void simdStore(float *p, simd_f32x4 v) { vst1q_f32(p, v); }
+inline simd_f32x4 simdSet1(float x) { return vdupq_n_f32(x); }
+inline simd_f32x4 simdSet4(float a, float b, float c, float d)
+{
+  float lanes[4] = {a, b, c, d};
+  return vld1q_f32(lanes);
+}
+inline simd_f32x4 simdAdd(simd_f32x4 a, simd_f32x4 b) { return vaddq_f32(a, b); }
+inline simd_f32x4 simdSub(simd_f32x4 a, simd_f32x4 b) { return vsubq_f32(a, b); }
+inline simd_f32x4 simdMul(simd_f32x4 a, simd_f32x4 b) { return vmulq_f32(a, b); }
+#if defined(__aarch64__)
+inline simd_f32x4 simdDiv(simd_f32x4 a, simd_f32x4 b) { return vdivq_f32(a, b); }
+inline simd_f32x4 simdSqrt(simd_f32x4 v) { return vsqrtq_f32(v); }
+#else // ARMv7 NEON has only estimates, lane by lane keeps the results exact
+inline simd_f32x4 simdDiv(simd_f32x4 a, simd_f32x4 b)
+{
+  float x[4], y[4];
+  vst1q_f32(x, a);
+  vst1q_f32(y, b);
+  for (int i = 0; i < 4; i++) x[i] /= y[i];
+  return vld1q_f32(x);
+}
+inline simd_f32x4 simdSqrt(simd_f32x4 v)
+{
+  float x[4];
+  vst1q_f32(x, v);
+  for (int i = 0; i < 4; i++) x[i] = sqrtf(x[i]);
+  return vld1q_f32(x);
+}
+#endif
+inline simd_f32x4 simdMin(simd_f32x4 a, simd_f32x4 b) { return vminq_f32(a, b); }
+inline simd_f32x4 simdMax(simd_f32x4 a, simd_f32x4 b) { return vmaxq_f32(a, b); }
+inline simd_f32x4 simdReverse(simd_f32x4 v)
+{
+  v = vrev64q_f32(v);
+  return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
+}
+inline simd_f32x4 simdSelectNotLess(simd_f32x4 a, simd_f32x4 b, simd_f32x4 x, simd_f32x4 y)
+{
+  return vbslq_f32(vmvnq_u32(vcltq_f32(a, b)), x, y);
+}
+
+#else // Scalar lanes, also used by the esp-dsp backend outside of its bulk routines
+
+typedef struct { float v[4]; } simd_f32x4;
+inline simd_f32x4 simdLoad(const float *p) { simd_f32x4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void simdStore(float *p, simd_f32x4 v) { memcpy(p, v.v, sizeof(v.v)); }
+inline simd_f32x4 simdSet1(float x) { simd_f32x4 r = {{x, x, x, x}}; return r; }
+inline simd_f32x4 simdSet4(float a, float b, float c, float d) { simd_f32x4 r = {{a, b, c, d}}; return r; }
+inline simd_f32x4 simdAdd(simd_f32x4 a, simd_f32x4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline simd_f32x4 simdSub(simd_f32x4 a, simd_f32x4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline simd_f32x4 simdMul(simd_f32x4 a, simd_f32x4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline simd_f32x4 simdDiv(simd_f32x4 a, simd_f32x4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+inline simd_f32x4 simdSqrt(simd_f32x4 a) { for (int i = 0; i < 4; i++) a.v[i] = sqrtf(a.v[i]); return a; }
+inline simd_f32x4 simdMin(simd_f32x4 a, simd_f32x4 b) { for (int i = 0; i < 4; i++) if (b.v[i] < a.v[i]) a.v[i] = b.v[i]; return a; }
+inline simd_f32x4 simdMax(simd_f32x4 a, simd_f32x4 b) { for (int i = 0; i < 4; i++) if (b.v[i] > a.v[i]) a.v[i] = b.v[i]; return a; }
+inline simd_f32x4 simdReverse(simd_f32x4 a) { simd_f32x4 r = {{a.v[3], a.v[2], a.v[1], a.v[0]}}; return r; }
+inline simd_f32x4 simdSelectNotLess(simd_f32x4 a, simd_f32x4 b, simd_f32x4 x, simd_f32x4 y)
+{
+  for (int i = 0; i < 4; i++) if (a.v[i] < b.v[i]) x.v[i] = y.v[i];
+  return x;
+}
+
+#endif
+
+// table[index[0..3]]
+inline simd_f32x4 simdGather(const float *table, const uint16_t *index)
+{
+  return simdSet4(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+}
+
+// === Bulk array kernels ============================================================================
+
+// out[i] = (out[i] + in[i]) / 2
+inline void simdAverage(float *out, const float *in, int n) __attribute__((always_inline));
+inline void simdAverage(float *out, const float *in, int n)
+{
+#if defined(SIMD_BACKEND_DSPS)
+  dsps_add_f32(out, in, out, n, 1, 1, 1);
+  dsps_mulc_f32(out, out, n, 0.5f, 1, 1);
+#else
+  int i = 0;
+  simd_f32x4 half = simdSet1(0.5f);
+  for (; i + 4 <= n; i += 4)
+    simdStore(out + i, simdMul(simdAdd(simdLoad(out + i), simdLoad(in + i)), half));
+  for (; i < n; i++)
+    out[i] = (out[i] + in[i]) * 0.5f;
+#endif
+}
+
+// out[n - 1 - i] = (out[n - 1 - i] + in[i]) / 2, or a plain reversed copy when averaging is off
+inline void simdAverageReversed(float *out, const float *in, int n, bool averaging) __attribute__((always_inline));
+inline void simdAverageReversed(float *out, const float *in, int n, bool averaging)
+{
+  int i = 0;
+  simd_f32x4 half = simdSet1(0.5f);
+  for (; i + 4 <= n; i += 4)
+  {
+    simd_f32x4 reversed = simdReverse(simdLoad(in + i));
+    float *dst = out + n - 4 - i;
+    simdStore(dst, averaging ? simdMul(simdAdd(simdLoad(dst), reversed), half) : reversed);
+  }
+  for (; i < n; i++)
+    out[n - 1 - i] = averaging ? (out[n - 1 - i] + in[i]) * 0.5f : in[i];
+}
+
+// out[i] = in[i] * scale + bias
+inline void simdAffine(const float *in, float *out, int n, float scale, float bias) __attribute__((always_inline));
+inline void simdAffine(const float *in, float *out, int n, float scale, float bias)
+{
+#if defined(SIMD_BACKEND_DSPS)
+  dsps_mulc_f32(in, out, n, scale, 1, 1);
+  dsps_addc_f32(out, out, n, bias, 1, 1);
+#else
+  int i = 0;
+  simd_f32x4 vScale = simdSet1(scale);
+  simd_f32x4 vBias = simdSet1(bias);
+  for (; i + 4 <= n; i += 4)
+    simdStore(out + i, simdAdd(simdMul(simdLoad(in + i), vScale), vBias));
+  for (; i < n; i++)
+    out[i] = in[i] * scale + bias;
+#endif
+}
+
+// out[i] = a[i] * b[i]
+inline void simdMultiply(const float *a, const float *b, float *out, int n) __attribute__((always_inline));
+inline void simdMultiply(const float *a, const float *b, float *out, int n)
+{
+#if defined(SIMD_BACKEND_DSPS)
+  dsps_mul_f32(a, b, out, n, 1, 1, 1);
+#else
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    simdStore(out + i, simdMul(simdLoad(a + i), simdLoad(b + i)));
+  for (; i < n; i++)
+    out[i] = a[i] * b[i];
+#endif
+}
+
+// Minimum and maximum of n > 0 values
+inline void simdMinMax(const float *in, int n, float *min, float *max) __attribute__((always_inline));
+inline void simdMinMax(const float *in, int n, float *min, float *max)
+{
+  int i = 0;
+  float lo = in[0];
+  float hi = in[0];
+  if (n >= 4)
+  {
+    simd_f32x4 vMin = simdLoad(in);
+    simd_f32x4 vMax = vMin;
+    for (i = 4; i + 4 <= n; i += 4)
+    {
+      simd_f32x4 v = simdLoad(in + i);
+      vMin = simdMin(vMin, v);
+      vMax = simdMax(vMax, v);
+    }
+    float lanes[4];
+    simdStore(lanes, vMin);
+    lo = lanes[0];
+    for (int j = 1; j < 4; j++) if (lanes[j] < lo) lo = lanes[j];
+    simdStore(lanes, vMax);
+    hi = lanes[0];
+    for (int j = 1; j < 4; j++) if (lanes[j] > hi) hi = lanes[j];
+  }
+  for (; i < n; i++)
+  {
+    if (in[i] < lo) lo = in[i];
+    if (in[i] > hi) hi = in[i];
+  }
+  *min = lo;
+  *max = hi;
+}
+
+#endif // SIMD_H
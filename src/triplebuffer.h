@@ -0,0 +1,79 @@
+// Lock-free single producer, single consumer triple buffer: the producer never waits for the consumer and
+// the consumer always takes the newest complete item without blocking
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define TRIPLE_BUFFER_FRESH 0x4 // Set on the middle index while it holds an item the consumer has not taken
+
+template <class T>
+struct TripleBuffer
+{
+  T slots[3];
+  std::atomic<uint32_t> middle; // Slot exchanged between both sides, plus TRIPLE_BUFFER_FRESH
+  uint32_t back; // Owned by the producer
+  uint32_t front; // Owned by the consumer
+
+  // Producer side statistics
+  uint32_t published;
+  uint32_t dropped; // Published items overwritten before the consumer took them
+
+  // Consumer side statistics
+  uint32_t taken;
+  uint32_t duplicates; // Takes that found nothing newer and got the previous item again
+};
+
+template <class T>
+inline void tripleBufferInit(TripleBuffer<T> *tb)
+{
+  tb->back = 0;
+  tb->middle.store(1);
+  tb->front = 2;
+  tb->published = 0;
+  tb->dropped = 0;
+  tb->taken = 0;
+  tb->duplicates = 0;
+}
+
+// Slot the producer fills before publishing it
+template <class T>
+inline T *tripleBufferBack(TripleBuffer<T> *tb)
+{
+  return &tb->slots[tb->back];
+}
+
+// Hand the filled back slot over and continue with the one the consumer is not using
+template <class T>
+inline void tripleBufferPublish(TripleBuffer<T> *tb)
+{
+  uint32_t previous = tb->middle.exchange(tb->back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+  tb->back = previous & ~TRIPLE_BUFFER_FRESH;
+  tb->published++;
+  if (previous & TRIPLE_BUFFER_FRESH) tb->dropped++;
+}
+
+// Whether a take would get an item not taken yet, without taking it, for consumers that poll
+template <class T>
+inline bool tripleBufferFresh(const TripleBuffer<T> *tb)
+{
+  return (tb->middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH) != 0;
+}
+
+// Newest published item, fresh tells whether it differs from the previous take
+template <class T>
+inline T *tripleBufferTake(TripleBuffer<T> *tb, bool *fresh)
+{
+  *fresh = (tb->middle.load(std::memory_order_acquire) & TRIPLE_BUFFER_FRESH) != 0;
+  if (*fresh)
+  {
+    tb->front = tb->middle.exchange(tb->front, std::memory_order_acq_rel) & ~TRIPLE_BUFFER_FRESH;
+    tb->taken++;
+  }
+  else
+    tb->duplicates++;
+  return &tb->slots[tb->front];
+}
+
+#endif // TRIPLEBUFFER_H
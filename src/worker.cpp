@@ -0,0 +1,115 @@
+#include "worker.h"
+
+#include <atomic>
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+static SemaphoreHandle_t workerStarted = NULL;
+static SemaphoreHandle_t workerFinished = NULL;
+static volatile workerJob currentJob = NULL;
+static void *volatile currentArg = NULL;
+static std::atomic<bool> claimed(false); // From workerRun to the matching workerWait
+
+static void workerTask(void *arg)
+{
+  for (;;)
+  {
+    xSemaphoreTake(workerStarted, portMAX_DELAY);
+    currentJob(currentArg);
+    xSemaphoreGive(workerFinished);
+  }
+}
+
+// Start the helper task pinned to the given core
+bool workerBegin(int core)
+{
+  workerStarted = xSemaphoreCreateBinary();
+  workerFinished = xSemaphoreCreateBinary();
+  if (workerStarted == NULL || workerFinished == NULL) return false;
+
+  return xTaskCreatePinnedToCore(workerTask, "worker", 4096, NULL, 1, NULL, core) == pdPASS;
+}
+
+// Hand a job over to the helper task, returns immediately. False while another caller's job has not been waited for
+bool workerRun(workerJob job, void *arg)
+{
+  bool idle = false;
+  if (!claimed.compare_exchange_strong(idle, true, std::memory_order_acquire)) return false;
+
+  currentJob = job;
+  currentArg = arg;
+  xSemaphoreGive(workerStarted);
+  return true;
+}
+
+// Barrier: block until the job handed over by workerRun has finished, only after workerRun returned true
+void workerWait()
+{
+  xSemaphoreTake(workerFinished, portMAX_DELAY);
+  claimed.store(false, std::memory_order_release);
+}
+
+#else // Host build: the same helper on std::thread for tests and benchmarks
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Never destroyed: the detached thread still waits on them when the process exits
+static std::mutex &workerMutex = *new std::mutex;
+static std::condition_variable &workerSignal = *new std::condition_variable;
+static workerJob currentJob = nullptr;
+static void *currentArg = nullptr;
+static bool jobPending = false;
+static bool claimed = false; // From workerRun to the matching workerWait
+
+static void workerTask()
+{
+  for (;;)
+  {
+    std::unique_lock<std::mutex> lock(workerMutex);
+    workerSignal.wait(lock, [] { return jobPending; });
+    workerJob job = currentJob;
+    lock.unlock();
+
+    job(currentArg);
+
+    lock.lock();
+    jobPending = false;
+    workerSignal.notify_all();
+  }
+}
+
+// Start the helper thread, the core is left to the host scheduler
+bool workerBegin(int core)
+{
+  (void)core;
+  std::thread(workerTask).detach();
+  return true;
+}
+
+// Hand a job over to the helper thread, returns immediately. False while another caller's job has not been waited for
+bool workerRun(workerJob job, void *arg)
+{
+  std::lock_guard<std::mutex> lock(workerMutex);
+  if (claimed) return false;
+
+  claimed = true;
+  currentJob = job;
+  currentArg = arg;
+  jobPending = true;
+  workerSignal.notify_all();
+  return true;
+}
+
+// Barrier: block until the job handed over by workerRun has finished, only after workerRun returned true
+void workerWait()
+{
+  std::unique_lock<std::mutex> lock(workerMutex);
+  workerSignal.wait(lock, [] { return !jobPending; });
+  claimed = false;
+}
+
+#endif
@@ -0,0 +1,12 @@
+// Helper task on the second core: runs one job at a time and lets the caller wait for it. A caller that finds
+// it taken by another one gets false from workerRun and does the work itself
+#ifndef WORKER_H
+#define WORKER_H
+
+typedef void (*workerJob)(void *arg);
+
+bool workerBegin(int core);
+bool workerRun(workerJob job, void *arg);
+void workerWait();
+
+#endif // WORKER_H
@@ -0,0 +1,111 @@
+// Deadline scheduled acquisition against a simulated sensor that measures in real time: once synchronized, a
+// subpage costs a couple of status polls and the rest of its period is slept
+#include <unity.h>
+
+#include <chrono>
+
+#include "MLX90640_Simulator.h"
+#include "acquisition.h"
+
+#define SENSOR_ADDRESS 0x33
+#define REFRESH_RATE 0x06 // 32 subpages per second
+#define PERIOD_MICROS (2000000 >> REFRESH_RATE)
+#define WARMUP_SUBPAGES 4
+#define MEASURED_SUBPAGES 32
+
+static simulatorMLX90640 simulator;
+static transportMLX90640 transport;
+static int device;
+static Acquisition acquisition;
+static uint16_t frameData[834];
+
+static uint32_t nowMicros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void setUp()
+{
+  uint16_t eeData[832];
+  MLX90640_SimulatorSyntheticEE(eeData);
+  MLX90640_SimulatorInit(&simulator, SENSOR_ADDRESS, eeData, true);
+  MLX90640_SimulatorTransport(&simulator, &transport);
+  device = MLX90640_I2CAttach(SENSOR_ADDRESS, &transport);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, device);
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_SetRefreshRate(device, REFRESH_RATE));
+  acquisitionBegin(&acquisition, device, REFRESH_RATE);
+}
+
+void tearDown()
+{
+  MLX90640_I2CDetach(device);
+}
+
+void test_period_follows_the_refresh_rate()
+{
+  TEST_ASSERT_EQUAL_UINT32(PERIOD_MICROS, acquisition.periodMicros);
+  acquisitionSetRefreshRate(&acquisition, 0x00);
+  TEST_ASSERT_EQUAL_UINT32(2000000, acquisition.periodMicros);
+  acquisitionSetRefreshRate(&acquisition, 0x07);
+  TEST_ASSERT_EQUAL_UINT32(15625, acquisition.periodMicros);
+  TEST_ASSERT_FALSE(acquisition.synced);
+}
+
+// Every subpage in turn, none skipped, polled only inside the guard window and slept through the rest
+void test_synchronized_subpages_are_slept_for()
+{
+  int subpage = -1;
+  for (int i = 0; i < WARMUP_SUBPAGES; i++)
+    subpage = acquisitionGetFrame(&acquisition, frameData);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, subpage);
+  TEST_ASSERT_TRUE(acquisition.synced);
+
+  acquisitionResetStats(&acquisition);
+  uint32_t startMicros = nowMicros();
+  for (int i = 0; i < MEASURED_SUBPAGES; i++)
+  {
+    int status = acquisitionGetFrame(&acquisition, frameData);
+    TEST_ASSERT_EQUAL_INT(subpage ^ 1, status);
+    subpage = status;
+  }
+  uint32_t elapsedMicros = nowMicros() - startMicros;
+
+  TEST_ASSERT_EQUAL_UINT32(MEASURED_SUBPAGES, acquisition.frames);
+  TEST_ASSERT_UINT32_WITHIN(PERIOD_MICROS, MEASURED_SUBPAGES * PERIOD_MICROS, elapsedMicros);
+
+  // Busy polling takes a poll per microsecond of bus time, the schedule a few per subpage
+  TEST_ASSERT_LESS_OR_EQUAL(4 * MEASURED_SUBPAGES, acquisition.polls);
+  TEST_ASSERT_LESS_OR_EQUAL(MEASURED_SUBPAGES / 2, acquisition.lateWakeups);
+
+  // The measured sleep fits into the elapsed time and covers most of it, the polling window the rest
+  TEST_ASSERT_LESS_OR_EQUAL(elapsedMicros, acquisition.sleptMicros + acquisition.wastedMicros);
+  TEST_ASSERT_GREATER_OR_EQUAL(elapsedMicros * 3 / 4, acquisition.sleptMicros);
+  TEST_ASSERT_LESS_OR_EQUAL(elapsedMicros / 4, acquisition.wastedMicros);
+}
+
+// A changed rate loses the phase, which is found again by polling
+void test_rate_switch_resynchronizes()
+{
+  for (int i = 0; i < WARMUP_SUBPAGES; i++)
+    TEST_ASSERT_GREATER_OR_EQUAL(0, acquisitionGetFrame(&acquisition, frameData));
+
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_SetRefreshRate(device, REFRESH_RATE + 1));
+  acquisitionSetRefreshRate(&acquisition, REFRESH_RATE + 1);
+  TEST_ASSERT_FALSE(acquisition.synced);
+
+  for (int i = 0; i < WARMUP_SUBPAGES; i++)
+    TEST_ASSERT_GREATER_OR_EQUAL(0, acquisitionGetFrame(&acquisition, frameData));
+  TEST_ASSERT_TRUE(acquisition.synced);
+  TEST_ASSERT_EQUAL_UINT32(PERIOD_MICROS / 2, acquisition.periodMicros);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_period_follows_the_refresh_rate);
+  RUN_TEST(test_synchronized_subpages_are_slept_for);
+  RUN_TEST(test_rate_switch_resynchronizes);
+  return UNITY_END();
+}
@@ -0,0 +1,171 @@
+// The compiled calibration against the reference calculation: pixel plans visit the pixels CalculateTo picks for
+// each mode and subpage, and CalculateToCompiled and GetImageCompiled reproduce its results bit for bit, as does
+// the SIMD part of the cached kernel its scalar loop
+#include <unity.h>
+
+#include <string.h>
+
+#include "MLX90640_API.h"
+#include "MLX90640_I2C_Driver.h"
+#include "MLX90640_Simulator.h"
+
+#define SENSOR_ADDRESS 0x33
+#define AMBIENTS 3
+#define FRAMES (2 * AMBIENTS * 2) // Modes, ambients, subpages
+
+static simulatorMLX90640 simulator;
+static transportMLX90640 transport;
+static int device;
+static paramsMLX90640 params;
+static compiledParamsMLX90640 compiled;
+static uint16_t frames[FRAMES][834];
+
+// Every pixel on its own temperature, from -40 to 300 degrees, so all four ranges of the To calculation are taken
+static void rampScene(void *arg, uint32_t frameNumber, float ta, float *to)
+{
+  (void)arg;
+  (void)ta;
+  for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    to[pixelNumber] = -40 + ((pixelNumber * 37 + frameNumber) % 768) * (340.0f / 767);
+}
+
+void setUp()
+{
+  static const float ambients[AMBIENTS] = {-10, 25, 70};
+  uint16_t eeData[832];
+  int frame = 0;
+
+  MLX90640_SimulatorSyntheticEE(eeData);
+  MLX90640_SimulatorInit(&simulator, SENSOR_ADDRESS, eeData, false);
+  MLX90640_SimulatorSetScene(&simulator, rampScene, NULL);
+  MLX90640_SimulatorTransport(&simulator, &transport);
+  device = MLX90640_I2CAttach(SENSOR_ADDRESS, &transport);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, device);
+
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_ExtractParameters(eeData, &params));
+  MLX90640_CompileParameters(&params, &compiled);
+
+  for (int mode = 0; mode < 2; mode++)
+  {
+    TEST_ASSERT_EQUAL_INT(0, mode ? MLX90640_SetChessMode(device) : MLX90640_SetInterleavedMode(device));
+    for (int a = 0; a < AMBIENTS; a++)
+    {
+      MLX90640_SimulatorSetAmbient(&simulator, ambients[a]);
+      for (int s = 0; s < 2; s++, frame++)
+        TEST_ASSERT_GREATER_OR_EQUAL(0, MLX90640_GetFrameData(device, frames[frame]));
+    }
+  }
+}
+
+void tearDown()
+{
+  MLX90640_I2CDetach(device);
+}
+
+// Each plan holds, in ascending order, the pixels CalculateTo selects for its mode and subpage, with the same
+// interleave and conversion patterns
+void test_plans_match_the_pixel_patterns()
+{
+  for (int mode = 0; mode < 2; mode++)
+    for (int subPage = 0; subPage < 2; subPage++)
+    {
+      const pixelPlanMLX90640 *plan = &compiled.plan[mode][subPage];
+      int entry = 0;
+      for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+      {
+        int8_t ilPattern = pixelNumber / 32 - (pixelNumber / 64) * 2;
+        int8_t chessPattern = ilPattern ^ (pixelNumber - (pixelNumber / 2) * 2);
+        int8_t conversionPattern = ((pixelNumber + 2) / 4 - (pixelNumber + 3) / 4 + (pixelNumber + 1) / 4 - pixelNumber / 4) * (1 - 2 * ilPattern);
+        if ((mode == 0 ? ilPattern : chessPattern) != subPage)
+          continue;
+
+        TEST_ASSERT_LESS_THAN(384, entry);
+        TEST_ASSERT_EQUAL_INT(pixelNumber, plan->pixel[entry]);
+        TEST_ASSERT_EQUAL_INT(ilPattern, plan->ilPattern[entry]);
+        TEST_ASSERT_EQUAL_INT(conversionPattern, plan->conversionPattern[entry]);
+        entry++;
+      }
+      TEST_ASSERT_EQUAL_INT(384, entry);
+    }
+}
+
+void test_frames_cover_both_modes_and_subpages()
+{
+  int seen[2][2] = {{0, 0}, {0, 0}};
+  for (int frame = 0; frame < FRAMES; frame++)
+    seen[(frames[frame][832] & 0x1000) >> 12][frames[frame][833]]++;
+  for (int mode = 0; mode < 2; mode++)
+    for (int subPage = 0; subPage < 2; subPage++)
+      TEST_ASSERT_EQUAL_INT(AMBIENTS, seen[mode][subPage]);
+}
+
+void test_compiled_to_is_bit_identical()
+{
+  static const float emissivities[2] = {1, 0.95f};
+  float expected[768];
+  float actual[768];
+
+  for (int frame = 0; frame < FRAMES; frame++)
+    for (int e = 0; e < 2; e++)
+    {
+      // Pixels of the other subpage are left alone by both, so the whole frame compares
+      memset(expected, 0, sizeof(expected));
+      memset(actual, 0, sizeof(actual));
+      MLX90640_CalculateTo(frames[frame], &params, emissivities[e], 23, expected);
+      MLX90640_CalculateToCompiled(frames[frame], &params, &compiled, emissivities[e], 23, actual);
+      TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+    }
+}
+
+void test_compiled_image_is_bit_identical()
+{
+  float expected[768];
+  float actual[768];
+
+  for (int frame = 0; frame < FRAMES; frame++)
+  {
+    memset(expected, 0, sizeof(expected));
+    memset(actual, 0, sizeof(actual));
+    MLX90640_GetImage(frames[frame], &params, expected);
+    MLX90640_GetImageCompiled(frames[frame], &params, &compiled, actual);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+  }
+}
+
+// The cached kernel runs four plan entries at a time on the SIMD layer: parts of three entries leave every pixel to
+// its scalar loop, which has to give the same bits
+void test_cached_blocks_match_the_scalar_loop()
+{
+  static const float emissivities[2] = {1, 0.95f};
+  frameContextMLX90640 context;
+  float expected[768];
+  float actual[768];
+
+  MLX90640_InitFrameContext(&context, 0.005f, 0.1f);
+  for (int frame = 0; frame < FRAMES; frame++)
+  {
+    MLX90640_UpdateFrameContext(frames[frame], &params, &compiled, &context);
+    for (int e = 0; e < 2; e++)
+    {
+      memset(expected, 0, sizeof(expected));
+      memset(actual, 0, sizeof(actual));
+      for (int part = 0; part < 128; part++)
+        MLX90640_CalculateToCachedPart(frames[frame], &params, &compiled, &context, emissivities[e], 23, expected, part, 128);
+      MLX90640_CalculateToCached(frames[frame], &params, &compiled, &context, emissivities[e], 23, actual);
+      TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_plans_match_the_pixel_patterns);
+  RUN_TEST(test_frames_cover_both_modes_and_subpages);
+  RUN_TEST(test_compiled_to_is_bit_identical);
+  RUN_TEST(test_compiled_image_is_bit_identical);
+  RUN_TEST(test_cached_blocks_match_the_scalar_loop);
+  return UNITY_END();
+}
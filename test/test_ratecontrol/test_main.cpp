@@ -0,0 +1,204 @@
+// Rate control closing the loop over a simulated sensor: every subpage is read, calculated and measured as the
+// sensor's task does it, on a simulated clock that advances by the subpage period of the rate in force, and the
+// decisions are written back to the sensor's control register like sensorAdaptRate does
+#include <unity.h>
+
+#include <vector>
+
+#include "MLX90640_API.h"
+#include "MLX90640_I2C_Driver.h"
+#include "MLX90640_Simulator.h"
+#include "ratecontrol.h"
+
+#define SENSOR_ADDRESS 0x33
+#define MIN_RATE 0x02 // 2 subpages per second
+#define MAX_RATE 0x06 // 32
+#define MAX_RESOLUTION 0x03 // 19 bit
+#define DWELL_MICROS 3000000
+#define FAST_PIPELINE_MICROS 1000 // Busy time per subpage that leaves capacity for every rate
+#define SLOW_PIPELINE_MICROS 40000 // 25 subpages per second at most
+
+static simulatorMLX90640 simulator;
+static transportMLX90640 transport;
+static int device;
+static paramsMLX90640 params;
+static compiledParamsMLX90640 compiled;
+static frameContextMLX90640 context;
+static RateControl rc;
+static uint16_t frameData[834];
+static float frame[768];
+static uint32_t now;
+static std::vector<uint32_t> switchMicros;
+
+static void stillScene(void *arg, uint32_t frameNumber, float ta, float *to)
+{
+  (void)arg;
+  (void)frameNumber;
+  for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    to[pixelNumber] = ta + 2 + (pixelNumber / 32) * 0.125f;
+}
+
+// Warm and cool columns scrolling by one every subpage
+static void movingScene(void *arg, uint32_t frameNumber, float ta, float *to)
+{
+  (void)arg;
+  for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    to[pixelNumber] = ta + ((pixelNumber + frameNumber) % 8 < 4 ? 10 : 2);
+}
+
+// Hot enough to saturate the raw pixel words
+static void hotScene(void *arg, uint32_t frameNumber, float ta, float *to)
+{
+  (void)arg;
+  (void)frameNumber;
+  (void)ta;
+  for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    to[pixelNumber] = pixelNumber % 32 < 16 ? 300 : 25;
+}
+
+static int sensorRate()
+{
+  return MLX90640_GetRefreshRate(device);
+}
+
+static int sensorResolution()
+{
+  return MLX90640_GetCurResolution(device);
+}
+
+// Simulated seconds of the sensor's task, each subpage costing busyMicros of reading and calculating
+static void run(float seconds, uint32_t busyMicros)
+{
+  uint32_t end = now + (uint32_t)(seconds * 1e6f);
+  while ((int32_t)(end - now) > 0)
+  {
+    TEST_ASSERT_GREATER_OR_EQUAL(0, MLX90640_GetFrameData(device, frameData));
+    MLX90640_UpdateFrameContext(frameData, &params, &compiled, &context);
+    MLX90640_CalculateToCached(frameData, &params, &compiled, &context, 1, context.ta, frame);
+    rateControlSubpage(&rc, frameData, frame, busyMicros);
+    now += (uint32_t)(1e6f / rateControlSubpageRate(rc.refreshRate));
+
+    uint8_t refreshRate;
+    uint8_t resolution;
+    if (!rateControlUpdate(&rc, now, &refreshRate, &resolution))
+      continue;
+    TEST_ASSERT_EQUAL_INT(0, MLX90640_SetRefreshRate(device, refreshRate));
+    TEST_ASSERT_EQUAL_INT(0, MLX90640_SetResolution(device, resolution));
+    rateControlSwitched(&rc, refreshRate, resolution, now);
+    switchMicros.push_back(now);
+  }
+}
+
+static void begin(uint8_t refreshRate, uint8_t resolution)
+{
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_SetRefreshRate(device, refreshRate));
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_SetResolution(device, resolution));
+  rateControlBegin(&rc, refreshRate, resolution, MIN_RATE, MAX_RATE, 1, now);
+}
+
+static void assertDwellKept()
+{
+  for (size_t i = 1; i < switchMicros.size(); i++)
+    TEST_ASSERT_GREATER_OR_EQUAL(DWELL_MICROS, switchMicros[i] - switchMicros[i - 1]);
+}
+
+void setUp()
+{
+  uint16_t eeData[832];
+  MLX90640_SimulatorSyntheticEE(eeData);
+  MLX90640_SimulatorInit(&simulator, SENSOR_ADDRESS, eeData, false);
+  MLX90640_SimulatorSetAmbient(&simulator, 25);
+  MLX90640_SimulatorTransport(&simulator, &transport);
+  device = MLX90640_I2CAttach(SENSOR_ADDRESS, &transport);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, device);
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_ExtractParameters(eeData, &params));
+  MLX90640_CompileParameters(&params, &compiled);
+  MLX90640_InitFrameContext(&context, 0.005f, 0.1f);
+  now = 0;
+  switchMicros.clear();
+}
+
+void tearDown()
+{
+  MLX90640_I2CDetach(device);
+}
+
+// One step per dwell time, down to the slowest rate, and the sensor follows
+void test_still_scene_steps_down_to_the_min_rate()
+{
+  MLX90640_SimulatorSetScene(&simulator, stillScene, NULL);
+  begin(0x05, MAX_RESOLUTION);
+  run(30, FAST_PIPELINE_MICROS);
+
+  TEST_ASSERT_EQUAL_INT(MIN_RATE, rc.refreshRate);
+  TEST_ASSERT_EQUAL_INT(MIN_RATE, sensorRate());
+  TEST_ASSERT_EQUAL_INT(MAX_RESOLUTION, sensorResolution());
+  TEST_ASSERT_EQUAL_UINT32(0x05 - MIN_RATE, rc.switches);
+  assertDwellKept();
+}
+
+void test_moving_scene_steps_up_to_the_max_rate()
+{
+  MLX90640_SimulatorSetScene(&simulator, movingScene, NULL);
+  begin(MIN_RATE, MAX_RESOLUTION);
+  run(30, FAST_PIPELINE_MICROS);
+
+  TEST_ASSERT_TRUE(rc.motion >= 0.02f);
+  TEST_ASSERT_EQUAL_INT(MAX_RATE, rc.refreshRate);
+  TEST_ASSERT_EQUAL_INT(MAX_RATE, sensorRate());
+  TEST_ASSERT_EQUAL_UINT32(MAX_RATE - MIN_RATE, rc.switches);
+  assertDwellKept();
+}
+
+// A slow pipeline takes 25 subpages per second: motion climbs only to 16, which leaves a quarter of headroom
+void test_moving_scene_climbs_only_within_capacity()
+{
+  MLX90640_SimulatorSetScene(&simulator, movingScene, NULL);
+  begin(MIN_RATE, MAX_RESOLUTION);
+  run(30, SLOW_PIPELINE_MICROS);
+
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 25, rc.capacity);
+  TEST_ASSERT_EQUAL_INT(0x05, rc.refreshRate);
+  TEST_ASSERT_EQUAL_INT(0x05, sensorRate());
+}
+
+// Too fast for the pipeline from the start: dropped at the first evaluation after the dwell, in one switch
+void test_overload_drops_the_rate_at_once()
+{
+  MLX90640_SimulatorSetScene(&simulator, movingScene, NULL);
+  begin(MAX_RATE, MAX_RESOLUTION);
+  run(DWELL_MICROS / 1e6f + 1.5f, SLOW_PIPELINE_MICROS);
+
+  TEST_ASSERT_EQUAL_UINT32(1, rc.switches);
+  TEST_ASSERT_EQUAL_INT(0x05, sensorRate()); // 16 subpages per second, the fastest under 90% of 25
+}
+
+// Saturated words step the resolution down, one step per dwell, and a cooler scene brings it back
+void test_clipping_steps_the_resolution_down_and_back()
+{
+  MLX90640_SimulatorSetScene(&simulator, hotScene, NULL);
+  begin(0x04, MAX_RESOLUTION);
+  run(4, FAST_PIPELINE_MICROS);
+  TEST_ASSERT_EQUAL_INT(MAX_RESOLUTION - 1, sensorResolution());
+  run(8, FAST_PIPELINE_MICROS);
+  TEST_ASSERT_EQUAL_INT(0x00, sensorResolution());
+  TEST_ASSERT_EQUAL_INT(0x00, rc.resolution);
+
+  MLX90640_SimulatorSetScene(&simulator, stillScene, NULL);
+  run(12, FAST_PIPELINE_MICROS);
+  TEST_ASSERT_EQUAL_INT(MAX_RESOLUTION, sensorResolution());
+  assertDwellKept();
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_still_scene_steps_down_to_the_min_rate);
+  RUN_TEST(test_moving_scene_steps_up_to_the_max_rate);
+  RUN_TEST(test_moving_scene_climbs_only_within_capacity);
+  RUN_TEST(test_overload_drops_the_rate_at_once);
+  RUN_TEST(test_clipping_steps_the_resolution_down_and_back);
+  return UNITY_END();
+}
@@ -0,0 +1,156 @@
+// Raw recorder on the host: a sensor's 64 Hz subpage stream reaches the file whole and in order, write errors
+// lose only their batch, and the recording can be ended while subpages are still being recorded
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "recorder.h"
+
+#define RECORDING_PATH "test_recorder.mlx"
+#define SUBPAGE_MICROS 15625 // Refresh rate 0x07, 64 subpages per second
+#define SUSTAINED_SUBPAGES 128
+#define RING_SLOTS 16 // A quarter of a second at 64 Hz
+
+static uint16_t eeData[RECORDING_EE_WORDS];
+
+static void fillSubpage(uint16_t *frameData, uint32_t number)
+{
+  for (int i = 0; i < RECORDING_FRAME_WORDS; i++)
+    frameData[i] = (uint16_t)(number * 31 + i);
+  frameData[833] = number & 1;
+}
+
+static long fileSize(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return -1;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+void setUp()
+{
+  for (int i = 0; i < RECORDING_EE_WORDS; i++)
+    eeData[i] = (uint16_t)(i ^ 0x5A5A);
+}
+
+void tearDown()
+{
+  recorderEnd();
+  remove(RECORDING_PATH);
+}
+
+// One subpage every 15.6 ms through a small ring: none lost, every record whole and in order
+void test_sustains_64_hz_without_loss()
+{
+  uint16_t frameData[RECORDING_FRAME_WORDS];
+  TEST_ASSERT_TRUE(recorderBegin(RECORDING_PATH, eeData, RING_SLOTS, 0));
+  TEST_ASSERT_TRUE(recorderActive());
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < SUSTAINED_SUBPAGES; n++)
+  {
+    std::this_thread::sleep_until(start + std::chrono::microseconds(n * SUBPAGE_MICROS));
+    fillSubpage(frameData, n);
+    TEST_ASSERT_TRUE(recorderRecord(frameData, n * SUBPAGE_MICROS));
+  }
+  recorderEnd();
+  TEST_ASSERT_FALSE(recorderActive());
+
+  RecorderStats stats;
+  recorderGetStats(&stats);
+  TEST_ASSERT_EQUAL_UINT32(SUSTAINED_SUBPAGES, stats.recorded);
+  TEST_ASSERT_EQUAL_UINT32(SUSTAINED_SUBPAGES, stats.written);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.overruns);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.writeErrors);
+  TEST_ASSERT_LESS_THAN(RING_SLOTS, stats.maxFill);
+
+  FILE *file = fopen(RECORDING_PATH, "rb");
+  TEST_ASSERT_NOT_NULL(file);
+  RecordingHeader header;
+  TEST_ASSERT_EQUAL(1, fread(&header, sizeof(header), 1, file));
+  TEST_ASSERT_EQUAL_MEMORY(RECORDING_MAGIC, header.magic, sizeof(header.magic));
+  TEST_ASSERT_EQUAL_UINT16(sizeof(RecordingFrame), header.frameBytes);
+  TEST_ASSERT_EQUAL_MEMORY(eeData, header.eeData, sizeof(eeData));
+
+  std::vector<RecordingFrame> frames(SUSTAINED_SUBPAGES + 1);
+  TEST_ASSERT_EQUAL(SUSTAINED_SUBPAGES, fread(frames.data(), sizeof(RecordingFrame), frames.size(), file));
+  fclose(file);
+  for (uint32_t n = 0; n < SUSTAINED_SUBPAGES; n++)
+  {
+    fillSubpage(frameData, n);
+    TEST_ASSERT_EQUAL_UINT32(n * SUBPAGE_MICROS, frames[n].micros);
+    TEST_ASSERT_EQUAL_UINT16(0, frames[n].dropped);
+    TEST_ASSERT_EQUAL_MEMORY(frameData, frames[n].frameData, sizeof(frameData));
+  }
+}
+
+// A device that fails every write: batches are counted as errors and dropped, recording never blocks
+void test_write_errors_lose_their_batches()
+{
+  uint16_t frameData[RECORDING_FRAME_WORDS];
+  if (fileSize("/dev/full") < 0) TEST_IGNORE_MESSAGE("needs /dev/full");
+  TEST_ASSERT_TRUE(recorderBegin("/dev/full", eeData, 4 * RING_SLOTS, 0)); // The header is still buffered
+
+  for (uint32_t n = 0; n < 2 * RING_SLOTS; n++)
+  {
+    fillSubpage(frameData, n);
+    recorderRecord(frameData, n);
+  }
+  recorderEnd();
+
+  RecorderStats stats;
+  recorderGetStats(&stats);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.written);
+  TEST_ASSERT_GREATER_THAN(0, stats.writeErrors);
+  TEST_ASSERT_EQUAL_UINT32(2 * RING_SLOTS, stats.recorded + stats.overruns);
+}
+
+// Ending from another thread while the producer keeps recording leaves only whole records behind
+void test_end_while_recording()
+{
+  std::atomic<bool> stop(false);
+  std::atomic<uint32_t> accepted(0);
+  TEST_ASSERT_TRUE(recorderBegin(RECORDING_PATH, eeData, RING_SLOTS, 0));
+
+  std::thread producer([&] {
+    uint16_t frameData[RECORDING_FRAME_WORDS];
+    for (uint32_t n = 0; !stop.load(); n++)
+    {
+      fillSubpage(frameData, n);
+      if (recorderRecord(frameData, n)) accepted++;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  recorderEnd();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  stop.store(true);
+  producer.join();
+
+  RecorderStats stats;
+  uint16_t frameData[RECORDING_FRAME_WORDS] = {0};
+  recorderGetStats(&stats);
+  TEST_ASSERT_FALSE(recorderRecord(frameData, 0));
+  TEST_ASSERT_GREATER_THAN(0, stats.written);
+  TEST_ASSERT_EQUAL_UINT32(accepted.load(), stats.recorded); // Nothing taken after the end
+  TEST_ASSERT_EQUAL_UINT32(stats.recorded, stats.written);
+  TEST_ASSERT_EQUAL(sizeof(RecordingHeader) + (long)stats.written * sizeof(RecordingFrame), fileSize(RECORDING_PATH));
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_sustains_64_hz_without_loss);
+  RUN_TEST(test_write_errors_lose_their_batches);
+  RUN_TEST(test_end_while_recording);
+  return UNITY_END();
+}
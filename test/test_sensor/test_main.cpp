@@ -0,0 +1,152 @@
+// Sensor instances: two simulated sensors read by their own tasks publish frames through their triple buffers, and
+// stitched frames keep every column outside the overlaps and cross-fade the ones inside
+#include <unity.h>
+
+#include <chrono>
+#include <thread>
+
+#include "MLX90640_Simulator.h"
+#include "sensor.h"
+
+#define SENSOR_ADDRESS 0x33
+#define SENSORS 2
+#define OVERLAP 4
+
+static simulatorMLX90640 simulators[SENSORS];
+static transportMLX90640 transports[SENSORS];
+static ThermalSensor sensors[SENSORS];
+static float frames[3][SENSOR_MATRIX_SIZE];
+static float stitched[SENSOR_MATRIX_Y * 3 * SENSOR_MATRIX_X];
+
+// Sensor k sees 10 degrees more than sensor k - 1, uniformly
+static void flatScene(void *arg, uint32_t frameNumber, float ta, float *to)
+{
+  (void)frameNumber;
+  (void)ta;
+  for (int pixelNumber = 0; pixelNumber < SENSOR_MATRIX_SIZE; pixelNumber++)
+    to[pixelNumber] = 20 + 10 * (int)(intptr_t)arg;
+}
+
+void setUp()
+{
+  uint16_t eeData[832];
+
+  MLX90640_SimulatorSyntheticEE(eeData);
+  for (int k = 0; k < SENSORS; k++)
+  {
+    MLX90640_SimulatorInit(&simulators[k], SENSOR_ADDRESS + k, eeData, false);
+    MLX90640_SimulatorSetScene(&simulators[k], flatScene, (void *)(intptr_t)k);
+    MLX90640_SimulatorTransport(&simulators[k], &transports[k]);
+    TEST_ASSERT_EQUAL_INT(0, sensorInit(&sensors[k], SENSOR_ADDRESS + k, &transports[k]));
+    sensors[k].emissivity = 1; // The simulator's scene is what CalculateTo gives back with emissivity 1
+  }
+}
+
+void tearDown()
+{
+  for (int k = 0; k < SENSORS; k++)
+  {
+    sensorStop(&sensors[k]);
+    MLX90640_I2CDetach(sensors[k].device);
+  }
+}
+
+void test_stitched_width()
+{
+  TEST_ASSERT_EQUAL_INT(32, sensorStitchedWidth(1, OVERLAP));
+  TEST_ASSERT_EQUAL_INT(64, sensorStitchedWidth(2, 0));
+  TEST_ASSERT_EQUAL_INT(60, sensorStitchedWidth(2, OVERLAP));
+  TEST_ASSERT_EQUAL_INT(88, sensorStitchedWidth(3, OVERLAP));
+}
+
+// Columns of a single sensor are copied, overlapping ones ramp from one sensor to the next and sum to one
+void test_stitch_cross_fades_the_overlap()
+{
+  for (int k = 0; k < 3; k++)
+    for (int i = 0; i < SENSOR_MATRIX_SIZE; i++)
+      frames[k][i] = 10 * (k + 1) + i % SENSOR_MATRIX_X * 0.001f;
+  const float *inputs[3] = {frames[0], frames[1], frames[2]};
+  sensorStitch(inputs, 3, OVERLAP, stitched);
+
+  int width = sensorStitchedWidth(3, OVERLAP);
+  for (int h = 0; h < SENSOR_MATRIX_Y; h++)
+    for (int c = 0; c < width; c++)
+    {
+      float value = stitched[h * width + c];
+      int k = c / (SENSOR_MATRIX_X - OVERLAP);
+      int column = c - k * (SENSOR_MATRIX_X - OVERLAP);
+      if (k > 2)
+      {
+        k = 2;
+        column = c - 2 * (SENSOR_MATRIX_X - OVERLAP);
+      }
+      if (k > 0 && column < OVERLAP)
+      {
+        // Shared with the previous sensor's last columns
+        float weight = (float)(column + 1) / (OVERLAP + 1);
+        float expected = weight * frames[k][column] + (1 - weight) * frames[k - 1][SENSOR_MATRIX_X - OVERLAP + column];
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected, value);
+      }
+      else
+        TEST_ASSERT_FLOAT_WITHIN(1e-6f, frames[k][column], value);
+    }
+}
+
+// Both tasks publish while this thread takes, and the frames stitch to the two scenes side by side
+void test_started_sensors_publish_frames()
+{
+  uint16_t eeData[832];
+  for (int k = 0; k < SENSORS; k++)
+  {
+    TEST_ASSERT_EQUAL_INT(0, sensorReadParameters(&sensors[k], eeData));
+    TEST_ASSERT_EQUAL_INT(0, sensorConfigure(&sensors[k], 0x07, 0x03, 0x07, 0x07, 1));
+    TEST_ASSERT_TRUE(sensorStart(&sensors[k], k));
+  }
+
+  // Taken while the tasks keep publishing. From the second frame on both subpages have been read into it, and
+  // taking no more keeps it in the front slot, which the tasks leave alone
+  const float *inputs[SENSORS];
+  int taken[SENSORS] = {0, 0};
+  for (int i = 0; i < 200 && (taken[0] < 2 || taken[1] < 2); i++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    for (int k = 0; k < SENSORS; k++)
+    {
+      if (taken[k] == 2) continue;
+      bool fresh;
+      SensorFrame *frame = tripleBufferTake(&sensors[k].frames, &fresh);
+      if (fresh)
+      {
+        inputs[k] = frame->temp;
+        taken[k]++;
+      }
+    }
+  }
+  for (int k = 0; k < SENSORS; k++)
+  {
+    sensorStop(&sensors[k]);
+    TEST_ASSERT_EQUAL_INT(2, taken[k]);
+    TEST_ASSERT_EQUAL_INT(0, sensors[k].errors);
+  }
+  sensorStitch(inputs, SENSORS, OVERLAP, stitched);
+
+  int width = sensorStitchedWidth(SENSORS, OVERLAP);
+  for (int h = 0; h < SENSOR_MATRIX_Y; h++)
+  {
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 20, stitched[h * width]);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 30, stitched[h * width + width - 1]);
+    for (int c = 1; c < width; c++)
+      TEST_ASSERT_TRUE(stitched[h * width + c] >= stitched[h * width + c - 1] - 0.5f);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_stitched_width);
+  RUN_TEST(test_stitch_cross_fades_the_overlap);
+  RUN_TEST(test_started_sensors_publish_frames);
+  return UNITY_END();
+}
@@ -0,0 +1,38 @@
+// The kernels of simd.h built once more on the scalar backend. They are inline, so this build lives in its own
+// namespace to link next to the native one, and is reached through the wrappers below
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "scalar.h"
+
+#define SIMD_FORCE_SCALAR
+namespace scalar
+{
+#include "simd.h"
+}
+
+void scalarAverage(float *out, const float *in, int n)
+{
+  scalar::simdAverage(out, in, n);
+}
+
+void scalarAverageReversed(float *out, const float *in, int n, bool averaging)
+{
+  scalar::simdAverageReversed(out, in, n, averaging);
+}
+
+void scalarAffine(const float *in, float *out, int n, float scale, float bias)
+{
+  scalar::simdAffine(in, out, n, scale, bias);
+}
+
+void scalarMultiply(const float *a, const float *b, float *out, int n)
+{
+  scalar::simdMultiply(a, b, out, n);
+}
+
+void scalarMinMax(const float *in, int n, float *min, float *max)
+{
+  scalar::simdMinMax(in, n, min, max);
+}
@@ -0,0 +1,11 @@
+// simd.h kernels on the scalar backend, see scalar.cpp
+#ifndef TEST_SIMD_SCALAR_H
+#define TEST_SIMD_SCALAR_H
+
+void scalarAverage(float *out, const float *in, int n);
+void scalarAverageReversed(float *out, const float *in, int n, bool averaging);
+void scalarAffine(const float *in, float *out, int n, float scale, float bias);
+void scalarMultiply(const float *a, const float *b, float *out, int n);
+void scalarMinMax(const float *in, int n, float *min, float *max);
+
+#endif
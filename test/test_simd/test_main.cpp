@@ -0,0 +1,175 @@
+// Every kernel of simd.h on the backend this build picked (SSE or NEON on a host) against SIMD_FORCE_SCALAR: the
+// same bits for whole vectors and every tail length, then their throughput side by side in pixels per microsecond
+#include <unity.h>
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "scalar.h"
+#include "simd.h"
+
+#define PIXELS 768
+#define MAX_LENGTH (PIXELS + 7)
+#define REPORT_ROUNDS 20000
+
+static float in[MAX_LENGTH];
+static float other[MAX_LENGTH];
+static float expected[MAX_LENGTH];
+static float actual[MAX_LENGTH];
+
+// Lengths with every remainder modulo the vector width, around the sizes the firmware passes
+static const int lengths[] = {1, 2, 3, 4, 5, 7, 8, 31, 32, 33, 767, PIXELS, PIXELS + 1, PIXELS + 7};
+
+static uint32_t nowMicros()
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Temperatures over the sensor range, with a fraction that rounds differently in every operation
+static void fill(float *values, uint32_t seed)
+{
+  for (int i = 0; i < MAX_LENGTH; i++)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    values[i] = -40 + (seed >> 8) * (340.0f / (1 << 24));
+  }
+}
+
+void setUp()
+{
+  fill(in, 1);
+  fill(other, 2);
+}
+
+void tearDown()
+{
+}
+
+void test_average_matches_scalar()
+{
+  for (int n : lengths)
+  {
+    memcpy(expected, other, sizeof(expected));
+    memcpy(actual, other, sizeof(actual));
+    scalarAverage(expected, in, n);
+    simdAverage(actual, in, n);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+  }
+}
+
+void test_average_reversed_matches_scalar()
+{
+  for (int averaging = 0; averaging < 2; averaging++)
+    for (int n : lengths)
+    {
+      memcpy(expected, other, sizeof(expected));
+      memcpy(actual, other, sizeof(actual));
+      scalarAverageReversed(expected, in, n, averaging);
+      simdAverageReversed(actual, in, n, averaging);
+      TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+    }
+}
+
+void test_affine_matches_scalar()
+{
+  for (int n : lengths)
+  {
+    memset(expected, 0, sizeof(expected));
+    memset(actual, 0, sizeof(actual));
+    scalarAffine(in, expected, n, 0.0037f, 1);
+    simdAffine(in, actual, n, 0.0037f, 1);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+  }
+}
+
+void test_multiply_matches_scalar()
+{
+  for (int n : lengths)
+  {
+    memset(expected, 0, sizeof(expected));
+    memset(actual, 0, sizeof(actual));
+    scalarMultiply(in, other, expected, n);
+    simdMultiply(in, other, actual, n);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, sizeof(expected));
+  }
+}
+
+void test_min_max_matches_scalar()
+{
+  for (int n : lengths)
+    for (int offset = 0; offset < 4; offset++) // Extremes in every lane and in the tail
+    {
+      float min[2];
+      float max[2];
+      int coldest = (n - 1) * offset / 3;
+      int hottest = (n - 1) * (3 - offset) / 3;
+      fill(actual, n + offset);
+      actual[coldest] = -41;
+      actual[hottest] = 301;
+      scalarMinMax(actual, n, &min[0], &max[0]);
+      simdMinMax(actual, n, &min[1], &max[1]);
+      TEST_ASSERT_EQUAL_MEMORY(&min[0], &min[1], sizeof(float));
+      TEST_ASSERT_EQUAL_MEMORY(&max[0], &max[1], sizeof(float));
+      TEST_ASSERT_TRUE(min[1] == -41 || coldest == hottest);
+      TEST_ASSERT_TRUE(max[1] == 301);
+    }
+}
+
+// Report only, timing on a shared host is no pass criterion
+void test_report_throughput()
+{
+  static const char *kernels[] = {"simdAverage", "simdAverageReversed", "simdAffine", "simdMultiply", "simdMinMax"};
+  float min;
+  float max;
+
+  printf("%-20s %12s %12s %8s  pixels/us\n", "kernel", SIMD_BACKEND_NAME, "scalar", "speedup");
+  for (int kernel = 0; kernel < 5; kernel++)
+  {
+    double rates[2];
+    for (int backend = 0; backend < 2; backend++)
+    {
+      bool native = backend == 0;
+      uint32_t start = nowMicros();
+      for (int round = 0; round < REPORT_ROUNDS; round++)
+      {
+        switch (kernel)
+        {
+        case 0:
+          native ? simdAverage(actual, in, PIXELS) : scalarAverage(actual, in, PIXELS);
+          break;
+        case 1:
+          native ? simdAverageReversed(actual, in, PIXELS, true) : scalarAverageReversed(actual, in, PIXELS, true);
+          break;
+        case 2:
+          native ? simdAffine(in, actual, PIXELS, 0.0037f, 1) : scalarAffine(in, actual, PIXELS, 0.0037f, 1);
+          break;
+        case 3:
+          native ? simdMultiply(in, other, actual, PIXELS) : scalarMultiply(in, other, actual, PIXELS);
+          break;
+        case 4:
+          native ? simdMinMax(in, PIXELS, &min, &max) : scalarMinMax(in, PIXELS, &min, &max);
+          in[round % PIXELS] += min - max; // Keeps the calls from being hoisted out of the loop
+          break;
+        }
+      }
+      uint32_t micros = nowMicros() - start;
+      rates[backend] = (double)REPORT_ROUNDS * PIXELS / (micros ? micros : 1);
+    }
+    printf("%-20s %12.0f %12.0f %7.2fx\n", kernels[kernel], rates[0], rates[1], rates[0] / rates[1]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_average_matches_scalar);
+  RUN_TEST(test_average_reversed_matches_scalar);
+  RUN_TEST(test_affine_matches_scalar);
+  RUN_TEST(test_multiply_matches_scalar);
+  RUN_TEST(test_min_max_matches_scalar);
+  RUN_TEST(test_report_throughput);
+  return UNITY_END();
+}
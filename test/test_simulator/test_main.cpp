@@ -0,0 +1,152 @@
+// The sensor pipeline on the host: calibration, configuration, acquisition and temperature calculation of a
+// ThermalSensor, talking to a simulated MLX90640 through its transport as it would to Wire
+#include <unity.h>
+
+#include "MLX90640_Simulator.h"
+#include "sensor.h"
+
+#define SENSOR_ADDRESS 0x33
+
+static simulatorMLX90640 simulator;
+static transportMLX90640 transport;
+static ThermalSensor sensor;
+static uint16_t eeData[832];
+
+// Still scene with a gradient over both axes, warmer by arg degrees
+static void gradientScene(void *arg, uint32_t frameNumber, float ta, float *to)
+{
+  (void)frameNumber;
+  (void)ta;
+  float base = 20 + *static_cast<const float *>(arg);
+  for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    to[pixelNumber] = base + (pixelNumber % 32) * 0.5f + (pixelNumber / 32) * 0.25f;
+}
+
+void setUp()
+{
+  uint16_t syntheticEE[832];
+  MLX90640_SimulatorSyntheticEE(syntheticEE);
+  MLX90640_SimulatorInit(&simulator, SENSOR_ADDRESS, syntheticEE, false);
+  MLX90640_SimulatorTransport(&simulator, &transport);
+  sensorInit(&sensor, SENSOR_ADDRESS, &transport);
+}
+
+void tearDown()
+{
+  MLX90640_I2CDetach(sensor.device);
+}
+
+void test_parameters_match_the_eeprom()
+{
+  paramsMLX90640 expected;
+  TEST_ASSERT_EQUAL_INT(0, sensorReadParameters(&sensor, eeData));
+  TEST_ASSERT_EQUAL_MEMORY(simulator.eeprom, eeData, sizeof(simulator.eeprom));
+
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_ExtractParameters(simulator.eeprom, &expected));
+  TEST_ASSERT_EQUAL_INT(expected.vdd25, sensor.params.vdd25);
+  TEST_ASSERT_EQUAL_INT(expected.vPTAT25, sensor.params.vPTAT25);
+  TEST_ASSERT_EQUAL_MEMORY(expected.offset, sensor.params.offset, sizeof(expected.offset));
+  TEST_ASSERT_EQUAL_MEMORY(expected.alpha, sensor.params.alpha, sizeof(expected.alpha));
+  TEST_ASSERT_EQUAL_MEMORY(expected.kta, sensor.params.kta, sizeof(expected.kta));
+}
+
+void test_configure_reaches_the_control_register()
+{
+  TEST_ASSERT_EQUAL_INT(0, sensorReadParameters(&sensor, eeData));
+  TEST_ASSERT_EQUAL_INT(0, sensorConfigure(&sensor, 0x07, 0x02, 0x01, 0x07, 1));
+
+  TEST_ASSERT_EQUAL_INT(0x07, MLX90640_GetRefreshRate(sensor.device));
+  TEST_ASSERT_EQUAL_INT(0x02, MLX90640_GetCurResolution(sensor.device));
+  TEST_ASSERT_EQUAL_INT(1, MLX90640_GetCurMode(sensor.device)); // Chess
+  TEST_ASSERT_EQUAL_HEX16(0x1B81, simulator.controlRegister1);
+}
+
+void test_subpages_alternate()
+{
+  uint16_t frameData[SENSOR_FRAME_WORDS];
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_GetFrameData(sensor.device, frameData));
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_GetSubPageNumber(frameData));
+  TEST_ASSERT_EQUAL_INT(1, MLX90640_GetFrameData(sensor.device, frameData));
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_GetFrameData(sensor.device, frameData));
+  TEST_ASSERT_EQUAL_INT(0, frameData[833]);
+}
+
+// Decoded with emissivity 1, the frame gives back the simulated scene
+void test_frame_decodes_to_the_scene()
+{
+  float warmer = 5;
+  float scene[768];
+  MLX90640_SimulatorSetScene(&simulator, gradientScene, &warmer);
+  MLX90640_SimulatorSetAmbient(&simulator, 28);
+  gradientScene(&warmer, 0, 28, scene);
+
+  TEST_ASSERT_EQUAL_INT(0, sensorReadParameters(&sensor, eeData));
+  TEST_ASSERT_EQUAL_INT(0, sensorConfigure(&sensor, 0x07, 0x03, 0x01, 0x07, 1));
+  sensor.emissivity = 1;
+
+  for (int i = 0; i < 4; i++)
+    TEST_ASSERT_GREATER_OR_EQUAL(0, sensorReadSubpage(&sensor));
+  TEST_ASSERT_EQUAL_UINT32(4, sensor.subpages);
+  TEST_ASSERT_EQUAL_UINT32(0, sensor.errors);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 28, sensor.ambientTemperature);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 3.3f, sensor.vdd);
+
+  for (int pixelNumber = 0; pixelNumber < 768; pixelNumber++)
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, scene[pixelNumber], sensor.frame[pixelNumber]);
+}
+
+// A recording comes back word for word, in a loop
+void test_recording_is_replayed()
+{
+  static uint16_t recording[3 * MLX90640_SIMULATOR_FRAME_WORDS];
+  uint16_t frameData[SENSOR_FRAME_WORDS];
+  for (int i = 0; i < 3 * MLX90640_SIMULATOR_FRAME_WORDS; i++)
+    recording[i] = (uint16_t)(i * 7);
+  for (int f = 0; f < 3; f++)
+    recording[f * MLX90640_SIMULATOR_FRAME_WORDS + 833] = f & 1;
+  MLX90640_SimulatorSetRecording(&simulator, recording, 3);
+
+  for (int f = 0; f < 4; f++)
+  {
+    const uint16_t *expected = &recording[(f % 3) * MLX90640_SIMULATOR_FRAME_WORDS];
+    TEST_ASSERT_EQUAL_INT(f % 3 & 1, MLX90640_GetFrameData(sensor.device, frameData));
+    TEST_ASSERT_EQUAL_MEMORY(expected, frameData, 832 * sizeof(uint16_t));
+  }
+}
+
+// Wire on the ESP32 returns no bytes for a read on a stuck bus: the driver recovers the bus and the read that
+// follows gets the frame, while a partial read is only retried
+void test_stuck_bus_is_recovered()
+{
+  uint16_t frameData[SENSOR_FRAME_WORDS];
+  busStatsMLX90640 stats;
+  TEST_ASSERT_EQUAL_INT(MLX90640_I2C_BUS_ERROR, MLX90640_I2CReceivedError(0, 1664));
+  TEST_ASSERT_EQUAL_INT(MLX90640_I2C_SHORT_READ, MLX90640_I2CReceivedError(64, 1664));
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_I2CReceivedError(1664, 1664));
+
+  TEST_ASSERT_EQUAL_INT(0, MLX90640_GetFrameData(sensor.device, frameData));
+  MLX90640_SimulatorSetStuckBus(&simulator, 1);
+  MLX90640_I2CResetStats();
+  TEST_ASSERT_EQUAL_INT(1, MLX90640_GetFrameData(sensor.device, frameData));
+  MLX90640_I2CGetStats(&stats);
+
+  TEST_ASSERT_EQUAL_INT(0, simulator.stuckBus);
+  TEST_ASSERT_EQUAL_INT(1, stats.recoveries);
+  TEST_ASSERT_EQUAL_INT(1, stats.busErrors);
+  TEST_ASSERT_EQUAL_INT(0, stats.shortReads);
+  TEST_ASSERT_EQUAL_INT(1, stats.retries);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_parameters_match_the_eeprom);
+  RUN_TEST(test_configure_reaches_the_control_register);
+  RUN_TEST(test_subpages_alternate);
+  RUN_TEST(test_frame_decodes_to_the_scene);
+  RUN_TEST(test_recording_is_replayed);
+  RUN_TEST(test_stuck_bus_is_recovered);
+  return UNITY_END();
+}
@@ -0,0 +1,120 @@
+// Triple buffer between a producer and a consumer thread: the consumer never sees a torn or older item, and
+// every published item is either taken or counted as dropped
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+
+#include "triplebuffer.h"
+
+#define ITEM_WORDS 768 // A temperature frame
+#define STRESS_ITEMS 200000
+
+struct Item
+{
+  uint32_t sequence;
+  uint32_t words[ITEM_WORDS];
+};
+
+static TripleBuffer<Item> buffer;
+
+static void publish(uint32_t sequence)
+{
+  Item *item = tripleBufferBack(&buffer);
+  item->sequence = sequence;
+  for (int i = 0; i < ITEM_WORDS; i++)
+    item->words[i] = sequence;
+  tripleBufferPublish(&buffer);
+}
+
+void setUp()
+{
+  tripleBufferInit(&buffer);
+}
+
+void tearDown()
+{
+}
+
+void test_take_before_publish_is_not_fresh()
+{
+  bool fresh = true;
+  TEST_ASSERT_FALSE(tripleBufferFresh(&buffer));
+  tripleBufferTake(&buffer, &fresh);
+  TEST_ASSERT_FALSE(fresh);
+  TEST_ASSERT_EQUAL_UINT32(0, buffer.taken);
+  TEST_ASSERT_EQUAL_UINT32(1, buffer.duplicates);
+}
+
+void test_take_gets_the_newest_item_once()
+{
+  bool fresh;
+  publish(1);
+  publish(2);
+  TEST_ASSERT_TRUE(tripleBufferFresh(&buffer));
+
+  Item *item = tripleBufferTake(&buffer, &fresh);
+  TEST_ASSERT_TRUE(fresh);
+  TEST_ASSERT_EQUAL_UINT32(2, item->sequence);
+  TEST_ASSERT_FALSE(tripleBufferFresh(&buffer));
+
+  item = tripleBufferTake(&buffer, &fresh);
+  TEST_ASSERT_FALSE(fresh);
+  TEST_ASSERT_EQUAL_UINT32(2, item->sequence); // The previous item again
+  TEST_ASSERT_EQUAL_UINT32(2, buffer.published);
+  TEST_ASSERT_EQUAL_UINT32(1, buffer.dropped);
+  TEST_ASSERT_EQUAL_UINT32(1, buffer.taken);
+  TEST_ASSERT_EQUAL_UINT32(1, buffer.duplicates);
+}
+
+// Both sides at full speed on their own threads, the consumer only takes when something is fresh
+void test_concurrent_items_are_whole_and_in_order()
+{
+  std::atomic<bool> done(false);
+  std::thread producer([&done] {
+    for (uint32_t sequence = 1; sequence <= STRESS_ITEMS; sequence++)
+      publish(sequence);
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t last = 0;
+  uint32_t torn = 0;
+  uint32_t reordered = 0;
+  while (last < STRESS_ITEMS)
+  {
+    bool finished = done.load(std::memory_order_acquire);
+    if (!tripleBufferFresh(&buffer))
+    {
+      if (finished) break;
+      std::this_thread::yield();
+      continue;
+    }
+
+    bool fresh;
+    const Item *item = tripleBufferTake(&buffer, &fresh);
+    TEST_ASSERT_TRUE(fresh); // Only this thread takes
+    for (int i = 0; i < ITEM_WORDS; i++)
+      if (item->words[i] != item->sequence) torn++;
+    if (item->sequence <= last) reordered++;
+    last = item->sequence;
+  }
+  producer.join();
+
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, reordered);
+  TEST_ASSERT_EQUAL_UINT32(STRESS_ITEMS, last); // The newest item always arrives
+  TEST_ASSERT_EQUAL_UINT32(STRESS_ITEMS, buffer.published);
+  TEST_ASSERT_EQUAL_UINT32(buffer.published, buffer.taken + buffer.dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, buffer.duplicates);
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_take_before_publish_is_not_fresh);
+  RUN_TEST(test_take_gets_the_newest_item_once);
+  RUN_TEST(test_concurrent_items_are_whole_and_in_order);
+  return UNITY_END();
+}
@@ -0,0 +1,186 @@
+// The worker on its host std::thread backend: workerWait is a barrier for the job workerRun handed over, a second
+// caller is turned away until then, and a subpage split across caller and worker matches the single core result
+// bit for bit, also with two sensors' callers competing for the worker
+#include <unity.h>
+
+#include <atomic>
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+#include "MLX90640_API.h"
+#include "MLX90640_I2C_Driver.h"
+#include "MLX90640_Simulator.h"
+#include "worker.h"
+
+#define SENSOR_ADDRESS 0x33
+#define FRAMES 8
+#define COMPETING_ROUNDS 2000
+
+// What main.cpp hands the worker for the second half of a subpage
+struct CalculationJob
+{
+  uint16_t *frameData;
+  float *result;
+};
+
+static paramsMLX90640 params;
+static compiledParamsMLX90640 compiled;
+static frameContextMLX90640 contexts[FRAMES];
+static uint16_t frames[FRAMES][834];
+static float expected[FRAMES][768];
+static std::atomic<bool> released(false);
+static std::atomic<int> started(0);
+
+static void calculateOnWorker(void *arg)
+{
+  CalculationJob *job = static_cast<CalculationJob *>(arg);
+  int frame = (job->frameData - frames[0]) / 834;
+  MLX90640_CalculateToCachedPart(job->frameData, &params, &compiled, &contexts[frame], 0.95f, 23, job->result, 1, 2);
+}
+
+// calculateTempValues in main.cpp: halves on both sides, or all of it here when the worker is taken. True if split
+static bool calculateSplit(int frame, float *result)
+{
+  CalculationJob job = {frames[frame], result};
+  if (!workerRun(calculateOnWorker, &job))
+  {
+    MLX90640_CalculateToCached(frames[frame], &params, &compiled, &contexts[frame], 0.95f, 23, result);
+    return false;
+  }
+  MLX90640_CalculateToCachedPart(frames[frame], &params, &compiled, &contexts[frame], 0.95f, 23, result, 0, 2);
+  workerWait();
+  return true;
+}
+
+static void blockingJob(void *arg)
+{
+  (void)arg;
+  started++;
+  while (!released)
+    std::this_thread::yield();
+}
+
+static void countingJob(void *arg)
+{
+  static_cast<std::atomic<int> *>(arg)->fetch_add(1);
+}
+
+void setUp()
+{
+  released = false;
+  started = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_wait_is_a_barrier()
+{
+  std::atomic<int> runs(0);
+  for (int i = 0; i < 1000; i++)
+  {
+    TEST_ASSERT_TRUE(workerRun(countingJob, &runs));
+    workerWait();
+    TEST_ASSERT_EQUAL_INT(i + 1, runs.load());
+  }
+}
+
+void test_second_caller_is_rejected_until_waited()
+{
+  std::atomic<int> runs(0);
+  TEST_ASSERT_TRUE(workerRun(blockingJob, NULL));
+  while (started == 0)
+    std::this_thread::yield();
+
+  bool accepted = true;
+  std::thread other([&] { accepted = workerRun(countingJob, &runs); });
+  other.join();
+  TEST_ASSERT_FALSE(accepted);
+  TEST_ASSERT_FALSE(workerRun(countingJob, &runs));
+
+  // Finished but not yet waited for still counts as taken
+  released = true;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  TEST_ASSERT_FALSE(workerRun(countingJob, &runs));
+  workerWait();
+
+  TEST_ASSERT_TRUE(workerRun(countingJob, &runs));
+  workerWait();
+  TEST_ASSERT_EQUAL_INT(1, runs.load());
+}
+
+void test_split_matches_single_core()
+{
+  float result[768];
+  for (int frame = 0; frame < FRAMES; frame++)
+  {
+    memset(result, 0, sizeof(result));
+    TEST_ASSERT_TRUE(calculateSplit(frame, result));
+    TEST_ASSERT_EQUAL_MEMORY(expected[frame], result, sizeof(result));
+  }
+}
+
+// Two sensors' tasks calculating at once: whoever finds the worker taken does its whole subpage itself
+void test_competing_callers_match_single_core()
+{
+  std::atomic<int> splits(0);
+  std::atomic<int> mismatches(0);
+  auto sensorTask = [&](int firstFrame) {
+    float result[768];
+    for (int round = 0; round < COMPETING_ROUNDS; round++)
+    {
+      int frame = (firstFrame + round) % FRAMES;
+      memset(result, 0, sizeof(result));
+      if (calculateSplit(frame, result))
+        splits++;
+      if (memcmp(expected[frame], result, sizeof(result)) != 0)
+        mismatches++;
+    }
+  };
+  std::thread first(sensorTask, 0);
+  std::thread second(sensorTask, FRAMES / 2);
+  first.join();
+  second.join();
+
+  TEST_ASSERT_EQUAL_INT(0, mismatches.load());
+  TEST_ASSERT_GREATER_THAN(0, splits.load());
+  TEST_ASSERT_LESS_OR_EQUAL(2 * COMPETING_ROUNDS, splits.load());
+}
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+  static simulatorMLX90640 simulator;
+  static transportMLX90640 transport;
+  uint16_t eeData[832];
+
+  // Frames of both subpages and modes, each with its own settled coefficient cache
+  MLX90640_SimulatorSyntheticEE(eeData);
+  MLX90640_SimulatorInit(&simulator, SENSOR_ADDRESS, eeData, false);
+  MLX90640_SimulatorTransport(&simulator, &transport);
+  int device = MLX90640_I2CAttach(SENSOR_ADDRESS, &transport);
+  MLX90640_ExtractParameters(eeData, &params);
+  MLX90640_CompileParameters(&params, &compiled);
+  for (int frame = 0; frame < FRAMES; frame++)
+  {
+    if (frame == FRAMES / 2)
+      MLX90640_SetChessMode(device);
+    MLX90640_SimulatorSetAmbient(&simulator, 20 + frame);
+    MLX90640_GetFrameData(device, frames[frame]);
+    MLX90640_InitFrameContext(&contexts[frame], 0, 0);
+    MLX90640_UpdateFrameContext(frames[frame], &params, &compiled, &contexts[frame]);
+    MLX90640_CalculateToCached(frames[frame], &params, &compiled, &contexts[frame], 0.95f, 23, expected[frame]);
+  }
+  MLX90640_I2CDetach(device);
+  workerBegin(1);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_wait_is_a_barrier);
+  RUN_TEST(test_second_caller_is_rejected_until_waited);
+  RUN_TEST(test_split_matches_single_core);
+  RUN_TEST(test_competing_callers_match_single_core);
+  return UNITY_END();
+}